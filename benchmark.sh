@@ -0,0 +1,129 @@
+#!/bin/bash
+
+# Builds the games with optimizations and runs each simulation core
+# headless at several board sizes. Compare the ticks/s and ns/tick columns
+# between commits to catch performance regressions in the game logic.
+# The ultimate tic-tac-toe search is timed at 1..N threads to check that
+# playouts/s scales with the cores, and so is the batch runner stepping
+# thousands of plugin game instances for agents. The leaderboard is filled
+# with a million games in a scratch directory to time appends and top-10
+# queries. Save states are written and resumed in a scratch directory at
+# the largest benchmarked sizes, and the same games are stepped back
+# through their rewind history. Snake battle mode is stepped with a
+# thousand AI snakes on one arena. The telemetry segment is updated ten
+# million times with and without a reader copying it concurrently.
+
+BUILD_DIR="${BUILD_DIR:-./bench_build}"
+TICKS="${TICKS:-200000}"
+SEED="${SEED:-1}"
+CC="${CC:-cc}"
+CFLAGS="${CFLAGS:--O2}"
+
+SNAKE_SIZES="15 64 256 1024 4096"
+CROSS_SIZES="40x21 100x50 200x100"
+# The snake autopilot: whole games on the small boards, decision speed on the big one
+AUTOPILOT_SIZES="16 32 256"
+AUTOPILOT_TICKS="${AUTOPILOT_TICKS:-1000000}"
+# Snake battle mode: SNAKES on one arena of SIZE (see src/battle.h)
+BATTLE_SIZE="${BATTLE_SIZE:-1024}"
+BATTLE_SNAKES="${BATTLE_SNAKES:-1000}"
+BATTLE_TICKS="${BATTLE_TICKS:-20000}"
+# A crowded river: up to 32 logs per lane, lengths 1-8, lanes at 1-4 ticks per move
+CROSS_DENSE="--logs 32 --log-length 8 --speeds 4"
+# MCTS playouts per thread count for ultimate, run at 1..all cores
+PLAYOUTS="${PLAYOUTS:-400000}"
+# Batch runner: instances of each plugin game stepped STEPS times at 1..all cores
+INSTANCES="${INSTANCES:-4096}"
+BATCH_STEPS="${BATCH_STEPS:-500}"
+# Games recorded on a scratch leaderboard (see src/scores.h)
+SCORES_RECORDS="${SCORES_RECORDS:-1000000}"
+# Frames published to a scratch telemetry segment (see src/telemetry.h)
+TELEMETRY_FRAMES="${TELEMETRY_FRAMES:-10000000}"
+
+mkdir -p "$BUILD_DIR"
+
+echo "Building benchmark binaries in $BUILD_DIR..."
+# The standalone games present frames on a thread (see src/render_thread.h)
+for GAME in snake cross; do
+    $CC $CFLAGS -pthread -o "$BUILD_DIR/game_$GAME" "src/$GAME.c"
+    if [ $? -ne 0 ]; then
+        echo "Error: Failed to build $GAME."
+        exit 1
+    fi
+done
+# The plugin builds the menu loads in-process (see src/plugin.h)
+for GAME in snake cross; do
+    $CC $CFLAGS -shared -fPIC -DATAR_PLUGIN -o "$BUILD_DIR/game_$GAME.so" "src/$GAME.c"
+    if [ $? -ne 0 ]; then
+        echo "Error: Failed to build the $GAME plugin."
+        exit 1
+    fi
+done
+$CC $CFLAGS -pthread -o "$BUILD_DIR/game_ultimate" src/ultimate.c -lm
+if [ $? -ne 0 ]; then
+    echo "Error: Failed to build ultimate."
+    exit 1
+fi
+
+$CC $CFLAGS -pthread -o "$BUILD_DIR/atar_batch" src/batch.c -ldl
+if [ $? -ne 0 ]; then
+    echo "Error: Failed to build the batch runner."
+    exit 1
+fi
+
+$CC $CFLAGS -o "$BUILD_DIR/atar_scores" src/scores.c
+if [ $? -ne 0 ]; then
+    echo "Error: Failed to build the scores tool."
+    exit 1
+fi
+
+$CC $CFLAGS -pthread -o "$BUILD_DIR/atar_stats" src/stats.c
+if [ $? -ne 0 ]; then
+    echo "Error: Failed to build the telemetry dumper."
+    exit 1
+fi
+
+# The xox2P tablebase is generated ahead of time; make sure it is still right
+$CC $CFLAGS -o "$BUILD_DIR/xox_tablegen" src/xox_tablegen.c && "$BUILD_DIR/xox_tablegen" --check
+if [ $? -ne 0 ]; then
+    echo "Error: src/xox_table.h disagrees with exhaustive search."
+    exit 1
+fi
+
+echo "Running $TICKS ticks per configuration (seed $SEED)..."
+for SIZE in $SNAKE_SIZES; do
+    "$BUILD_DIR/game_snake" --size "$SIZE" --headless "$TICKS" --seed "$SEED" || exit 1
+done
+for SIZE in $AUTOPILOT_SIZES; do
+    "$BUILD_DIR/game_snake" --size "$SIZE" --headless "$AUTOPILOT_TICKS" --autopilot --seed "$SEED" || exit 1
+done
+"$BUILD_DIR/game_snake" --size "$BATTLE_SIZE" --battle "$BATTLE_SNAKES" --headless "$BATTLE_TICKS" \
+    --seed "$SEED" || exit 1
+for SIZE in $CROSS_SIZES; do
+    "$BUILD_DIR/game_cross" --size "$SIZE" --headless "$TICKS" --seed "$SEED" || exit 1
+    "$BUILD_DIR/game_cross" --size "$SIZE" $CROSS_DENSE --headless "$TICKS" --seed "$SEED" || exit 1
+done
+"$BUILD_DIR/game_ultimate" --bench --playouts "$PLAYOUTS" --seed "$SEED" || exit 1
+for GAME in snake cross; do
+    "$BUILD_DIR/atar_batch" "$BUILD_DIR/game_$GAME.so" --instances "$INSTANCES" --steps "$BATCH_STEPS" \
+        --seed "$SEED" || exit 1
+done
+
+SNAPSHOT_DIR=$(mktemp -d)
+ATAR_STORAGE="$SNAPSHOT_DIR" "$BUILD_DIR/game_snake" --size 4096 --headless "$TICKS" --seed "$SEED" --snapshot \
+    --rewind &&
+ATAR_STORAGE="$SNAPSHOT_DIR" "$BUILD_DIR/game_cross" --size 200x100 $CROSS_DENSE --headless "$TICKS" \
+    --seed "$SEED" --snapshot --rewind
+STATUS=$?
+rm -rf "$SNAPSHOT_DIR"
+[ $STATUS -eq 0 ] || exit 1
+
+SCORES_DIR=$(mktemp -d)
+ATAR_STORAGE="$SCORES_DIR" "$BUILD_DIR/atar_scores" --bench "$SCORES_RECORDS" --seed "$SEED"
+STATUS=$?
+rm -rf "$SCORES_DIR"
+[ $STATUS -eq 0 ] || exit 1
+
+"$BUILD_DIR/atar_stats" --bench "$TELEMETRY_FRAMES" || exit 1
+
+echo "Benchmark completed successfully!"
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "bench.h"
+#include "replay.h"
+#include "batch.h"
+
+// Batch runner: plays thousands of instances of a plugin game (see
+// plugin.h) at once with a random agent and times the steps, at 1..N
+// threads to check that steps/s scales with the cores. The checksum of
+// the final observations must not change with the thread count.
+//
+//   cc -O2 -pthread -o atar_batch src/batch.c -ldl
+//   ./atar_batch ./game_snake.so --instances 4096 --steps 1000
+
+#define DEFAULT_INSTANCES 4096
+#define DEFAULT_STEPS 1000
+#define MAX_INSTANCES (1 << 24)
+
+// Press one of the game's keys, or none a fifth of the time
+char random_policy(const uint8_t *obs, Rng *rng, void *ctx) {
+    const char *actions = ctx;
+    uint32_t pick = rng_below(rng, strlen(actions) * 5 / 4 + 1);
+    return pick < strlen(actions) ? actions[pick] : 0;
+}
+
+// Run instances copies of the game for steps steps on threads threads and
+// print the rate against single, the single-thread rate (0 if this is it).
+// Returns the steps per second, or 0 if the batch could not be started.
+double run_batch(const AtarPlugin *api, int instances, long steps, int threads, uint64_t seed,
+                 double single) {
+    Batch batch;
+    long total_steps, episodes;
+    int64_t reward;
+
+    if (!batch_init(&batch, api, instances, threads, seed, random_policy, (void *)api->actions)) {
+        fprintf(stderr, "Failed to start %d instances of %s\n", instances, api->name);
+        return 0;
+    }
+    uint64_t start = bench_now_ns();
+    for (long i = 0; i < steps; i++) {
+        batch_step(&batch, NULL);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    batch_totals(&batch, &total_steps, &episodes, &reward);
+    uint64_t checksum = replay_hash(REPLAY_HASH_INIT, batch.obs, (size_t)instances * api->obs_size);
+    double rate = total_steps / (elapsed / 1e9);
+
+    printf("%2d threads %12.0f steps/s  speedup %5.2f  %9ld episodes  mean length %6.1f  "
+           "reward %+lld  obs %016llx\n",
+           batch.threads, rate, single ? rate / single : 1.0, episodes,
+           episodes ? (double)total_steps / episodes : 0.0, (long long)reward,
+           (unsigned long long)checksum);
+    batch_free(&batch);
+    return rate;
+}
+
+// Print the command-line help
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s PLUGIN [--instances N] [--steps N] [--threads MAX] [--seed N]\n"
+                    "Steps N instances (default %d) of the plugin's game N times (default %d)\n"
+                    "with a random agent, at 1..MAX threads (default: all cores).\n",
+            program, DEFAULT_INSTANCES, DEFAULT_STEPS);
+}
+
+int main(int argc, char *argv[]) {
+    PluginModule module;
+    const char *path = NULL;
+    long instances = DEFAULT_INSTANCES, steps = DEFAULT_STEPS;
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = time(NULL);
+
+    if (max_threads < 1) max_threads = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            instances = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            max_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path || instances < 1 || instances > MAX_INSTANCES || steps < 1 ||
+        max_threads < 1 || max_threads > BATCH_MAX_THREADS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (plugin_open(&module, path) < 0) {
+        fprintf(stderr, "%s\n", module.error);
+        return 1;
+    }
+    if (!plugin_has_agents(module.api)) {
+        fprintf(stderr, "%s has no agent interface\n", path);
+        plugin_close(&module);
+        return 1;
+    }
+
+    printf("%s batch: %ld instances x %ld steps, %u-byte observations, seed %llu\n",
+           module.api->name, instances, steps, module.api->obs_size, (unsigned long long)seed);
+    double single = 0;
+    for (int threads = 1; threads <= max_threads; threads++) {
+        double rate = run_batch(module.api, instances, steps, threads, seed, single);
+        if (rate == 0) break;
+        if (threads == 1) single = rate;
+    }
+    plugin_close(&module);
+    return 0;
+}
@@ -0,0 +1,284 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "plugin.h"
+#include "rng.h"
+
+// Batch simulation of many independent instances of one plugin game, for
+// agents that learn or are evaluated over thousands of episodes.
+//
+// The instances' state blocks sit side by side in one allocation, each on
+// its own cache lines. batch_step() advances every instance by one tick on
+// a pool of threads: each worker starts with an equal share of the
+// instances and claims BATCH_CHUNK at a time from the front of its range;
+// a worker that runs out steals the back half of another worker's range.
+// Instances whose episode ends are reset in place and keep going.
+//
+// The agent sees the batch as arrays indexed by instance: obs (obs_size
+// bytes each, see plugin.h), rewards (score gained in the last step) and
+// dones (the episode ended in the last step, obs already shows the next
+// one). Each step takes one key per instance, 0 for none, either from the
+// caller or from a policy the workers call on each instance's observation.
+// Every instance has its own Rng for the policy, so the results don't
+// depend on the number of threads or on who stole what.
+
+#define BATCH_CHUNK 64         // Instances a worker claims at a time
+#define BATCH_MAX_THREADS 256
+
+// Pick a key for one instance from its observation, 0 for none
+typedef char (*BatchPolicy)(const uint8_t *obs, Rng *rng, void *ctx);
+
+typedef struct Batch Batch;
+
+typedef struct {
+    uint64_t range;            // Instances left to step: end << 32 | next
+    Batch *batch;
+    int index;
+    pthread_t thread;
+    uint64_t seen;             // Last generation this worker ran
+    long steps, episodes;      // Counted by the worker, summed by batch_totals()
+    int64_t reward;
+} __attribute__((aligned(64))) BatchWorker;
+
+struct Batch {
+    const AtarPlugin *api;
+    int count;                 // Instances
+    size_t stride;             // Bytes per state block, a multiple of 64
+    uint8_t *states;
+    uint8_t *obs;              // count * obs_size
+    int32_t *rewards;
+    uint8_t *dones;
+    Rng *rngs;                 // Per-instance randomness for the policy
+    BatchPolicy policy;
+    void *policy_ctx;
+    const char *keys;          // Keys for the step running now, NULL to ask the policy
+
+    // Thread pool: batch_step() bumps generation and waits until busy is 0
+    int threads;
+    BatchWorker *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, idle;
+    uint64_t generation;
+    int busy, quit;
+};
+
+// Claim up to BATCH_CHUNK instances from the front of the worker's own range
+static inline int batch_claim(BatchWorker *w, uint32_t *first, uint32_t *last) {
+    uint64_t range = __atomic_load_n(&w->range, __ATOMIC_RELAXED);
+    for (;;) {
+        uint32_t next = (uint32_t)range, end = range >> 32;
+        if (next >= end) return 0;
+        uint32_t take = end - next < BATCH_CHUNK ? end : next + BATCH_CHUNK;
+        if (__atomic_compare_exchange_n(&w->range, &range, (uint64_t)end << 32 | take, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            *first = next;
+            *last = take;
+            return 1;
+        }
+    }
+}
+
+// Take the back half of another worker's range
+static inline int batch_steal(BatchWorker *victim, uint32_t *first, uint32_t *last) {
+    uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_RELAXED);
+    for (;;) {
+        uint32_t next = (uint32_t)range, end = range >> 32;
+        if (next >= end) return 0;
+        uint32_t middle = next + (end - next) / 2;
+        if (__atomic_compare_exchange_n(&victim->range, &range, (uint64_t)middle << 32 | next, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            *first = middle;
+            *last = end;
+            return 1;
+        }
+    }
+}
+
+// Step instances first..last-1 and observe the result
+static inline void batch_run(Batch *b, BatchWorker *w, uint32_t first, uint32_t last) {
+    const AtarPlugin *api = b->api;
+    for (uint32_t i = first; i < last; i++) {
+        void *state = b->states + (size_t)i * b->stride;
+        uint8_t *obs = b->obs + (size_t)i * api->obs_size;
+        char key = b->keys ? b->keys[i] : b->policy(obs, &b->rngs[i], b->policy_ctx);
+
+        int64_t before = api->score(state);
+        if (key) api->input(state, key); // Quitting means nothing to an agent
+        api->tick(state);
+        b->rewards[i] = api->score(state) - before;
+        b->dones[i] = api->done(state) != 0;
+        w->steps++;
+        w->reward += b->rewards[i];
+        if (b->dones[i]) {
+            w->episodes++;
+            api->reset(state);
+        }
+        api->observe(state, obs);
+    }
+}
+
+// Drain the worker's own range, then steal until every range is empty.
+// Stolen work moves into the thief's range, so no instance is left behind
+// when a worker gives up.
+static inline void batch_work(BatchWorker *w) {
+    Batch *b = w->batch;
+    uint32_t first, last;
+    for (;;) {
+        while (batch_claim(w, &first, &last)) {
+            batch_run(b, w, first, last);
+        }
+        int stolen = 0;
+        for (int k = 1; k < b->threads && !stolen; k++) {
+            stolen = batch_steal(&b->workers[(w->index + k) % b->threads], &first, &last);
+        }
+        if (!stolen) return;
+        // Nobody steals from an empty range, so it is safe to overwrite
+        __atomic_store_n(&w->range, (uint64_t)last << 32 | first, __ATOMIC_RELEASE);
+    }
+}
+
+static inline void *batch_thread(void *arg) {
+    BatchWorker *w = arg;
+    Batch *b = w->batch;
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        while (b->generation == w->seen && !b->quit) {
+            pthread_cond_wait(&b->wake, &b->lock);
+        }
+        w->seen = b->generation;
+        int quit = b->quit;
+        pthread_mutex_unlock(&b->lock);
+        if (quit) return NULL;
+
+        batch_work(w);
+
+        pthread_mutex_lock(&b->lock);
+        if (--b->busy == 0) pthread_cond_signal(&b->idle);
+        pthread_mutex_unlock(&b->lock);
+    }
+}
+
+// Advance every instance by one tick. keys holds one key per instance, or
+// is NULL to let the policy choose.
+static inline void batch_step(Batch *b, const char *keys) {
+    b->keys = keys;
+    for (int i = 0; i < b->threads; i++) {
+        uint64_t first = (uint64_t)b->count * i / b->threads;
+        uint64_t end = (uint64_t)b->count * (i + 1) / b->threads;
+        __atomic_store_n(&b->workers[i].range, end << 32 | first, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_lock(&b->lock);
+    b->generation++;
+    b->busy = b->threads - 1;
+    pthread_cond_broadcast(&b->wake);
+    pthread_mutex_unlock(&b->lock);
+
+    batch_work(&b->workers[0]); // Worker 0 is the calling thread
+
+    pthread_mutex_lock(&b->lock);
+    while (b->busy > 0) {
+        pthread_cond_wait(&b->idle, &b->lock);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+// Totals over all workers since batch_init()
+static inline void batch_totals(const Batch *b, long *steps, long *episodes, int64_t *reward) {
+    *steps = *episodes = 0;
+    *reward = 0;
+    for (int i = 0; i < b->threads; i++) {
+        *steps += b->workers[i].steps;
+        *episodes += b->workers[i].episodes;
+        *reward += b->workers[i].reward;
+    }
+}
+
+static inline void batch_free(Batch *b) {
+    if (b->workers) {
+        pthread_mutex_lock(&b->lock);
+        b->quit = 1;
+        pthread_cond_broadcast(&b->wake);
+        pthread_mutex_unlock(&b->lock);
+        for (int i = 1; i < b->threads; i++) {
+            pthread_join(b->workers[i].thread, NULL);
+        }
+        pthread_mutex_destroy(&b->lock);
+        pthread_cond_destroy(&b->wake);
+        pthread_cond_destroy(&b->idle);
+    }
+    for (int i = 0; b->states && i < b->count; i++) {
+        b->api->shutdown(b->states + (size_t)i * b->stride);
+    }
+    free(b->states);
+    free(b->obs);
+    free(b->rewards);
+    free(b->dones);
+    free(b->rngs);
+    free(b->workers);
+    memset(b, 0, sizeof(*b));
+}
+
+// Start count instances of the game, seeded from seed, and threads workers.
+// Returns 0 on failure. The game must have the agent interface.
+static inline int batch_init(Batch *b, const AtarPlugin *api, int count, int threads, uint64_t seed,
+                             BatchPolicy policy, void *policy_ctx) {
+    Rng seeds;
+    memset(b, 0, sizeof(*b));
+    if (!plugin_has_agents(api) || count < 1 || threads < 1 || threads > BATCH_MAX_THREADS) return 0;
+    b->api = api;
+    b->policy = policy;
+    b->policy_ctx = policy_ctx;
+    b->stride = (api->state_size + 63) & ~(size_t)63;
+    b->states = aligned_alloc(64, b->stride * count);
+    b->obs = malloc((size_t)count * api->obs_size);
+    b->rewards = calloc(count, sizeof(int32_t));
+    b->dones = calloc(count, 1);
+    b->rngs = malloc(count * sizeof(Rng));
+    if (!b->states || !b->obs || !b->rewards || !b->dones || !b->rngs) {
+        batch_free(b);
+        return 0;
+    }
+    memset(b->states, 0, b->stride * count);
+
+    // Nothing is drawn, the terminal size only matters for a game's view
+    rng_seed(&seeds, seed);
+    for (int i = 0; i < count; i++) {
+        void *state = b->states + (size_t)i * b->stride;
+        if (!api->init(state, 24, 80, rng_next(&seeds))) {
+            b->count = i;
+            batch_free(b);
+            return 0;
+        }
+        b->count = i + 1;
+        rng_seed(&b->rngs[i], rng_next(&seeds));
+        api->observe(state, b->obs + (size_t)i * api->obs_size);
+    }
+
+    b->workers = aligned_alloc(64, threads * sizeof(BatchWorker));
+    if (!b->workers) {
+        batch_free(b);
+        return 0;
+    }
+    memset(b->workers, 0, threads * sizeof(BatchWorker));
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->wake, NULL);
+    pthread_cond_init(&b->idle, NULL);
+    b->threads = 1;
+    b->workers[0].batch = b;
+    for (int i = 1; i < threads; i++) {
+        b->workers[i].batch = b;
+        b->workers[i].index = i;
+        if (pthread_create(&b->workers[i].thread, NULL, batch_thread, &b->workers[i]) != 0) {
+            break; // Carry on with the workers we have
+        }
+        b->threads = i + 1;
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,350 @@
+#ifndef BATTLE_H
+#define BATTLE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rng.h"
+
+// Battle mode for snake: hundreds to thousands of snakes in one arena,
+// all but the player's steered by a simple AI. A snake dies on a wall or
+// on a body, its own or another's; two heads meeting on the same cell
+// leave the longer snake alive, or neither if they are as long. Half of a
+// dead snake's body turns into food, and it comes back after a while
+// somewhere else.
+//
+// The arena is one ownership grid: the id (plus one) of the snake on each
+// cell, BATTLE_EMPTY or BATTLE_FOOD. Next to it, each body cell keeps the
+// direction to the next segment toward the head, so a tail moves on in
+// O(1) without any per-snake body storage, and a dead snake is cleared by
+// walking from its tail to its head.
+//
+// Snakes are kept as a structure of arrays, padded to whole blocks of
+// BATTLE_LANES, so the movement pass (next head, off-arena check, target
+// cell) runs over fixed-width blocks the compiler turns into vector code.
+// Collisions are then resolved in a single pass over the snakes in id
+// order: a head reaching a cell another head took earlier in the same pass
+// is a head-on meeting, anything else on the cell is a body. Tails move
+// before heads, so a head may follow a tail into the cell it leaves.
+
+#define BATTLE_EMPTY 0
+#define BATTLE_FOOD 0xFFFF
+#define BATTLE_MAX_SNAKES 65534
+#define BATTLE_LANES 8             // Snakes per block of the movement pass
+#define BATTLE_SPAWN_GROWTH 2      // A new snake is one cell and grows this much
+#define BATTLE_FOOD_GROWTH 1       // Cells grown per food eaten
+#define BATTLE_FOOD_PER_SNAKE 2    // Food kept on the arena per snake
+#define BATTLE_RESPAWN_TICKS 20    // Ticks a dead snake stays out
+#define BATTLE_SPAWN_TRIES 8       // Random cells tried per food or snake placed per tick
+
+// Directions in the order snake.c numbers them: up, left, down, right
+static const int8_t battle_dx[4] = {-1, 0, 1, 0};
+static const int8_t battle_dy[4] = {0, -1, 0, 1};
+
+typedef struct {
+    int rows, cols, cells;
+    uint16_t *owner;           // Per cell: snake id + 1, BATTLE_EMPTY or BATTLE_FOOD
+    uint8_t *toward;           // Per body cell: direction of the next segment toward the head
+    int count;                 // Snakes
+    int blocks;                // Blocks of BATTLE_LANES snakes, the last one padded
+    int player;                // Snake steered by battle_turn(), -1 for none
+
+    // Per snake, BATTLE_LANES * blocks entries each
+    int32_t *hx, *hy;          // Head row and column
+    int32_t *dx, *dy;          // Step of the coming move
+    int32_t *target;           // Cell the head moves to this tick
+    int32_t *off;              // Nonzero if that is off the arena
+    int32_t *tail;             // Tail cell
+    int32_t *length;           // Cells covered
+    int32_t *grow;             // Cells still to grow, never 0 while length is 1
+    int32_t *respawn;          // Ticks until a dead snake comes back
+    int32_t *kills;
+    uint8_t *dir;              // Direction of the coming move
+    uint8_t *alive;
+
+    int32_t *dying;            // Snakes that died this tick
+    int dying_count;
+    int player_dir;            // Turn asked for the player, -1 for none
+    int alive_count;
+    int food, food_target;
+    Rng rng;
+    uint64_t ticks;
+    uint64_t deaths;           // Totals since the start
+    uint64_t head_on;          // Head-on meetings
+    uint64_t eaten;
+} Battle;
+
+// Allocate an arena of rows x cols for count snakes, returns 0 on failure
+static inline int battle_init(Battle *b, int rows, int cols, int count, uint64_t seed) {
+    memset(b, 0, sizeof(*b));
+    b->rows = rows;
+    b->cols = cols;
+    b->cells = rows * cols;
+    b->count = count;
+    b->blocks = (count + BATTLE_LANES - 1) / BATTLE_LANES;
+    b->player = -1;
+    b->player_dir = -1;
+    b->food_target = count * BATTLE_FOOD_PER_SNAKE < b->cells / 4 ? count * BATTLE_FOOD_PER_SNAKE
+                                                                   : b->cells / 4;
+    rng_seed(&b->rng, seed);
+
+    size_t n = (size_t)b->blocks * BATTLE_LANES;
+    b->owner = calloc(b->cells, sizeof(uint16_t));
+    b->toward = calloc(b->cells, 1);
+    int32_t **fields[] = {&b->hx, &b->hy, &b->dx, &b->dy, &b->target, &b->off, &b->tail,
+                          &b->length, &b->grow, &b->respawn, &b->kills, &b->dying};
+    int ok = b->owner && b->toward;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        *fields[i] = calloc(n, sizeof(int32_t));
+        ok = ok && *fields[i];
+    }
+    b->dir = calloc(n, 1);
+    b->alive = calloc(n, 1);
+    return ok && b->dir && b->alive;
+}
+
+static inline void battle_free(Battle *b) {
+    int32_t *fields[] = {b->hx, b->hy, b->dx, b->dy, b->target, b->off, b->tail,
+                         b->length, b->grow, b->respawn, b->kills, b->dying};
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) free(fields[i]);
+    free(b->owner);
+    free(b->toward);
+    free(b->dir);
+    free(b->alive);
+    memset(b, 0, sizeof(*b));
+}
+
+static inline void battle_set_dir(Battle *b, int i, int dir) {
+    b->dir[i] = dir;
+    b->dx[i] = battle_dx[dir];
+    b->dy[i] = battle_dy[dir];
+}
+
+// What is on a cell for a snake thinking of moving there: 0 wall or body,
+// 1 empty, 2 food
+static inline int battle_look(const Battle *b, int x, int y) {
+    if ((unsigned)x >= (unsigned)b->rows || (unsigned)y >= (unsigned)b->cols) return 0;
+    uint16_t o = b->owner[x * b->cols + y];
+    return o == BATTLE_EMPTY ? 1 : o == BATTLE_FOOD ? 2 : 0;
+}
+
+// Put snake i back on a random empty cell, returns 0 if none was found
+static inline int battle_spawn(Battle *b, int i) {
+    for (int tries = 0; tries < BATTLE_SPAWN_TRIES; tries++) {
+        int cell = rng_below(&b->rng, b->cells);
+        if (b->owner[cell] != BATTLE_EMPTY) continue;
+        b->owner[cell] = i + 1;
+        b->hx[i] = cell / b->cols;
+        b->hy[i] = cell % b->cols;
+        b->tail[i] = cell;
+        b->length[i] = 1;
+        b->grow[i] = BATTLE_SPAWN_GROWTH;
+        b->alive[i] = 1;
+        battle_set_dir(b, i, rng_below(&b->rng, 4));
+        b->alive_count++;
+        return 1;
+    }
+    return 0;
+}
+
+// Top the food up towards food_target
+static inline void battle_feed(Battle *b) {
+    for (int tries = 0; b->food < b->food_target && tries < BATTLE_SPAWN_TRIES; tries++) {
+        int cell = rng_below(&b->rng, b->cells);
+        if (b->owner[cell] != BATTLE_EMPTY) continue;
+        b->owner[cell] = BATTLE_FOOD;
+        b->food++;
+    }
+}
+
+// Empty the arena and place every snake and the food afresh
+static inline void battle_reset(Battle *b) {
+    memset(b->owner, 0, b->cells * sizeof(uint16_t));
+    memset(b->alive, 0, (size_t)b->blocks * BATTLE_LANES);
+    b->alive_count = b->food = 0;
+    for (int i = 0; i < b->count; i++) {
+        b->kills[i] = 0;
+        b->respawn[i] = 0;
+        battle_spawn(b, i);
+    }
+    for (int i = 0; i < b->food_target; i++) battle_feed(b);
+}
+
+// Choose the coming move of an AI snake: food next to the head if there is
+// any, else straight on, turning now and then or to keep off walls and
+// bodies. It looks one cell ahead, and two straight ahead.
+static inline void battle_steer(Battle *b, int i) {
+    uint32_t r = rng_next(&b->rng) >> 32;
+    int x = b->hx[i], y = b->hy[i], ahead = b->dir[i];
+    int best = -1, best_score = -1;
+    for (int k = 0; k < 3; k++) {
+        int d = (ahead + (k == 0 ? 0 : k == 1 ? 1 : 3)) & 3; // Straight, left, right
+        int nx = x + battle_dx[d], ny = y + battle_dy[d];
+        int cell = battle_look(b, nx, ny);
+        if (!cell) continue;
+        int score = cell * 8 + battle_look(b, nx + battle_dx[d], ny + battle_dy[d]) * 2;
+        if (k == 0 && (r & 15) != 0) score += 3; // Mostly keep going
+        score += (r >> (4 + 2 * k)) & 3;        // Break ties at random
+        if (score > best_score) {
+            best_score = score;
+            best = d;
+        }
+    }
+    if (best >= 0) battle_set_dir(b, i, best);
+}
+
+// Ask for the player's snake to turn; reversing onto the body is ignored
+static inline void battle_turn(Battle *b, int dir) {
+    b->player_dir = dir;
+}
+
+// Kill snake i this tick; its body is cleared once every head has moved
+static inline void battle_kill(Battle *b, int i) {
+    b->alive[i] = 0;
+    b->alive_count--;
+    b->deaths++;
+    b->respawn[i] = BATTLE_RESPAWN_TICKS;
+    b->dying[b->dying_count++] = i;
+}
+
+// Take the cell a head moved to
+static inline void battle_claim(Battle *b, int i, int cell) {
+    b->owner[cell] = i + 1;
+    b->hx[i] += b->dx[i];
+    b->hy[i] += b->dy[i];
+}
+
+// Clear a dead snake from its tail to its head, every other cell turning
+// into food. Cells another head has taken meanwhile are left alone.
+static inline void battle_clear(Battle *b, int i) {
+    int cell = b->tail[i], head = b->hx[i] * b->cols + b->hy[i];
+    uint16_t id = i + 1;
+    for (int n = 0;; n++) {
+        if (b->owner[cell] == id) {
+            int food = (n & 1) != 0;
+            b->owner[cell] = food ? BATTLE_FOOD : BATTLE_EMPTY;
+            b->food += food;
+        }
+        if (cell == head) break;
+        int d = b->toward[cell];
+        cell += battle_dx[d] * b->cols + battle_dy[d];
+    }
+}
+
+// Next head cell of BATTLE_LANES snakes, and whether it is off the arena.
+// The fixed width and the restrict pointers let this become vector code.
+static inline void battle_move_block(const int32_t *restrict hx, const int32_t *restrict hy,
+                                     const int32_t *restrict dx, const int32_t *restrict dy,
+                                     int32_t *restrict target, int32_t *restrict off,
+                                     int rows, int cols) {
+    for (int k = 0; k < BATTLE_LANES; k++) {
+        int32_t nx = hx[k] + dx[k], ny = hy[k] + dy[k];
+        off[k] = ((uint32_t)nx >= (uint32_t)rows) | ((uint32_t)ny >= (uint32_t)cols);
+        target[k] = nx * cols + ny;
+    }
+}
+
+// Advance every snake by one tick
+static inline void battle_step(Battle *b) {
+    int rows = b->rows, cols = b->cols;
+
+    // Steering: the AI for most snakes, the last key for the player's
+    for (int i = 0; i < b->count; i++) {
+        if (!b->alive[i]) continue;
+        if (i != b->player) {
+            battle_steer(b, i);
+        } else if (b->player_dir >= 0 && b->player_dir != ((b->dir[i] + 2) & 3)) {
+            battle_set_dir(b, i, b->player_dir);
+        }
+    }
+    b->player_dir = -1;
+
+    // Movement: where every head goes, a block of snakes at a time. Dead
+    // snakes and the padding are computed too and ignored.
+    for (int block = 0; block < b->blocks; block++) {
+        int first = block * BATTLE_LANES;
+        battle_move_block(b->hx + first, b->hy + first, b->dx + first, b->dy + first,
+                          b->target + first, b->off + first, rows, cols);
+    }
+
+    // Tails move first, unless the snake is growing. The head's cell
+    // records the move so the tail can follow it later.
+    for (int i = 0; i < b->count; i++) {
+        if (!b->alive[i]) continue;
+        b->toward[b->hx[i] * cols + b->hy[i]] = b->dir[i];
+        if (b->grow[i] > 0) {
+            b->grow[i]--;
+            b->length[i]++;
+            continue;
+        }
+        int tail = b->tail[i], d = b->toward[tail];
+        b->owner[tail] = BATTLE_EMPTY;
+        b->tail[i] = tail + battle_dx[d] * cols + battle_dy[d];
+    }
+
+    // Heads, in one pass. A cell held by a snake processed earlier whose
+    // head is now there was taken this tick: a head-on meeting.
+    b->dying_count = 0;
+    for (int i = 0; i < b->count; i++) {
+        if (!b->alive[i]) continue;
+        if (b->off[i]) {
+            battle_kill(b, i);
+            continue;
+        }
+        int cell = b->target[i];
+        uint16_t o = b->owner[cell];
+        if (o == BATTLE_EMPTY) {
+            battle_claim(b, i, cell);
+        } else if (o == BATTLE_FOOD) {
+            b->food--;
+            b->eaten++;
+            b->grow[i] += BATTLE_FOOD_GROWTH;
+            battle_claim(b, i, cell);
+        } else {
+            int j = o - 1;
+            if (j < i && b->alive[j] && b->hx[j] * cols + b->hy[j] == cell) {
+                b->head_on++;
+                if (b->length[i] > b->length[j]) {
+                    battle_kill(b, j);
+                    b->kills[i]++;
+                    battle_claim(b, i, cell);
+                } else {
+                    battle_kill(b, i);
+                    if (b->length[i] == b->length[j]) {
+                        battle_kill(b, j);
+                    } else {
+                        b->kills[j]++;
+                    }
+                }
+            } else {
+                battle_kill(b, i);
+                if (j != i) b->kills[j]++;
+            }
+        }
+    }
+    for (int k = 0; k < b->dying_count; k++) battle_clear(b, b->dying[k]);
+
+    // The dead come back after a while, food is topped up
+    for (int i = 0; i < b->count; i++) {
+        if (!b->alive[i] && --b->respawn[i] <= 0) battle_spawn(b, i);
+    }
+    battle_feed(b);
+    b->ticks++;
+}
+
+// Hash of the arena and every snake, for checking that two runs agree
+static inline uint64_t battle_hash(const Battle *b) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const uint8_t *bytes = (const uint8_t *)b->owner;
+    for (size_t i = 0; i < b->cells * sizeof(uint16_t); i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    for (int i = 0; i < b->count; i++) {
+        uint64_t v = (uint64_t)b->length[i] << 32 | (uint32_t)b->tail[i];
+        hash = (hash ^ v) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+// Headless benchmarking helpers shared by the games.
+//
+// A headless run times every simulation tick with the monotonic clock,
+// keeps the samples in a buffer allocated up front and reports throughput,
+// latency percentiles and the number of heap allocations made while the
+// simulation was running.
+
+// Count heap allocations by interposing the glibc allocator entry points
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long bench_alloc_count;
+
+void *malloc(size_t size) {
+    __atomic_fetch_add(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    __atomic_fetch_add(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_fetch_add(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+static inline unsigned long bench_allocations() {
+    return __atomic_load_n(&bench_alloc_count, __ATOMIC_RELAXED);
+}
+#else
+static inline unsigned long bench_allocations() {
+    return 0;
+}
+#endif
+
+typedef struct {
+    uint32_t *samples;        // Nanoseconds per tick
+    long count, cap;
+    uint64_t start_ns, end_ns;
+    unsigned long allocs;     // Allocations made between begin and end
+} BenchRun;
+
+// Current monotonic time in nanoseconds
+static inline uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Prepare a run of up to ticks samples, returns -1 if out of memory
+static inline int bench_begin(BenchRun *run, long ticks) {
+    run->samples = malloc(ticks * sizeof(uint32_t));
+    if (!run->samples) return -1;
+    run->count = 0;
+    run->cap = ticks;
+    run->allocs = bench_allocations();
+    run->start_ns = bench_now_ns();
+    return 0;
+}
+
+// Record one tick that started at start_ns
+static inline void bench_sample(BenchRun *run, uint64_t start_ns) {
+    uint64_t elapsed = bench_now_ns() - start_ns;
+    if (run->count < run->cap) {
+        run->samples[run->count++] = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+    }
+}
+
+static inline void bench_end(BenchRun *run) {
+    run->end_ns = bench_now_ns();
+    run->allocs = bench_allocations() - run->allocs;
+}
+
+static int bench_compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sample at the given fraction of the sorted samples
+static inline uint32_t bench_percentile(const BenchRun *run, double fraction) {
+    long index = (long)(fraction * (run->count - 1) + 0.5);
+    return run->samples[index];
+}
+
+// Print one result line and release the samples
+static inline void bench_report(BenchRun *run, FILE *f, const char *label) {
+    if (run->count == 0) {
+        fprintf(f, "%-24s no ticks recorded\n", label);
+        free(run->samples);
+        return;
+    }
+    qsort(run->samples, run->count, sizeof(uint32_t), bench_compare_u32);
+    double seconds = (run->end_ns - run->start_ns) / 1e9;
+    fprintf(f, "%-24s %10ld ticks %12.0f ticks/s  ns/tick p50 %6u p90 %6u p99 %7u max %8u  allocs %lu\n",
+            label, run->count, run->count / seconds,
+            bench_percentile(run, 0.50), bench_percentile(run, 0.90),
+            bench_percentile(run, 0.99), run->samples[run->count - 1], run->allocs);
+    free(run->samples);
+}
+
+#endif
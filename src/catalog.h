@@ -0,0 +1,282 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+// Catalog of the game_* executables and game_*.so plugins (see plugin.h)
+// in the game directory. A plugin is listed under the same title as the
+// executable it replaces and shadows it, so the menu runs it in-process.
+//
+// The catalog is saved next to the binaries in CATALOG_FILE together with
+// the directory's mtime. At startup, if the directory hasn't changed since
+// the file was written, only the listed games are stat()ed again instead
+// of reading the whole directory. An inotify watch then keeps the catalog
+// up to date while the menu runs, so games that are installed, replaced
+// or removed show up without a restart.
+
+#define CATALOG_FILE ".atar_catalog"
+#define CATALOG_VERSION 2 // 2: plugins
+#define CATALOG_PREFIX "game_"
+#define CATALOG_PLUGIN_SUFFIX ".so"
+#define CATALOG_NAME_MAX 64
+
+typedef struct {
+    char title[CATALOG_NAME_MAX];  // Shown in the menu: "game_snake" -> "Snake"
+    char path[CATALOG_NAME_MAX];   // File name in the game directory
+    int64_t mtime_ns;
+    int64_t size;
+    int32_t plugin;                // Loaded in-process rather than executed
+    int32_t reserved;
+} CatalogEntry;
+
+typedef struct {
+    char magic[4];                 // "ATCG"
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+    int64_t dir_mtime_ns;          // Directory mtime once the file was in place
+} CatalogHeader;
+
+typedef struct {
+    CatalogEntry *entries;         // Sorted by title
+    int count, cap;
+    int watch_fd;                  // inotify descriptor, -1 if unavailable
+} Catalog;
+
+static inline int64_t catalog_mtime(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static inline int catalog_find(const Catalog *c, const char *path) {
+    for (int i = 0; i < c->count; i++) {
+        if (strcmp(c->entries[i].path, path) == 0) return i;
+    }
+    return -1;
+}
+
+static inline void catalog_remove(Catalog *c, int index) {
+    memmove(&c->entries[index], &c->entries[index + 1],
+            (c->count - index - 1) * sizeof(CatalogEntry));
+    c->count--;
+}
+
+// Order by title, a plugin before the executable it shadows
+static inline int catalog_compare(const CatalogEntry *a, const CatalogEntry *b) {
+    int order = strcmp(a->title, b->title);
+    return order ? order : b->plugin - a->plugin;
+}
+
+// Is the entry hidden behind a plugin with the same title?
+static inline int catalog_shadowed(const Catalog *c, int index) {
+    return index > 0 && strcmp(c->entries[index - 1].title, c->entries[index].title) == 0;
+}
+
+// Next entry shown in the menu in the given direction (+1 or -1), wrapping
+static inline int catalog_step(const Catalog *c, int index, int step) {
+    if (c->count == 0) return 0;
+    do {
+        index = (index + step + c->count) % c->count;
+    } while (catalog_shadowed(c, index));
+    return index;
+}
+
+// Add or refresh an entry, keeping the list sorted; returns -1 if out of memory
+static inline int catalog_put(Catalog *c, const CatalogEntry *entry) {
+    int index = catalog_find(c, entry->path);
+    if (index >= 0) catalog_remove(c, index);
+    if (c->count == c->cap) {
+        int cap = c->cap ? c->cap * 2 : 16;
+        CatalogEntry *entries = realloc(c->entries, cap * sizeof(CatalogEntry));
+        if (!entries) return -1;
+        c->entries = entries;
+        c->cap = cap;
+    }
+    for (index = c->count; index > 0 && catalog_compare(&c->entries[index - 1], entry) > 0; index--) {
+        c->entries[index] = c->entries[index - 1];
+    }
+    c->entries[index] = *entry;
+    c->count++;
+    return 0;
+}
+
+// Look a file up on disk: 1 if it is a game (entry filled in), 0 if not
+static inline int catalog_probe(const char *path, CatalogEntry *entry) {
+    struct stat st;
+    size_t len = strlen(path), prefix = strlen(CATALOG_PREFIX), suffix = strlen(CATALOG_PLUGIN_SUFFIX);
+    if (strncmp(path, CATALOG_PREFIX, prefix) != 0 || len >= CATALOG_NAME_MAX || len == prefix) {
+        return 0;
+    }
+    // Plugins only need to be readable, executables must be executable
+    int plugin = len > prefix + suffix && strcmp(path + len - suffix, CATALOG_PLUGIN_SUFFIX) == 0;
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode) || access(path, plugin ? R_OK : X_OK) != 0) {
+        return 0;
+    }
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->path, path, len);
+    memcpy(entry->title, path + prefix, len - prefix - (plugin ? suffix : 0));
+    entry->title[0] = toupper((unsigned char)entry->title[0]);
+    entry->plugin = plugin;
+    entry->mtime_ns = catalog_mtime(&st);
+    entry->size = st.st_size;
+    return 1;
+}
+
+// Re-check one file after it changed, returns 1 if the catalog changed
+static inline int catalog_refresh(Catalog *c, const char *path) {
+    CatalogEntry entry;
+    int index = catalog_find(c, path);
+    if (catalog_probe(path, &entry)) {
+        if (index >= 0 && c->entries[index].mtime_ns == entry.mtime_ns &&
+            c->entries[index].size == entry.size) {
+            return 0;
+        }
+        return catalog_put(c, &entry) == 0;
+    }
+    if (index < 0) return 0;
+    catalog_remove(c, index);
+    return 1;
+}
+
+// Write the catalog, stamped with the directory mtime it leaves behind.
+// The entries go to a temporary file renamed over the old catalog, so a
+// crash or another menu reading at the same time sees one list or the
+// other, never a mix. The rename is what changes the directory mtime, so
+// the stamp is written last, in place: until then the catalog is stale
+// and the next start just scans.
+static inline void catalog_save(const Catalog *c) {
+    CatalogHeader header;
+    struct stat st;
+    char temp[sizeof(CATALOG_FILE) + 16];
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "ATCG", 4);
+    header.version = CATALOG_VERSION;
+    header.count = c->count;
+
+    // One temporary file per menu, so two saving at once don't share one
+    snprintf(temp, sizeof(temp), "%s.%d", CATALOG_FILE, (int)getpid());
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return; // Read-only directory, start with a scan next time
+    int ok = write(fd, &header, sizeof(header)) == sizeof(header) &&
+             write(fd, c->entries, c->count * sizeof(CatalogEntry)) ==
+                 (ssize_t)(c->count * sizeof(CatalogEntry)) &&
+             fdatasync(fd) == 0 && rename(temp, CATALOG_FILE) == 0;
+    if (!ok) {
+        close(fd);
+        unlink(temp);
+        return;
+    }
+    if (stat(".", &st) == 0) {
+        header.dir_mtime_ns = catalog_mtime(&st);
+        if (pwrite(fd, &header.dir_mtime_ns, sizeof(header.dir_mtime_ns),
+                   offsetof(CatalogHeader, dir_mtime_ns)) < 0) {
+            // Left stale, the next start scans
+        }
+    }
+    close(fd);
+}
+
+// Read the saved catalog if the directory hasn't changed since, returns 0 if stale
+static inline int catalog_load(Catalog *c) {
+    CatalogHeader header;
+    struct stat st;
+    int fd = open(CATALOG_FILE, O_RDONLY);
+    if (fd < 0) return 0;
+    int ok = read(fd, &header, sizeof(header)) == sizeof(header) &&
+             memcmp(header.magic, "ATCG", 4) == 0 && header.version == CATALOG_VERSION &&
+             stat(".", &st) == 0 && catalog_mtime(&st) == header.dir_mtime_ns;
+    if (ok && header.count > 0) {
+        c->entries = malloc(header.count * sizeof(CatalogEntry));
+        ok = c->entries && read(fd, c->entries, header.count * sizeof(CatalogEntry)) ==
+                               (ssize_t)(header.count * sizeof(CatalogEntry));
+        c->cap = c->count = ok ? header.count : 0;
+    }
+    close(fd);
+    if (!ok) return 0;
+
+    // A binary can be rebuilt in place without touching the directory
+    int changed = 0;
+    for (int i = c->count - 1; i >= 0; i--) {
+        char path[CATALOG_NAME_MAX];
+        memcpy(path, c->entries[i].path, sizeof(path));
+        path[sizeof(path) - 1] = '\0';
+        changed |= catalog_refresh(c, path);
+    }
+    if (changed) catalog_save(c);
+    return 1;
+}
+
+// Read every entry of the directory
+static inline void catalog_scan(Catalog *c) {
+    DIR *dir = opendir(".");
+    struct dirent *entry;
+    CatalogEntry game;
+    c->count = 0;
+    if (!dir) {
+        perror("Failed to open directory");
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (catalog_probe(entry->d_name, &game)) catalog_put(c, &game);
+    }
+    closedir(dir);
+}
+
+// Load or build the catalog of the current directory and start watching it
+static inline void catalog_open(Catalog *c) {
+    memset(c, 0, sizeof(*c));
+    if (!catalog_load(c)) {
+        catalog_scan(c);
+        catalog_save(c);
+    }
+    c->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (c->watch_fd >= 0 &&
+        inotify_add_watch(c->watch_fd, ".", IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                                IN_CLOSE_WRITE | IN_ATTRIB) < 0) {
+        close(c->watch_fd);
+        c->watch_fd = -1;
+    }
+}
+
+// Apply pending inotify events, returns 1 if the list of games changed
+static inline int catalog_update(Catalog *c) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0, overflow = 0;
+    ssize_t len;
+    if (c->watch_fd < 0) return 0;
+    while ((len = read(c->watch_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            if (event->mask & IN_Q_OVERFLOW) overflow = 1;
+            if (event->len && strncmp(event->name, CATALOG_PREFIX, strlen(CATALOG_PREFIX)) == 0) {
+                changed |= catalog_refresh(c, event->name);
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    if (overflow) {
+        // Events were lost, the only safe thing is to look again
+        catalog_scan(c);
+        changed = 1;
+    }
+    if (changed) catalog_save(c);
+    return changed;
+}
+
+static inline void catalog_close(Catalog *c) {
+    if (c->watch_fd >= 0) close(c->watch_fd);
+    free(c->entries);
+    memset(c, 0, sizeof(*c));
+    c->watch_fd = -1;
+}
+
+#endif
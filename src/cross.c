@@ -1,48 +1,147 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <termios.h>
 #include <time.h>
-#include <fcntl.h>
-#include <signal.h>
+#include <sys/mman.h>
+
+#include "render.h"
+#include "rng.h"
+#include "replay.h"
+#include "loop.h"
+#include "plugin.h"
+#include "rewind.h"
+#ifndef ATAR_PLUGIN
+#include "bench.h" // Allocation counting, standalone binary only
+#include "render_thread.h"
+#include "scores.h"
+#include "snapshot.h"
+#include "telemetry.h"
+#endif
 
 #define SCREEN_WIDTH  40
 #define SCREEN_HEIGHT 21
+#define MIN_SCREEN_SIZE 3
+#define MAX_SCREEN_SIZE 4096
+#define MAX_LOG_LENGTH 64
+#define MAX_LOG_PERIOD 16
+#define SPAWN_CHANCE 20 // One in SPAWN_CHANCE ticks a lane tries to spawn a log
 #define LOG_SYMBOL '|'
 #define PLAYER_SYMBOL 'O'
 #define RIVER_SYMBOL '~'
-int DELAY = 100000; // Microseconds
-
-struct termios orig_termios;
+#define DELAY 100000 // Microseconds per tick
+#define SNAPSHOT_NAME "cross" // Save state on the storage volume, see snapshot.h
+#define SNAPSHOT_STATE 2      // Bump whenever CrossGame or the log layout changes
+#define REWIND_SECONDS 30     // How far back 'r' can go
+#define REWIND_TICKS (REWIND_SECONDS * 1000000 / DELAY)
+#define REWIND_STEP (1000000 / DELAY) // Ticks undone per 'r', one second
+#define REWIND_BYTES (1 << 20) // History budget, whatever the field size
+#define LOG_EXIT  0           // History events, see CrossStep
+#define LOG_SPAWN 1
 
 // Player position
 typedef struct {
     int x, y;
 } Player;
 
-// Log structure
+// Complete game state, passed explicitly so the same code runs as the
+// standalone binary and as a plugin whose state the menu owns.
+//
+// Logs are stored per lane (row) in structure-of-arrays form. All logs in a
+// lane drift right at the lane's speed, so they leave in the order they
+// spawned and each lane is a FIFO ring of up to maxLogs slots. After a
+// resume the lane arrays are pages of the snapshot (see snapshot.h).
 typedef struct {
-    int x, y;
-    int active; // 1 if log is on screen, 0 otherwise
-} Log;
+    Player player;
+    int score;
+    int screenWidth, screenHeight; // Field size, set from --size
+    int maxLogs;                   // Log slots per lane, from --logs
+    int maxLogLength;              // Longest log, from --log-length
+    int maxPeriod;                 // Slowest lane moves once per maxPeriod ticks, from --speeds
+    int *logX;                     // Rightmost cell of each log, lane * maxLogs + slot
+    int *logLength;                // Cells covered by each log
+    int *laneHead;                 // Slot of the oldest (rightmost) log in each lane
+    int *laneCount;                // Logs in each lane
+    int *lanePeriod;               // Ticks between moves in each lane
+    uint64_t *rowMask;             // Log-covered cells per row, rebuilt every tick
+    int rowWords;                  // Words per row in rowMask
+    uint64_t seed;                 // Random seed, from --seed or the clock
+    Rng rng;                       // Log spawns and scripted input
+    uint64_t ticks;                // Ticks stepped so far
+    int crashes;                   // Times a log hit the player, ends an agent's episode
+    int crashScore;                // Score the player had when last hit
+    uint8_t *snapshot;             // Mapping the lane arrays live in after a resume, or NULL
+    size_t snapshotSize;
+    RewindBuffer *history;         // Ticks to undo with the rewind key, NULL when off
+} CrossGame;
+
+// History record of one tick: the player and random state before it, then
+// one event per log that drifted off the right edge or spawned, packed as
+// lane << 8 | kind << 7 | length. Which lanes drifted follows from the
+// tick number, so the drift itself takes no space.
+typedef struct {
+    Player player;
+    int score;
+    uint64_t rng;
+    uint64_t tick;
+} CrossStep;
 
-// Global variables
-Player player;
-Log logs[SCREEN_HEIGHT];
-int score = 0;
+// Keyframe written before a crash clears the river: the player's state,
+// then every lane's log count followed by its logs as (x, length) pairs
+typedef struct {
+    Player player;
+    int score;
+    int crashes, crashScore;
+} CrossCrash;
 
 // Function prototypes
+void initGame(CrossGame *g);
+void drawGame(CrossGame *g, Renderer *screen);
+void updateLogs(CrossGame *g);
+void checkCollision(CrossGame *g);
+void movePlayer(CrossGame *g, char input);
+int allocLogs(CrossGame *g);
+void freeLogs(CrossGame *g);
+void clearLogs(CrossGame *g);
+int validSettings(CrossGame *g);
+int parseFieldSize(CrossGame *g, const char *text);
+void stepGame(CrossGame *g);
+int stepBack(CrossGame *g);
+uint64_t stateHash(CrossGame *g);
+
+#ifndef ATAR_PLUGIN
+
+CrossGame game = {.screenWidth = SCREEN_WIDTH, .screenHeight = SCREEN_HEIGHT,
+                  .maxLogs = 1, .maxLogLength = 1, .maxPeriod = 1};
+ReplayWriter recorder = {.fd = -1}; // Session recording, open with --record
+
+struct termios orig_termios;
+Renderer screen; // Info bar plus the river, diffed frame to frame
+RenderThread presenter; // Writes the frames out so a slow terminal can't stall ticks
+GameLoop loop;   // Fixed-timestep pacing and frame telemetry
+Telemetry telemetry; // Live counters for the menu and atar_stats
+RewindBuffer history; // Last REWIND_SECONDS of ticks, for the 'r' key
+// A rewind can take back a crash, so the best run of the session goes on
+// the leaderboard once, on quit, if it beat the score the game resumed with
+int startScore, bestScore;
+Scores scores; // Leaderboard, loaded before the first frame so quitting only appends
+int haveScores;
+
 void clearScreen();
 void disableRawMode();
 void enableRawMode();
-void enableNonBlockingInput();
-void disableNonBlockingInput();
-void handleExit(int sig);
-void initGame();
-void drawGame();
-void updateLogs();
-void checkCollision();
-void movePlayer(char input);
+void quitGame();
+void usage(const char *program);
+void applyKey(CrossGame *g, char input);
+char randomKey(CrossGame *g);
+void runHeadless(CrossGame *g, long count, const char *keys);
+int runReplay(const char *path);
+int saveGame(CrossGame *g, const char *name);
+int resumeGame(CrossGame *g, const char *name);
+int validSavedGame(CrossGame *g);
+void timeSnapshot(CrossGame *g);
+void timeRewind(CrossGame *g);
 
 // Restore terminal settings after exiting the program
 void disableRawMode() {
@@ -58,23 +157,20 @@ void enableRawMode() {
     tcsetattr(STDIN_FILENO, TCSANOW, &raw);
 }
 
-// Enable non-blocking input
-void enableNonBlockingInput() {
-    int flags = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
-}
-
-// Disable non-blocking input
-void disableNonBlockingInput() {
-    int flags = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, flags & ~O_NONBLOCK); // Clear non-blocking flag
-}
-
-// Signal handler to gracefully exit on termination signals
-void handleExit(int sig) {
+// Finish the recording, restore the terminal and exit
+void quitGame() {
+    replay_finish(&recorder, game.ticks, stateHash(&game));
+    saveGame(&game, SNAPSHOT_NAME); // The run carries on next time
+    render_thread_stop(&presenter, &screen);
+    if (haveScores && bestScore > startScore) scores_add(&scores, "cross", bestScore);
+    scores_close(&scores);
+    render_shutdown(&screen);
     disableRawMode();
-    disableNonBlockingInput();
-    clearScreen();
+    clearScreen(); // Ensure clean exit
+    fflush(stdout);
+    loop_dump(&loop);
+    loop_close(&loop);
+    telemetry_close(&telemetry);
     exit(0);
 }
 
@@ -83,147 +179,866 @@ void clearScreen() {
     printf("\033[H\033[J");
 }
 
-// Initialize the game state
-void initGame() {
-    player.x = SCREEN_WIDTH / 2;
-    player.y = SCREEN_HEIGHT - 1;
+#endif
 
-    for (int i = 0; i < SCREEN_HEIGHT; i++) {
-        logs[i].active = 0;
+// Allocate the per-lane log storage for the field size, returns 0 on failure
+int allocLogs(CrossGame *g) {
+    g->rowWords = (g->screenWidth + 63) / 64;
+    g->logX = malloc((size_t)g->screenHeight * g->maxLogs * sizeof(int));
+    g->logLength = malloc((size_t)g->screenHeight * g->maxLogs * sizeof(int));
+    g->laneHead = calloc(g->screenHeight, sizeof(int));
+    g->laneCount = calloc(g->screenHeight, sizeof(int));
+    g->lanePeriod = malloc(g->screenHeight * sizeof(int));
+    g->rowMask = calloc((size_t)g->screenHeight * g->rowWords, sizeof(uint64_t));
+    return g->logX && g->logLength && g->laneHead && g->laneCount && g->lanePeriod && g->rowMask;
+}
+
+void freeLogs(CrossGame *g) {
+    if (g->snapshot) {
+        munmap(g->snapshot, g->snapshotSize);
+        g->snapshot = NULL;
+        return;
     }
+    free(g->logX);
+    free(g->logLength);
+    free(g->laneHead);
+    free(g->laneCount);
+    free(g->lanePeriod);
+    free(g->rowMask);
+    g->logX = g->logLength = NULL;
+    g->laneHead = g->laneCount = g->lanePeriod = NULL;
+    g->rowMask = NULL;
+}
 
-    srand(time(0)); // Seed random number generator
+// Is the cell covered by a log? One bit test
+static inline int isLog(CrossGame *g, int x, int y) {
+    return (g->rowMask[y * g->rowWords + (x >> 6)] >> (x & 63)) & 1;
+}
+
+// Mark cells from..to (inclusive, on screen) of a row as covered
+static inline void markLog(uint64_t *row, int from, int to) {
+    while (from <= to) {
+        int bit = from & 63;
+        int span = to - from + 1 < 64 - bit ? to - from + 1 : 64 - bit;
+        uint64_t bits = span == 64 ? ~(uint64_t)0 : (((uint64_t)1 << span) - 1) << bit;
+        row[from >> 6] |= bits;
+        from += span;
+    }
+}
+
+// Rebuild a row's occupancy from its logs
+static void buildRow(CrossGame *g, int lane) {
+    int *x = g->logX + lane * g->maxLogs;
+    int *length = g->logLength + lane * g->maxLogs;
+    uint64_t *row = g->rowMask + lane * g->rowWords;
+    memset(row, 0, g->rowWords * sizeof(uint64_t));
+    for (int i = 0, slot = g->laneHead[lane]; i < g->laneCount[lane];
+         i++, slot = slot + 1 == g->maxLogs ? 0 : slot + 1) {
+        int tail = x[slot] - length[slot] + 1;
+        markLog(row, tail > 0 ? tail : 0, x[slot] < g->screenWidth ? x[slot] : g->screenWidth - 1);
+    }
+}
+
+// Note a log leaving or spawning in the tick's history record
+static inline void logEvent(CrossGame *g, int lane, int kind, int length) {
+    uint32_t event = (uint32_t)lane << 8 | kind << 7 | length;
+    rewind_put(g->history, &event, sizeof(event));
+}
+
+// Remove every log from the river
+void clearLogs(CrossGame *g) {
+    memset(g->laneCount, 0, g->screenHeight * sizeof(int));
+    memset(g->rowMask, 0, (size_t)g->screenHeight * g->rowWords * sizeof(uint64_t));
+}
+
+// Initialize the game state
+void initGame(CrossGame *g) {
+    g->player.x = g->screenWidth / 2;
+    g->player.y = g->screenHeight - 1;
+
+    rng_seed(&g->rng, g->seed); // Seed random number generator
+
+    // Each lane gets its own speed
+    for (int i = 0; i < g->screenHeight; i++) {
+        g->lanePeriod[i] = 1 + rng_below(&g->rng, g->maxPeriod);
+    }
+    clearLogs(g);
 }
 
 // Draw the game state
-void drawGame() {
-    clearScreen();
+void drawGame(CrossGame *g, Renderer *screen) {
+    render_clear(screen);
 
     // Draw the top info bar
-    printf("Use 'w', 'a', 's', 'd' to move. Score: %d\n", score);
+    render_text(screen, 0, 0, "Use 'w', 'a', 's', 'd' to move. Score: %d", g->score);
 
     // Draw the game grid
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
-            if (y == player.y && x == player.x) {
-                printf("%c", PLAYER_SYMBOL); // Draw player
-            } else {
-                int isLog = 0;
-                for (int i = 0; i < SCREEN_HEIGHT; i++) {
-                    if (logs[i].active && logs[i].x == x && logs[i].y == y) {
-                        printf("%c", LOG_SYMBOL); // Draw log
-                        isLog = 1;
-                        break;
-                    }
-                }
-                if (!isLog) {
-                    if (y == SCREEN_HEIGHT - 1 || y == 0) {
-                        printf("%c", RIVER_SYMBOL); // Draw river
-                    } else {
-                        printf(" "); // Empty space
-                    }
-                }
+    for (int y = 0; y < g->screenHeight; y++) {
+        for (int x = 0; x < g->screenWidth; x++) {
+            if (y == g->player.y && x == g->player.x) {
+                render_put(screen, y + 1, x, PLAYER_SYMBOL); // Draw player
+            } else if (isLog(g, x, y)) {
+                render_put(screen, y + 1, x, LOG_SYMBOL); // Draw log
+            } else if (y == g->screenHeight - 1 || y == 0) {
+                render_put(screen, y + 1, x, RIVER_SYMBOL); // Draw river
             }
         }
-        printf("\n");
     }
 }
 
-// Update log positions
-void updateLogs() {
-    for (int i = 0; i < SCREEN_HEIGHT; i++) {
-        if (logs[i].active) {
-            logs[i].x += 1; // Move log to the right
-            if (logs[i].x >= SCREEN_WIDTH) {
-                logs[i].active = 0; // Deactivate log if it goes out of bounds
+// Update log positions and rebuild the row masks
+void updateLogs(CrossGame *g) {
+    // Prevent logs from spawning on the top and bottom lines
+    for (int lane = 1; lane < g->screenHeight - 1; lane++) {
+        int *x = g->logX + lane * g->maxLogs;
+        int *length = g->logLength + lane * g->maxLogs;
+        int count = g->laneCount[lane];
+        int head = g->laneHead[lane];
+
+        if (g->ticks % g->lanePeriod[lane] == 0) {
+            for (int i = 0, slot = head; i < count; i++, slot = slot + 1 == g->maxLogs ? 0 : slot + 1) {
+                x[slot] += 1; // Move log to the right
+            }
+            // Logs that drifted off the right edge are always the oldest
+            while (count > 0 && x[head] - length[head] + 1 >= g->screenWidth) {
+                if (g->history) logEvent(g, lane, LOG_EXIT, length[head]);
+                head = head + 1 == g->maxLogs ? 0 : head + 1;
+                count--;
             }
-        } else if (rand() % 20 == 0 && i != SCREEN_HEIGHT - 1 && i != 0) {
-            // Prevent logs from spawning on the top and bottom lines
-            logs[i].active = 1;
-            logs[i].x = 0; // Spawn log at the left edge
-            logs[i].y = i;
         }
+
+        // Spawn at the left edge once the newest log has cleared it
+        if (count < g->maxLogs && rng_below(&g->rng, SPAWN_CHANCE) == 0) {
+            int newest = (head + count - 1) % g->maxLogs;
+            if (count == 0 || x[newest] - length[newest] + 1 > 1) {
+                int slot = (head + count) % g->maxLogs;
+                x[slot] = 0;
+                length[slot] = 1 + rng_below(&g->rng, g->maxLogLength);
+                count++;
+                if (g->history) logEvent(g, lane, LOG_SPAWN, 0);
+            }
+        }
+        g->laneHead[lane] = head;
+        g->laneCount[lane] = count;
+        buildRow(g, lane);
     }
 }
 
 // Check for collisions
-void checkCollision() {
-    for (int i = 0; i < SCREEN_HEIGHT; i++) {
-        if (logs[i].active && logs[i].x == player.x && logs[i].y == player.y) {
-            // Collision detected
-            score = 0;                // Reset the score
-            player.x = SCREEN_WIDTH / 2; // Keep player centered horizontally
-            player.y = SCREEN_HEIGHT - 1; // Respawn player at the starting row
-            // Clear all logs
-            for (int j = 0; j < SCREEN_HEIGHT; j++) {
-                logs[j].active = 0;
+void checkCollision(CrossGame *g) {
+    if (isLog(g, g->player.x, g->player.y)) {
+        // Collision detected. The river is about to be wiped, so the
+        // history keeps all of it.
+        if (g->history) {
+            CrossCrash crash = {g->player, g->score, g->crashes, g->crashScore};
+            rewind_begin(g->history, REWIND_KEYFRAME);
+            rewind_put(g->history, &crash, sizeof(crash));
+            for (int lane = 0; lane < g->screenHeight; lane++) {
+                rewind_put(g->history, &g->laneCount[lane], sizeof(int));
+                for (int i = 0; i < g->laneCount[lane]; i++) {
+                    int slot = lane * g->maxLogs + (g->laneHead[lane] + i) % g->maxLogs;
+                    int log[2] = {g->logX[slot], g->logLength[slot]};
+                    rewind_put(g->history, log, sizeof(log));
+                }
             }
-            break;
+            rewind_end(g->history);
         }
+        g->crashScore = g->score;
+        g->score = 0;                         // Reset the score
+        g->player.x = g->screenWidth / 2;     // Keep player centered horizontally
+        g->player.y = g->screenHeight - 1;    // Respawn player at the starting row
+        clearLogs(g);
+        g->crashes++;
     }
 }
 
 // Move player
-void movePlayer(char input) {
+void movePlayer(CrossGame *g, char input) {
     switch (input) {
         case 'a': // Move left
-            if (player.x > 0) player.x--;
+            if (g->player.x > 0) g->player.x--;
             break;
         case 'd': // Move right
-            if (player.x < SCREEN_WIDTH - 1) player.x++;
+            if (g->player.x < g->screenWidth - 1) g->player.x++;
             break;
         case 'w': // Move up
-            if (player.y >= 1) {
-                player.y--;
-                score += 1; // Increment score
+            if (g->player.y >= 1) {
+                g->player.y--;
+                g->score += 1; // Increment score
             }
-            if (player.y == 0) {
-                player.y = SCREEN_HEIGHT - 1;
-                score += 100;
+            if (g->player.y == 0) {
+                g->player.y = g->screenHeight - 1;
+                g->score += 100;
             }
             break;
         case 's': // Move down
-            if (player.y < SCREEN_HEIGHT - 1) {
-                player.y++;
-                score--;
+            if (g->player.y < g->screenHeight - 1) {
+                g->player.y++;
+                g->score--;
             }
             break;
-        case 'q': // Exit game
-            disableRawMode();
-            disableNonBlockingInput(); // Restore input mode
-            clearScreen(); // Ensure clean exit
-            exit(0);
     }
 }
 
-int main() {
-    char input;
+// Check the field and log settings are in range
+int validSettings(CrossGame *g) {
+    return g->screenWidth >= MIN_SCREEN_SIZE && g->screenWidth <= MAX_SCREEN_SIZE &&
+           g->screenHeight >= MIN_SCREEN_SIZE && g->screenHeight <= MAX_SCREEN_SIZE &&
+           g->maxLogs >= 1 && g->maxLogs <= g->screenWidth &&
+           g->maxLogLength >= 1 && g->maxLogLength <= MAX_LOG_LENGTH &&
+           g->maxPeriod >= 1 && g->maxPeriod <= MAX_LOG_PERIOD;
+}
+
+// Parse "WIDTHxHEIGHT" into the field size, returns 0 if out of range
+int parseFieldSize(CrossGame *g, const char *text) {
+    char *end;
+    long width = strtol(text, &end, 10);
+    if (*end != 'x' && *end != 'X') return 0;
+    long height = strtol(end + 1, &end, 10);
+    if (*end != '\0' || width < MIN_SCREEN_SIZE || width > MAX_SCREEN_SIZE ||
+        height < MIN_SCREEN_SIZE || height > MAX_SCREEN_SIZE) {
+        return 0;
+    }
+    g->screenWidth = width;
+    g->screenHeight = height;
+    return 1;
+}
+
+// Advance the river by one tick
+void stepGame(CrossGame *g) {
+    if (g->history) {
+        CrossStep step = {g->player, g->score, g->rng.state, g->ticks};
+        rewind_begin(g->history, REWIND_TICK);
+        rewind_put(g->history, &step, sizeof(step));
+    }
+    updateLogs(g);
+    if (g->history) rewind_end(g->history);
+    checkCollision(g);
+    g->ticks++;
+}
+
+// Put the river back as the keyframe on top of the history has it
+static void undoCrash(CrossGame *g) {
+    CrossCrash crash;
+    uint64_t offset = sizeof(crash);
+    rewind_read(g->history, 0, &crash, sizeof(crash));
+    for (int lane = 0; lane < g->screenHeight; lane++) {
+        int count;
+        rewind_read(g->history, offset, &count, sizeof(count));
+        offset += sizeof(count);
+        for (int i = 0; i < count; i++) {
+            int log[2];
+            rewind_read(g->history, offset, log, sizeof(log));
+            offset += sizeof(log);
+            g->logX[lane * g->maxLogs + i] = log[0];
+            g->logLength[lane * g->maxLogs + i] = log[1];
+        }
+        g->laneHead[lane] = 0;
+        g->laneCount[lane] = count;
+        buildRow(g, lane);
+    }
+    g->player = crash.player;
+    g->score = crash.score;
+    g->crashes = crash.crashes;
+    g->crashScore = crash.crashScore;
+}
 
-    // Set up signal handling
-    signal(SIGINT, handleExit);
-    signal(SIGHUP, handleExit);  // Handle terminal disconnect
-    signal(SIGTERM, handleExit); // Handle termination signal
-    signal(SIGQUIT, handleExit); // Handle quit signal
+// Undo the tick on top of the history: take back its spawns and departures
+// in reverse, then drift the lanes that moved back one cell. A departed log
+// left with its tail exactly on the right edge, so its length is all it
+// takes to put it back.
+static void undoStep(CrossGame *g, uint64_t length) {
+    CrossStep step;
+    rewind_read(g->history, 0, &step, sizeof(step));
+    for (uint64_t offset = length; offset > sizeof(step); ) {
+        uint32_t event;
+        offset -= sizeof(event);
+        rewind_read(g->history, offset, &event, sizeof(event));
+        int lane = event >> 8;
+        if ((event >> 7 & 1) == LOG_SPAWN) {
+            g->laneCount[lane]--;
+        } else {
+            int head = g->laneHead[lane] == 0 ? g->maxLogs - 1 : g->laneHead[lane] - 1;
+            int slot = lane * g->maxLogs + head;
+            g->logLength[slot] = event & 0x7F;
+            g->logX[slot] = g->screenWidth + g->logLength[slot] - 1;
+            g->laneHead[lane] = head;
+            g->laneCount[lane]++;
+        }
+        if (step.tick % g->lanePeriod[lane] != 0) buildRow(g, lane); // Spawned without drifting
+    }
+    for (int lane = 1; lane < g->screenHeight - 1; lane++) {
+        if (step.tick % g->lanePeriod[lane] == 0) {
+            for (int i = 0; i < g->laneCount[lane]; i++) {
+                g->logX[lane * g->maxLogs + (g->laneHead[lane] + i) % g->maxLogs]--;
+            }
+            buildRow(g, lane);
+        }
+    }
+    g->player = step.player;
+    g->score = step.score;
+    g->rng.state = step.rng;
+}
+
+// Go back one tick, returns 0 once the history runs out. ticks keeps
+// counting, it is the clock replays are keyed to.
+int stepBack(CrossGame *g) {
+    uint64_t length;
+    uint32_t type;
+    while (g->history && (type = rewind_last(g->history, &length))) {
+        if (type == REWIND_KEYFRAME) {
+            undoCrash(g);
+            rewind_pop(g->history);
+        } else {
+            undoStep(g, length);
+            rewind_pop(g->history);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Hash of everything that determines how the game continues
+uint64_t stateHash(CrossGame *g) {
+    uint64_t hash = replay_hash(REPLAY_HASH_INIT, &g->player, sizeof(g->player));
+    hash = replay_hash(hash, &g->score, sizeof(g->score));
+    hash = replay_hash(hash, &g->rng.state, sizeof(g->rng.state));
+    for (int lane = 0; lane < g->screenHeight; lane++) {
+        for (int i = 0; i < g->laneCount[lane]; i++) {
+            int slot = lane * g->maxLogs + (g->laneHead[lane] + i) % g->maxLogs;
+            hash = replay_hash(hash, &g->logX[slot], sizeof(int));
+            hash = replay_hash(hash, &g->logLength[slot], sizeof(int));
+        }
+    }
+    return hash;
+}
+
+#ifndef ATAR_PLUGIN
+
+// Print the command-line help
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [OPTIONS] [--seed N] [--record FILE] [--new]\n"
+                    "       %s [OPTIONS] --headless TICKS [--keys KEYS] [--seed N] [--snapshot] [--rewind]\n"
+                    "       %s --replay FILE\n"
+                    "Options: --size WIDTHxHEIGHT   field size, each side %d to %d\n"
+                    "         --logs N              logs per lane, up to the width\n"
+                    "         --log-length N        longest log, up to %d\n"
+                    "         --speeds N            slowest lane moves every N ticks, up to %d\n"
+                    "'r' steps back a second, up to %d seconds.\n"
+                    "A game that is quit is saved in %s and resumed on the next start;\n"
+                    "--new starts over, and so do field options other than the saved game's.\n"
+                    "--snapshot times saving and resuming the headless game, --rewind stepping\n"
+                    "it back.\n",
+            program, program, program, MIN_SCREEN_SIZE, MAX_SCREEN_SIZE,
+            MAX_LOG_LENGTH, MAX_LOG_PERIOD, REWIND_SECONDS, STORAGE_DEFAULT);
+}
+
+// Move the player as soon as a key is pressed. Every key except 'q' is
+// recorded against the current tick, so replaying keys through here
+// between stepGame() calls reproduces a session exactly.
+void applyKey(CrossGame *g, char input) {
+    if (input != 'q') {
+        replay_record(&recorder, g->ticks, input);
+    } else {
+        quitGame();
+    }
+    if (input == 'r') { // Go back a second
+        for (int i = 0; i < REWIND_STEP && stepBack(g); i++);
+        return;
+    }
+    movePlayer(g, input);
+    checkCollision(g);
+}
+
+// Random stand-in for a player, mostly pushing upstream
+char randomKey(CrossGame *g) {
+    static const char keys[] = "wwwwaasd..";
+    return keys[rng_below(&g->rng, sizeof(keys) - 1)];
+}
+
+// Step the simulation for a fixed number of ticks and report its speed.
+// Keys come from the script (one per tick, '.' for none, repeated) or from
+// randomKey(); 'q' is ignored so the run always completes.
+void runHeadless(CrossGame *g, long count, const char *keys) {
+    BenchRun run;
+    size_t keyCount = keys ? strlen(keys) : 0;
+    int best = 0;
+
+    if (bench_begin(&run, count) < 0) {
+        fprintf(stderr, "Not enough memory for %ld samples\n", count);
+        return;
+    }
+    for (long t = 0; t < count; t++) {
+        uint64_t start = bench_now_ns();
+        char input = keyCount ? keys[t % keyCount] : randomKey(g);
+        if (input != 'q') {
+            applyKey(g, input);
+        }
+        stepGame(g);
+        if (g->score > best) best = g->score;
+        bench_sample(&run, start);
+    }
+    bench_end(&run);
+
+    char label[64];
+    snprintf(label, sizeof(label), "cross %dx%d", g->screenWidth, g->screenHeight);
+    bench_report(&run, stdout, label);
+    int logCount = 0;
+    for (int lane = 0; lane < g->screenHeight; lane++) {
+        logCount += g->laneCount[lane];
+    }
+    printf("%-24s best score %d, final score %d, %d logs on the river\n", "", best, g->score, logCount);
+}
+
+// Save the game as snapshot name: the CrossGame struct, then the lane
+// arrays as they are. Returns -1 on failure.
+int saveGame(CrossGame *g, const char *name) {
+    size_t slots = (size_t)g->screenHeight * g->maxLogs;
+    struct iovec sections[] = {
+        {g, sizeof(*g)},
+        {g->logX, slots * sizeof(int)},
+        {g->logLength, slots * sizeof(int)},
+        {g->laneHead, g->screenHeight * sizeof(int)},
+        {g->laneCount, g->screenHeight * sizeof(int)},
+        {g->lanePeriod, g->screenHeight * sizeof(int)},
+        {g->rowMask, (size_t)g->screenHeight * g->rowWords * sizeof(uint64_t)},
+    };
+    return snapshot_save(name, "cross", SNAPSHOT_STATE, sections, 7);
+}
+
+// Take over the game in snapshot name, returns 0 if there is none. The
+// lane arrays stay in the mapping, so nothing is read until it is used.
+// Whether a saved game is one this build could have written: the player on
+// the field, every lane's ring within its slots and every log where the
+// drift could have put it. A damaged or edited snapshot would otherwise
+// index out of bounds on the first tick.
+int validSavedGame(CrossGame *g) {
+    if (g->player.x < 0 || g->player.x >= g->screenWidth || g->player.y < 0 ||
+        g->player.y >= g->screenHeight || g->score < 0 || g->crashes < 0 || g->crashScore < 0) {
+        return 0;
+    }
+    for (int lane = 0; lane < g->screenHeight; lane++) {
+        int head = g->laneHead[lane], count = g->laneCount[lane];
+        if (head < 0 || head >= g->maxLogs || count < 0 || count > g->maxLogs ||
+            g->lanePeriod[lane] < 1 || g->lanePeriod[lane] > g->maxPeriod) {
+            return 0;
+        }
+        for (int i = 0, slot = head; i < count; i++, slot = slot + 1 == g->maxLogs ? 0 : slot + 1) {
+            int x = g->logX[lane * g->maxLogs + slot], length = g->logLength[lane * g->maxLogs + slot];
+            if (length < 1 || length > g->maxLogLength || x < 0 || x - length + 1 >= g->screenWidth) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int resumeGame(CrossGame *g, const char *name) {
+    Snapshot snap;
+    if (snapshot_open(&snap, name, "cross", SNAPSHOT_STATE) < 0) return 0;
+
+    CrossGame *saved = snapshot_section(&snap, 0, sizeof(CrossGame));
+    CrossGame resumed = {0};
+    if (saved && validSettings(saved) && saved->rowWords == (saved->screenWidth + 63) / 64) {
+        size_t slots = (size_t)saved->screenHeight * saved->maxLogs;
+        size_t lanes = saved->screenHeight * sizeof(int);
+        resumed = *saved;
+        resumed.logX = snapshot_section(&snap, 1, slots * sizeof(int));
+        resumed.logLength = snapshot_section(&snap, 2, slots * sizeof(int));
+        resumed.laneHead = snapshot_section(&snap, 3, lanes);
+        resumed.laneCount = snapshot_section(&snap, 4, lanes);
+        resumed.lanePeriod = snapshot_section(&snap, 5, lanes);
+        resumed.rowMask = snapshot_section(&snap, 6, (size_t)saved->screenHeight * saved->rowWords *
+                                                         sizeof(uint64_t));
+    }
+    if (!resumed.logX || !resumed.logLength || !resumed.laneHead || !resumed.laneCount ||
+        !resumed.lanePeriod || !resumed.rowMask || !validSavedGame(&resumed)) {
+        snapshot_close(&snap);
+        return 0;
+    }
+    for (int lane = 0; lane < resumed.screenHeight; lane++) {
+        buildRow(&resumed, lane); // Derived from the logs, so not trusted
+    }
+    resumed.snapshot = snap.map;
+    resumed.snapshotSize = snap.size;
+    resumed.history = NULL;
+    *g = resumed;
+    return 1;
+}
+
+// Save the headless game to a scratch snapshot, resume it into a second
+// game and check both play on the same
+void timeSnapshot(CrossGame *g) {
+    CrossGame copy;
+    const char *name = "cross-bench";
+
+    uint64_t start = bench_now_ns();
+    if (saveGame(g, name) < 0) {
+        fprintf(stderr, "Cannot save a snapshot in %s\n", storage_dir());
+        return;
+    }
+    uint64_t saved = bench_now_ns();
+    int resumed = resumeGame(&copy, name);
+    uint64_t done = bench_now_ns();
+    snapshot_remove(name);
+    if (!resumed) {
+        fprintf(stderr, "Cannot resume the snapshot\n");
+        return;
+    }
+    int same = stateHash(&copy) == stateHash(g);
+    for (int i = 0; i < 1000; i++) {
+        char key = "wwad"[i % 4]; // randomKey() would draw from one game's Rng only
+        movePlayer(g, key);
+        checkCollision(g);
+        movePlayer(&copy, key);
+        checkCollision(&copy);
+        stepGame(g);
+        stepGame(&copy);
+    }
+    same = same && stateHash(&copy) == stateHash(g);
+    printf("%-24s snapshot %zu bytes: save %.1f us (synced), resume %.1f us, %s\n", "",
+           copy.snapshotSize, (saved - start) / 1e3, (done - saved) / 1e3,
+           same ? "plays on the same" : "DIFFERS");
+    freeLogs(&copy);
+}
+
+// Play REWIND_TICKS more ticks of the headless game with the history on,
+// then step all the way back, checking each step lands on the state the
+// tick started from
+void timeRewind(CrossGame *g) {
+    static uint64_t hashes[REWIND_TICKS];
+    RewindBuffer rewind;
+    if (rewind_init(&rewind, REWIND_BYTES, REWIND_TICKS) < 0) {
+        fprintf(stderr, "Not enough memory for the rewind history\n");
+        return;
+    }
+    g->history = &rewind;
+    for (int i = 0; i < REWIND_TICKS; i++) {
+        applyKey(g, randomKey(g));
+        hashes[i] = stateHash(g);
+        stepGame(g);
+    }
+    uint64_t used = rewind_used(&rewind);
+
+    // Only the steps back are timed, hashing the river to check them is not
+    int steps = 0, same = 1;
+    uint64_t elapsed = 0, start = bench_now_ns();
+    while (stepBack(g)) {
+        elapsed += bench_now_ns() - start;
+        steps++;
+        same = same && stateHash(g) == hashes[REWIND_TICKS - steps];
+        start = bench_now_ns();
+    }
+    printf("%-24s rewind %d ticks, %.0f ns per step back, %llu of %d bytes of history, %s\n", "",
+           steps, steps ? (double)elapsed / steps : 0.0, (unsigned long long)used, REWIND_BYTES,
+           same && steps == REWIND_TICKS ? "lands on every tick" : "DIFFERS");
+    g->history = NULL;
+    rewind_free(&rewind);
+}
+
+// Play a recorded session back from a memory-mapped file as fast as possible
+// and check that it ends in the recorded state
+int runReplay(const char *path) {
+    ReplayReader replay;
+    BenchRun run;
+
+    if (replay_open(&replay, path, "cross") < 0) {
+        fprintf(stderr, "%s is not a cross replay\n", path);
+        return 1;
+    }
+    game.screenWidth = replay.header.params[0];
+    game.screenHeight = replay.header.params[1];
+    game.maxLogs = replay.header.params[2];
+    game.maxLogLength = replay.header.params[3] >> 16;
+    game.maxPeriod = replay.header.params[3] & 0xFFFF;
+    game.seed = replay.header.seed;
+    // Rewinds replay the same from the same history
+    if (!validSettings(&game) || !allocLogs(&game) ||
+        rewind_init(&history, REWIND_BYTES, REWIND_TICKS) < 0 ||
+        bench_begin(&run, replay_end_tick(&replay)) < 0) {
+        fprintf(stderr, "Cannot set up a %dx%d field for %s\n", game.screenWidth, game.screenHeight, path);
+        replay_close(&replay);
+        return 1;
+    }
+    initGame(&game);
+    game.history = &history;
+
+    // Keys pressed after the last step still count, so apply them first
+    while (1) {
+        uint64_t start = bench_now_ns();
+        char key;
+        while ((key = replay_key(&replay, game.ticks))) {
+            applyKey(&game, key);
+        }
+        if (game.ticks >= replay_end_tick(&replay)) break;
+        stepGame(&game);
+        bench_sample(&run, start);
+    }
+    bench_end(&run);
+
+    char label[64];
+    snprintf(label, sizeof(label), "cross replay %dx%d", game.screenWidth, game.screenHeight);
+    bench_report(&run, stdout, label);
+    printf("Final score %d after %llu ticks\n", game.score, (unsigned long long)game.ticks);
+
+    int status = 0;
+    if (!replay.has_footer) {
+        printf("Replay has no footer (session did not exit cleanly), state not verified\n");
+    } else if (stateHash(&game) == replay.footer.state_hash) {
+        printf("Final state matches the recording\n");
+    } else {
+        printf("Final state DIFFERS from the recording\n");
+        status = 1;
+    }
+    replay_close(&replay);
+    freeLogs(&game);
+    rewind_free(&history);
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    long headlessTicks = 0;
+    const char *keys = NULL;
+    const char *recordPath = NULL;
+    int fresh = 0, timeSnapshots = 0, timeRewinds = 0;
+    int fieldGiven = 0; // Any of --size, --logs, --log-length and --speeds
+
+    game.seed = time(0);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc && parseFieldSize(&game, argv[i + 1])) {
+            i++;
+            fieldGiven = 1;
+        } else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            headlessTicks = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+            keys = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            game.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--logs") == 0 && i + 1 < argc) {
+            game.maxLogs = atoi(argv[++i]);
+            fieldGiven = 1;
+        } else if (strcmp(argv[i], "--log-length") == 0 && i + 1 < argc) {
+            game.maxLogLength = atoi(argv[++i]);
+            fieldGiven = 1;
+        } else if (strcmp(argv[i], "--speeds") == 0 && i + 1 < argc) {
+            game.maxPeriod = atoi(argv[++i]);
+            fieldGiven = 1;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--new") == 0) {
+            fresh = 1;
+        } else if (strcmp(argv[i], "--snapshot") == 0) {
+            timeSnapshots = 1;
+        } else if (strcmp(argv[i], "--rewind") == 0) {
+            timeRewinds = 1;
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            return runReplay(argv[i + 1]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!validSettings(&game)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Pick up the game saved when it was last quit, unless starting over.
+    // A recording has to start from the seed, so it always starts over, and
+    // a field asked for explicitly starts over unless it matches.
+    CrossGame saved;
+    int resumed = !fresh && !headlessTicks && !recordPath && resumeGame(&saved, SNAPSHOT_NAME);
+    if (resumed && fieldGiven &&
+        (saved.screenWidth != game.screenWidth || saved.screenHeight != game.screenHeight ||
+         saved.maxLogs != game.maxLogs || saved.maxLogLength != game.maxLogLength ||
+         saved.maxPeriod != game.maxPeriod)) {
+        fprintf(stderr, "Starting a new game on the field asked for; quitting it replaces the saved "
+                        "%dx%d one\n", saved.screenWidth, saved.screenHeight);
+        freeLogs(&saved);
+        resumed = 0;
+    }
+    if (resumed) game = saved;
+    if (!resumed && !allocLogs(&game)) {
+        fprintf(stderr, "Not enough memory for a %dx%d field\n", game.screenWidth, game.screenHeight);
+        return 1;
+    }
+
+    // Run the simulation alone, without a terminal or any pacing
+    if (headlessTicks > 0) {
+        initGame(&game);
+        runHeadless(&game, headlessTicks, keys);
+        if (timeSnapshots) timeSnapshot(&game);
+        if (timeRewinds) timeRewind(&game);
+        freeLogs(&game);
+        return 0;
+    }
+
+    if (recordPath) {
+        uint32_t params[REPLAY_PARAMS] = {game.screenWidth, game.screenHeight, game.maxLogs,
+                                          (uint32_t)game.maxLogLength << 16 | game.maxPeriod};
+        if (replay_create(&recorder, recordPath, "cross", game.seed, params) < 0) {
+            perror("Failed to create the replay file");
+            return 1;
+        }
+    }
+
+    // SIGINT, SIGHUP, SIGTERM and SIGQUIT arrive through the loop and quit
+    if (loop_init(&loop, DELAY * 1000ull) < 0) {
+        fprintf(stderr, "Failed to set up the game timer\n");
+        return 1;
+    }
 
     enableRawMode();
-    enableNonBlockingInput();
 
-    initGame();
+    // Wide enough for the info bar, one extra row for it above the river
+    if (render_init(&screen, game.screenWidth > 48 ? game.screenWidth : 48, game.screenHeight + 1) < 0) {
+        disableRawMode();
+        loop_close(&loop);
+        fprintf(stderr, "Failed to allocate the screen buffers\n");
+        return 1;
+    }
+
+    if (!resumed) initGame(&game);
+    if (rewind_init(&history, REWIND_BYTES, REWIND_TICKS) == 0) {
+        game.history = &history; // Without the memory 'r' does nothing
+    }
 
+    // Move on every key as it arrives, simulate every tick that is due at
+    // the DELAY pace, then hand the frame to the render thread
+    render_thread_start(&presenter, &screen); // Presented inline if it fails
+    telemetry_open(&telemetry, "cross", DELAY * 1000ull); // Played without if it fails
+    haveScores = scores_open(&scores) == 0; // Quietly skipped without storage
+    startScore = bestScore = game.score;
+    drawGame(&game, &screen);
+    render_thread_publish(&presenter, &screen); // Emit only what changed since the last frame
     while (1) {
-        if (read(STDIN_FILENO, &input, 1) == 1) {
-            movePlayer(input);
+        LoopEvents events;
+        int crashes = game.crashes;
+        if (loop_wait(&loop, &events) < 0 || events.signal) {
+            quitGame();
         }
+        if (events.resumed) {
+            render_thread_invalidate(&presenter, &screen); // The menu drew over us while we were stopped
+        }
+        for (int i = 0; i < events.keys; i++) {
+            applyKey(&game, events.key[i]);
+        }
+        for (int i = 0; i < events.ticks; i++) {
+            stepGame(&game);
+        }
+        if (game.crashes > crashes && game.crashScore > bestScore) {
+            bestScore = game.crashScore; // Ended by a crash this frame
+        }
+        if (game.score > bestScore) bestScore = game.score;
+        drawGame(&game, &screen);
+        render_thread_publish(&presenter, &screen);
+        uint64_t frameNs = loop_frame_done(&loop);
+        telemetry_frame(&telemetry, &loop, render_thread_stats(&presenter, &screen), events.keys,
+                        game.score, frameNs);
+    }
+}
 
-        updateLogs();
-        checkCollision();
-        drawGame();
-        usleep(DELAY); // Control game speed
+#else
+
+// Plugin entry points, see plugin.h. The plugin plays the default field.
+
+// Agent observation: OBS_ROWS x OBS_COLS cells centred on the player
+#define OBS_ROWS 9
+#define OBS_COLS 15
+#define OBS_RIVER 0
+#define OBS_LOG   1
+#define OBS_BANK  2
+#define OBS_WALL  3
+
+static int pluginInit(void *state, int termRows, int termCols, uint64_t seed) {
+    CrossGame *g = state;
+    g->screenWidth = SCREEN_WIDTH;
+    g->screenHeight = SCREEN_HEIGHT;
+    g->maxLogs = g->maxLogLength = g->maxPeriod = 1;
+    g->seed = seed;
+    if (!allocLogs(g)) {
+        freeLogs(g);
+        return 0;
     }
+    initGame(g);
+    return 1;
+}
 
-    // Cleanup (though this won't be reached due to the infinite loop)
-    disableRawMode();
-    disableNonBlockingInput();
-    return 0;
+static int pluginInput(void *state, char key) {
+    if (key == 'q') return 0;
+    movePlayer(state, key);
+    checkCollision(state);
+    return 1;
+}
+
+static void pluginTick(void *state) {
+    stepGame(state);
+}
+
+static void pluginRender(void *state, Renderer *screen) {
+    drawGame(state, screen);
+}
+
+static int pluginActive(void *state) {
+    return 1; // The river never stops
+}
+
+static void pluginShutdown(void *state) {
+    freeLogs(state);
+}
+
+static void pluginObserve(void *state, uint8_t *obs) {
+    CrossGame *g = state;
+    for (int i = 0; i < OBS_ROWS; i++) {
+        int y = g->player.y + i - OBS_ROWS / 2;
+        for (int j = 0; j < OBS_COLS; j++) {
+            int x = g->player.x + j - OBS_COLS / 2;
+            if (x < 0 || x >= g->screenWidth || y < 0 || y >= g->screenHeight) {
+                *obs++ = OBS_WALL;
+            } else if (isLog(g, x, y)) {
+                *obs++ = OBS_LOG;
+            } else {
+                *obs++ = y == 0 || y == g->screenHeight - 1 ? OBS_BANK : OBS_RIVER;
+            }
+        }
+    }
+}
+
+static int64_t pluginScore(void *state) {
+    return ((CrossGame *)state)->score;
 }
 
+// The river never ends, so an agent's episode ends when a log hits it
+static int pluginDone(void *state) {
+    return ((CrossGame *)state)->crashes > 0;
+}
+
+static void pluginReset(void *state) {
+    CrossGame *g = state;
+    g->seed = rng_next(&g->rng); // A new river each episode
+    g->score = 0;
+    g->crashes = 0;
+    initGame(g);
+}
+
+const AtarPlugin atar_plugin = {
+    .abi = ATAR_PLUGIN_ABI,
+    .state_version = 2,
+    .state_size = sizeof(CrossGame),
+    .tick_ns = DELAY * 1000ull,
+    .name = "cross",
+    .init = pluginInit,
+    .input = pluginInput,
+    .tick = pluginTick,
+    .render = pluginRender,
+    .active = pluginActive,
+    .shutdown = pluginShutdown,
+    .actions = "wasd",
+    .obs_size = OBS_ROWS * OBS_COLS,
+    .observe = pluginObserve,
+    .score = pluginScore,
+    .done = pluginDone,
+    .reset = pluginReset,
+};
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+// Event-driven, fixed-timestep game loop shared by the real-time games.
+//
+// The loop blocks in a single poll() over stdin, a timerfd and a signalfd,
+// so the process sleeps until something happens. Key presses are returned
+// as soon as they arrive, all of them, in order. Ticks come from an absolute
+// CLOCK_MONOTONIC timer, so the simulation rate does not drift with render
+// cost or terminal backpressure. When the game falls behind, loop_wait()
+// reports several ticks at once, up to LOOP_MAX_CATCH_UP, and drops the rest.
+// Termination signals arrive through the signalfd and are handled in the
+// normal flow of the game instead of inside a signal handler. A paused game
+// can disarm the timer and use no CPU at all. So does SIGCONT after the menu
+// stopped the game in the background: the timer restarts from the moment
+// of resumption instead of catching up on the time spent stopped.
+//
+// Lateness of each timer wake-up (jitter) and the work done per frame are
+// kept in log2 histograms. Set ATAR_LOOP_STATS to a file name (or 1 for
+// stderr) to dump them on exit.
+
+#define LOOP_MAX_CATCH_UP 5
+#define LOOP_MAX_KEYS 64
+#define LOOP_BUCKETS 32
+
+typedef struct {
+    uint64_t count[LOOP_BUCKETS]; // Bucket i holds [2^(i-1), 2^i) microseconds, bucket 0 < 1us
+    uint64_t samples;
+    uint64_t max_ns;
+} LoopHistogram;
+
+typedef struct {
+    int ticks;                 // Simulation ticks due now
+    int keys;                  // Keys read, in arrival order
+    char key[LOOP_MAX_KEYS];
+    int signal;                // Termination signal received, 0 if none
+    int resumed;               // Continued after being stopped, the screen needs a repaint
+} LoopEvents;
+
+typedef struct {
+    int timer_fd, signal_fd;
+    int stdin_open;            // Cleared once stdin reaches end of file
+    int armed;                 // Timer running (not paused)
+    sigset_t old_mask;         // Signal mask to restore on close
+    uint64_t tick_ns;          // Simulation timestep
+    uint64_t next_tick;        // Deadline of the next tick
+    uint64_t wake;             // When the current frame started
+    uint64_t last_wake;        // Previous timer wake-up, 0 after a pause
+    uint64_t ticks;            // Ticks handed out
+    uint64_t dropped;          // Ticks skipped because the loop fell too far behind
+    uint64_t interval_sum;     // Timer wake-to-wake intervals
+    uint64_t deviation_sum;    // Distance of each interval from tick_ns
+    uint64_t intervals;
+    uint64_t key_events;       // Wake-ups caused by input
+    uint64_t syscalls;         // poll(), read() and timer calls made by the loop
+    LoopHistogram jitter;      // How late each timer wake-up was
+    LoopHistogram frame;       // Update plus render time per frame
+} GameLoop;
+
+static inline uint64_t loop_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Histogram bucket a duration falls in
+static inline int loop_hist_bucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    return bucket < LOOP_BUCKETS ? bucket : LOOP_BUCKETS - 1;
+}
+
+static inline void loop_hist_add(LoopHistogram *h, uint64_t ns) {
+    h->count[loop_hist_bucket(ns)]++;
+    h->samples++;
+    if (ns > h->max_ns) h->max_ns = ns;
+}
+
+static inline struct timespec loop_timespec(uint64_t ns) {
+    struct timespec ts = {.tv_sec = ns / 1000000000ull, .tv_nsec = ns % 1000000000ull};
+    return ts;
+}
+
+// Arm the periodic timer with its first tick one timestep from now
+static inline void loop_resume(GameLoop *loop) {
+    if (loop->armed) return;
+    loop->next_tick = loop_now_ns() + loop->tick_ns;
+    struct itimerspec spec = {
+        .it_interval = loop_timespec(loop->tick_ns),
+        .it_value = loop_timespec(loop->next_tick),
+    };
+    timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    loop->syscalls++;
+    loop->armed = 1;
+    loop->last_wake = 0;
+}
+
+// Stop ticking until loop_resume(); input and signals still wake the loop
+static inline void loop_pause(GameLoop *loop) {
+    if (!loop->armed) return;
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    timerfd_settime(loop->timer_fd, 0, &spec, NULL);
+    loop->syscalls++;
+    loop->armed = 0;
+}
+
+// Create the timer and route termination signals to the loop, returns -1 on failure
+static inline int loop_init(GameLoop *loop, uint64_t tick_ns) {
+    memset(loop, 0, sizeof(*loop));
+    loop->tick_ns = tick_ns;
+    loop->stdin_open = 1;
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGQUIT);
+    sigaddset(&mask, SIGCONT); // Still continues the process, only the signal is queued
+    sigprocmask(SIG_BLOCK, &mask, &loop->old_mask);
+
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    loop->signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (loop->timer_fd < 0 || loop->signal_fd < 0) {
+        if (loop->timer_fd >= 0) close(loop->timer_fd);
+        if (loop->signal_fd >= 0) close(loop->signal_fd);
+        sigprocmask(SIG_SETMASK, &loop->old_mask, NULL);
+        loop->timer_fd = loop->signal_fd = -1;
+        return -1;
+    }
+    loop_resume(loop);
+    return 0;
+}
+
+// Release the descriptors and unblock the signals again
+static inline void loop_close(GameLoop *loop) {
+    if (loop->tick_ns == 0 || loop->timer_fd < 0) return;
+    close(loop->timer_fd);
+    close(loop->signal_fd);
+    loop->timer_fd = loop->signal_fd = -1;
+    sigprocmask(SIG_SETMASK, &loop->old_mask, NULL);
+}
+
+// Block until a key, a tick or a signal arrives and report what happened
+static inline int loop_wait(GameLoop *loop, LoopEvents *events) {
+    struct pollfd fds[3] = {
+        {loop->stdin_open ? STDIN_FILENO : -1, POLLIN, 0},
+        {loop->timer_fd, POLLIN, 0},
+        {loop->signal_fd, POLLIN, 0},
+    };
+    events->ticks = 0;
+    events->keys = 0;
+    events->signal = 0;
+    events->resumed = 0;
+
+    int ready;
+    do {
+        loop->syscalls++;
+        ready = poll(fds, 3, -1);
+    } while (ready < 0 && errno == EINTR);
+    if (ready < 0) return -1;
+    uint64_t now = loop_now_ns();
+    loop->wake = now;
+
+    if (fds[2].revents & POLLIN) {
+        struct signalfd_siginfo info;
+        loop->syscalls++;
+        if (read(loop->signal_fd, &info, sizeof(info)) == sizeof(info)) {
+            if (info.ssi_signo == SIGCONT) {
+                events->resumed = 1;
+            } else {
+                events->signal = info.ssi_signo;
+            }
+        }
+    }
+    if (events->resumed && loop->armed) {
+        // Expirations that piled up while stopped are dropped with the old timer
+        loop_pause(loop);
+        loop_resume(loop);
+        fds[1].revents = 0;
+    }
+
+    if (fds[0].revents & (POLLIN | POLLHUP)) {
+        loop->syscalls++;
+        ssize_t n = read(STDIN_FILENO, events->key, sizeof(events->key));
+        if (n > 0) {
+            events->keys = n;
+            loop->key_events++;
+        } else if (n == 0 || errno != EAGAIN) {
+            loop->stdin_open = 0; // Nothing more will come, stop polling it
+        }
+    }
+
+    uint64_t expirations;
+    if (fds[1].revents & POLLIN) loop->syscalls++;
+    if ((fds[1].revents & POLLIN) &&
+        read(loop->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        // The latest expiration was due (expirations - 1) steps after next_tick
+        uint64_t deadline = loop->next_tick + (expirations - 1) * loop->tick_ns;
+        loop_hist_add(&loop->jitter, now > deadline ? now - deadline : 0);
+        loop->next_tick += expirations * loop->tick_ns;
+
+        if (expirations > LOOP_MAX_CATCH_UP) {
+            loop->dropped += expirations - LOOP_MAX_CATCH_UP;
+            expirations = LOOP_MAX_CATCH_UP;
+        }
+        events->ticks = (int)expirations;
+        loop->ticks += expirations;
+
+        if (loop->last_wake) {
+            uint64_t interval = now - loop->last_wake;
+            loop->interval_sum += interval;
+            loop->deviation_sum += interval > loop->tick_ns ? interval - loop->tick_ns
+                                                            : loop->tick_ns - interval;
+            loop->intervals++;
+        }
+        loop->last_wake = now;
+    }
+    return 0;
+}
+
+// Call after the frame is rendered to record how long it took, returns
+// that time
+static inline uint64_t loop_frame_done(GameLoop *loop) {
+    uint64_t ns = loop_now_ns() - loop->wake;
+    loop_hist_add(&loop->frame, ns);
+    return ns;
+}
+
+static inline void loop_hist_print(const LoopHistogram *h, FILE *f, const char *name) {
+    fprintf(f, "%s: %llu samples, max %.3f ms\n", name,
+            (unsigned long long)h->samples, h->max_ns / 1e6);
+    for (int i = 0; i < LOOP_BUCKETS; i++) {
+        if (!h->count[i]) continue;
+        double share = 100.0 * h->count[i] / h->samples;
+        fprintf(f, "  %8llu - %8llu us %10llu  %5.1f%% ",
+                i ? 1ull << (i - 1) : 0ull, 1ull << i,
+                (unsigned long long)h->count[i], share);
+        for (int bar = 0; bar < (int)(share / 2); bar++) fputc('#', f);
+        fputc('\n', f);
+    }
+}
+
+static inline void loop_report(const GameLoop *loop, FILE *f) {
+    double mean = loop->intervals ? (double)loop->interval_sum / loop->intervals : 0;
+    double deviation = loop->intervals ? (double)loop->deviation_sum / loop->intervals : 0;
+    fprintf(f, "Loop: %llu ticks at %.3f ms, %llu dropped, %llu input wake-ups, tick interval mean %.3f ms, "
+               "mean deviation from the timestep %.3f ms\n",
+            (unsigned long long)loop->ticks, loop->tick_ns / 1e6, (unsigned long long)loop->dropped,
+            (unsigned long long)loop->key_events, mean / 1e6, deviation / 1e6);
+    loop_hist_print(&loop->jitter, f, "Wake-up jitter");
+    loop_hist_print(&loop->frame, f, "Frame time");
+}
+
+// Dump the telemetry where ATAR_LOOP_STATS points, if anywhere
+static inline void loop_dump(const GameLoop *loop) {
+    const char *target = getenv("ATAR_LOOP_STATS");
+    if (!target || (loop->ticks == 0 && loop->key_events == 0)) return;
+    if (strcmp(target, "1") == 0) {
+        loop_report(loop, stderr);
+        return;
+    }
+    FILE *f = fopen(target, "a");
+    if (f) {
+        loop_report(loop, f);
+        fclose(f);
+    }
+}
+
+#endif
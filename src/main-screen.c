@@ -1,72 +1,118 @@
+#define _GNU_SOURCE // posix_spawn_file_actions_addtcsetpgrp_np()
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <unistd.h>
 #include <signal.h>
 #include <termios.h>
-#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 
-#define MAX_GAMES 100
+#include "catalog.h"
+#include "plugin.h"
+#include "loop.h"
+#include "scores.h"
+#include "telemetry.h"
 
 // Forward declarations
 void restore_canonical_mode();
 void set_non_canonical_mode();
-void display_main_menu(int selected, int game_count, int game_selected, char *formatted_names[]);
-void launch_game(const char *game);
-int get_game_files(char *games[], char *formatted_names[], int max_games);
-
-// Original terminal settings
+void display_main_menu(int selected, int game_selected);
+int launch_game(const CatalogEntry *game);
+void resume_game(int index);
+void end_game(int index);
+void reap_games();
+int run_plugin(const CatalogEntry *game);
+void report_launch();
+void display_scores(const CatalogEntry *game);
+void display_stats(const CatalogEntry *game);
+
+// Games in the current directory, kept up to date while the menu runs
+Catalog catalog;
+
+// Descriptor a launched game finds its ready pipe on (see render_signal_ready)
+#define READY_FD 3
+
+// A rebuilt plugin is reloaded once its file has been left alone this long,
+// so a half-written file from a running compiler is never picked up
+#define RELOAD_SETTLE_NS 200000000ull
+
+// Shared by every plugin game the menu runs, set up on first use
+Renderer screen;
+GameLoop loop;
+
+// Leaderboard on the storage volume, refreshed whenever the menu is drawn
+Scores scores;
+int have_scores;
+
+// Show the Stats screen under the menu instead of the top scores
+int show_stats;
+
+// Games kept alive at once, running or stopped in the background
+#define MAX_RUNNING 8
+// How long a game gets to exit on SIGTERM before it is killed
+#define END_TIMEOUT_MS 1000
+
+// Timing of the last launch
+typedef struct {
+    char title[CATALOG_NAME_MAX];
+    uint64_t spawn_ns;         // posix_spawn() itself
+    uint64_t first_frame_ns;   // Launch until the game's first frame, 0 if it never drew
+    uint64_t exit_ns;          // When the game exited or was stopped
+    uint64_t back_ns;          // Exit until the menu was drawn again
+    int pending;               // back_ns not measured yet
+    int plugin;                // Ran in-process
+    int reloads;               // Hot reloads while it ran
+    int resumed;               // Brought back from the background rather than launched
+    uint64_t background_ns;    // Time spent stopped before the resume
+    uint64_t background_cpu_ns; // CPU it used meanwhile, should stay 0
+} LaunchTiming;
+
+LaunchTiming last_launch;
+extern char **environ;
+
+// A game process under supervision. Each game runs in its own process
+// group, which owns the terminal while the game is in the foreground.
+// Ctrl+Z stops the group and hands the terminal back to the menu; the
+// game's terminal settings are kept until it is resumed.
+typedef struct {
+    pid_t pid;                 // Also the id of its process group
+    int pidfd;                 // Readable once the game has exited
+    int ready_fd;              // Ready pipe (see render_signal_ready), -1 once drawn or closed
+    int stopped;               // Stopped in the background
+    struct termios tio;        // Its terminal settings while stopped
+    char path[CATALOG_NAME_MAX];
+    uint64_t started;          // Start of the current stint in the foreground
+    uint64_t stopped_at;
+    uint64_t cpu_at_stop;      // CPU time used when it was stopped
+    LaunchTiming timing;       // Of the current stint in the foreground
+} RunningGame;
+
+RunningGame running[MAX_RUNNING];
+int running_count;
+int foreground = -1;           // Game owning the terminal, -1 while the menu does
+int signal_fd = -1;            // SIGINT, SIGTERM and SIGCHLD for the supervisor
+int have_tty;                  // stdin is a terminal we can hand over
+
+// Original terminal settings, and the menu's own
 struct termios original_tio;
-
-// Global state variables
-pid_t child_pid = -1; // Stores the child process PID if a game is running
-
-// Signal handler for the parent process
-void parent_signal_handler(int sig) {
-    if (sig == SIGINT) {
-        // If a game is running, terminate it and return to the menu
-        if (child_pid > 0) {
-            kill(child_pid, SIGINT); // Send SIGINT to the child process
-            waitpid(child_pid, NULL, 0); // Wait for the child process to terminate
-            child_pid = -1; // Reset child_pid
-        } else {
-          restore_canonical_mode();
-                  printf("\033[H\033[J");
-
-                  exit(0);
-        }
-    } else if (sig == SIGTERM) {
-        // If SIGTERM is received, terminate both the menu and the game
-        if (child_pid > 0) {
-            kill(child_pid, SIGTERM); // Ensure the child process is terminated
-            waitpid(child_pid, NULL, 0);
-        }
-        restore_canonical_mode();
-        printf("\033[H\033[J");
-        child_pid = -1; // Reset child_pid
-        exit(0);
-    }
-}
-
-// Signal handler for the child process (game)
-void child_signal_handler(int sig) {
-    if (sig == SIGINT) {
-        // Ignore SIGINT (Ctrl+C) to avoid terminating the game
-        printf("\nGame interrupted. Returning to main menu...\n");
-        exit(0);
-    }
-    // Ignore SIGTERM as it is meant for parent termination
-}
+struct termios menu_tio;
 
 // Enable non-canonical mode
 void set_non_canonical_mode() {
-    struct termios new_tio;
     tcgetattr(STDIN_FILENO, &original_tio);
-    new_tio = original_tio;
-    new_tio.c_lflag &= ~(ICANON | ECHO); // Disable line buffering and echo
-    tcsetattr(STDIN_FILENO, TCSANOW, &new_tio);
+    menu_tio = original_tio;
+    menu_tio.c_lflag &= ~(ICANON | ECHO); // Disable line buffering and echo
+    tcsetattr(STDIN_FILENO, TCSANOW, &menu_tio);
 }
 
 // Restore terminal to canonical mode
@@ -74,40 +120,30 @@ void restore_canonical_mode() {
     tcsetattr(STDIN_FILENO, TCSANOW, &original_tio);
 }
 
-// Get game files in the current directory
-int get_game_files(char *games[], char *formatted_names[], int max_games) {
-    DIR *dir;
-    struct dirent *entry;
-    int count = 0;
-
-    if ((dir = opendir(".")) == NULL) {
-        perror("Failed to open directory");
-        return 0;
-    }
-
-    // Scan for files starting with "game_" that are executable
-    while ((entry = readdir(dir)) != NULL) {
-        if (count >= max_games) break;
-
-        if (strncmp(entry->d_name, "game_", 5) == 0 && access(entry->d_name, X_OK) == 0) {
-            games[count] = strdup(entry->d_name);
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
-            // Format the name: remove "game_" and capitalize the first letter
-            char *name = entry->d_name + 5;
-            char *formatted_name = strdup(name);
-            formatted_name[0] = toupper(formatted_name[0]);
+// CPU time a game process has used so far
+static uint64_t game_cpu_ns(pid_t pid) {
+    clockid_t clock;
+    struct timespec ts;
+    if (clock_getcpuclockid(pid, &clock) != 0 || clock_gettime(clock, &ts) < 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
-            formatted_names[count] = formatted_name;
-            count++;
-        }
+// Supervised game started from this catalog path, -1 if none
+static int find_running(const char *path) {
+    for (int i = 0; i < running_count; i++) {
+        if (strcmp(running[i].path, path) == 0) return i;
     }
-
-    closedir(dir);
-    return count;
+    return -1;
 }
 
 // Display the main menu
-void display_main_menu(int selected, int game_count, int game_selected, char *formatted_names[]) {
+void display_main_menu(int selected, int game_selected) {
     printf("\033[H\033[J"); // Clear the screen
     printf("###################################################\n");
     printf("#          WELCOME TO ATARI CONSOLE               #\n");
@@ -116,6 +152,8 @@ void display_main_menu(int selected, int game_count, int game_selected, char *fo
     printf("#   Use 'a' and 'd' to navigate                   #\n");
     printf("#   Use 'w' and 's' to switch game at games       #\n");
     printf("#   Press 'enter' to play at play                 #\n");
+    printf("#   'Stats' shows the last game's counters        #\n");
+    printf("#   Ctrl+Z in a game pauses it, 'x' ends it       #\n");
     printf("#   Press 'q' to exit                             #\n");
     printf("###################################################\n\n");
 
@@ -125,100 +163,653 @@ void display_main_menu(int selected, int game_count, int game_selected, char *fo
         printf("    Play           ");
     }
 
+    char title[CATALOG_NAME_MAX + 16] = "(no games)";
+    if (catalog.count) {
+        const CatalogEntry *game = &catalog.entries[game_selected];
+        snprintf(title, sizeof(title), "%s%s", game->title,
+                 find_running(game->path) >= 0 ? " (paused)" : "");
+    }
     if (selected == 1) {
-        printf("-> [( %s )] <-", formatted_names[game_selected]);
+        printf("-> [( %s )] <-", title);
     } else {
-        printf("    %s     ", formatted_names[game_selected]);
+        printf("    %s     ", title);
     }
 
     if (selected == 2) {
-        printf("       -> [(Exit)] <-\n");
+        printf("       -> [(Stats)] <-");
     } else {
-        printf("           Exit\n");
+        printf("           Stats     ");
+    }
+
+    if (selected == 3) {
+        printf("   -> [(Exit)] <-\n");
+    } else {
+        printf("       Exit\n");
+    }
+
+    // Stopped games and the CPU they used since, which should stay at zero
+    int shown = 0;
+    for (int i = 0; i < running_count; i++) {
+        RunningGame *g = &running[i];
+        if (!g->stopped) continue;
+        int index = catalog_find(&catalog, g->path);
+        printf("%s %s %.0f s, %.3f s CPU since", shown++ ? "," : "\nPaused:",
+               index >= 0 ? catalog.entries[index].title : g->path,
+               (now_ns() - g->stopped_at) / 1e9, (game_cpu_ns(g->pid) - g->cpu_at_stop) / 1e9);
+    }
+    if (shown) printf("\n");
+    if (show_stats) {
+        display_stats(catalog.count ? &catalog.entries[game_selected] : NULL);
+    } else if (catalog.count) {
+        display_scores(&catalog.entries[game_selected]);
     }
 }
 
-// Launch a game
-void launch_game(const char *game) {
-    printf("\nLaunching game: %s\n", game);
+// Name a game's scores and counters are kept under, its title in lower case
+static void score_name(const char *title, char *name, size_t size) {
+    size_t i = 0;
+    for (; i + 1 < size && title[i]; i++) {
+        name[i] = tolower((unsigned char)title[i]);
+    }
+    name[i] = '\0';
+}
+
+// Top scores of the selected game
+void display_scores(const CatalogEntry *game) {
+    ScoreEntry top[SCORES_TOP];
+    char name[sizeof(((ScoreRecord *)0)->game) + 1];
+
+    if (!have_scores) {
+        printf("\nNo scores are kept, %s is not mounted\n", storage_dir());
+        return;
+    }
+    scores_refresh(&scores);
+    score_name(game->title, name, sizeof(name));
+    ScoreBoard *board = scores_board(&scores, name, 0);
+    int count = scores_top(&scores, name, top, SCORES_TOP);
+    printf("\n%s top scores, %ld games played:\n", game->title, board ? board->games : 0L);
+    for (int i = 0; i < count; i++) {
+        char when[32];
+        time_t t = top[i].time;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&t));
+        printf("  %2d. %8lld   %s\n", i + 1, (long long)top[i].score, when);
+    }
+    if (count == 0) printf("  none yet\n");
+}
+
+// Live counters of the game running or played last (see telemetry.h), or
+// of the selected game before any was played
+void display_stats(const CatalogEntry *game) {
+    char name[TELEMETRY_NAME_MAX];
+    TelemetrySegment stats;
+    const char *title = last_launch.title[0] ? last_launch.title : game ? game->title : NULL;
+
+    if (!title) return;
+    score_name(title, name, sizeof(name));
+    printf("\n");
+    if (telemetry_read(name, &stats) < 0) {
+        printf("No counters from %s yet\n", title);
+        return;
+    }
+    telemetry_print(&stats, stdout);
+}
+
+static void show_cursor(int visible) {
+    const char *seq = visible ? "\033[?25h" : "\033[?25l";
+    if (write(STDOUT_FILENO, seq, strlen(seq)) < 0) {
+        // The cursor just keeps its state
+    }
+}
+
+// Give the terminal to a game's process group with its settings
+static void give_terminal(RunningGame *g) {
+    if (!have_tty) return;
+    tcsetattr(STDIN_FILENO, TCSANOW, &g->tio);
+    tcsetpgrp(STDIN_FILENO, g->pid);
+}
+
+// The foreground game stopped or exited: take the terminal back
+static void take_terminal(RunningGame *g) {
+    if (have_tty) {
+        tcsetpgrp(STDIN_FILENO, getpgrp()); // SIGTTOU is blocked, so this works from the background
+        if (g->stopped) tcgetattr(STDIN_FILENO, &g->tio);
+        tcsetattr(STDIN_FILENO, TCSANOW, &menu_tio);
+    }
+    show_cursor(1);
+    g->timing.exit_ns = now_ns();
+    last_launch = g->timing;
+    last_launch.pending = 1;
+    foreground = -1;
+}
+
+static void remove_game(int index) {
+    RunningGame *g = &running[index];
+    close(g->pidfd);
+    if (g->ready_fd >= 0) close(g->ready_fd);
+    memmove(g, g + 1, (running_count - index - 1) * sizeof(RunningGame));
+    running_count--;
+    if (foreground > index) foreground--;
+}
+
+// Launch a game into the foreground without waiting for it. The game is
+// started with posix_spawn() straight from its catalog path, with no shell
+// and no PATH search, in a new process group that gets the terminal. It
+// inherits the write end of a pipe on READY_FD, and a byte arrives on it
+// when its first frame is drawn. Returns -1 if it could not be started.
+int launch_game(const CatalogEntry *game) {
+    int ready[2];
+    char path[CATALOG_NAME_MAX + 2];
+    char *argv[] = {(char *)game->path, NULL};
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t signals;
+
+    if (running_count == MAX_RUNNING) {
+        fprintf(stderr, "Too many games paused, end one with 'x' first\n");
+        return -1;
+    }
+    snprintf(path, sizeof(path), "./%s", game->path);
+    if (pipe(ready) < 0) {
+        perror("Error creating the launch pipe");
+        return -1;
+    }
+    fcntl(ready[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ready[1], F_SETFD, FD_CLOEXEC);
+    if (ready[1] == READY_FD) {
+        // dup2() onto itself would leave close-on-exec set
+        int fd = fcntl(ready[1], F_DUPFD_CLOEXEC, READY_FD + 1);
+        close(ready[1]);
+        ready[1] = fd;
+    }
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, ready[1], READY_FD);
+    if (have_tty) {
+        // The child takes the terminal before exec, so it never runs in the background
+        posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+    }
+
+    // The game gets default signal handling, including job control, and an
+    // empty signal mask, in a process group of its own
+    posix_spawnattr_init(&attr);
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attr, &signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGTSTP);
+    sigaddset(&signals, SIGTTIN);
+    sigaddset(&signals, SIGTTOU);
+    posix_spawnattr_setsigdefault(&attr, &signals);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+
+    // Only the child gets ATAR_READY_FD; the menu renders plugin games itself
+    // and must not write to the pipe
+    int env_count = 0;
+    while (environ[env_count]) env_count++;
+    char **envp = malloc((env_count + 2) * sizeof(char *));
+    if (!envp) {
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attr);
+        close(ready[0]);
+        close(ready[1]);
+        return -1;
+    }
+    char ready_fd[32];
+    snprintf(ready_fd, sizeof(ready_fd), "ATAR_READY_FD=%d", READY_FD);
+    int envc = 0;
+    for (int i = 0; i < env_count; i++) {
+        if (strncmp(environ[i], "ATAR_READY_FD=", 14) != 0) envp[envc++] = environ[i];
+    }
+    envp[envc++] = ready_fd;
+    envp[envc] = NULL;
+
     fflush(stdout);
+    RunningGame *g = &running[running_count];
+    memset(g, 0, sizeof(*g));
+    strcpy(g->path, game->path);
+    strcpy(g->timing.title, game->title);
+    g->started = now_ns();
+    pid_t pid;
+    int error = posix_spawn(&pid, path, &actions, &attr, argv, envp);
+    g->timing.spawn_ns = now_ns() - g->started;
+    free(envp);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(ready[1]);
+    if (error) {
+        close(ready[0]);
+        fprintf(stderr, "Error launching game: %s\n", strerror(error));
+        return -1;
+    }
+
+    // The child is not reaped before we have the pidfd, so the pid can't be reused
+    g->pid = pid;
+    g->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (g->pidfd < 0) {
+        perror("Error watching the game");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(ready[0]);
+        if (have_tty) tcsetpgrp(STDIN_FILENO, getpgrp());
+        return -1;
+    }
+    fcntl(g->pidfd, F_SETFD, FD_CLOEXEC);
+    g->ready_fd = ready[0];
+    foreground = running_count++;
+    return 0;
+}
+
+// Bring a stopped game back exactly where it was
+void resume_game(int index) {
+    RunningGame *g = &running[index];
+    fflush(stdout);
+    memset(&g->timing, 0, sizeof(g->timing));
+    int catalog_index = catalog_find(&catalog, g->path);
+    strcpy(g->timing.title, catalog_index >= 0 ? catalog.entries[catalog_index].title : g->path);
+    g->timing.resumed = 1;
+    g->timing.background_ns = now_ns() - g->stopped_at;
+    g->timing.background_cpu_ns = game_cpu_ns(g->pid) - g->cpu_at_stop;
+    g->started = now_ns();
+    give_terminal(g);
+    g->stopped = 0;
+    foreground = index;
+    kill(-g->pid, SIGCONT);
+}
 
-    child_pid = fork();
-
-    if (child_pid == 0) {
-        // Child process: run the game
-        signal(SIGINT, child_signal_handler); // Handle SIGINT for the game
-        signal(SIGTERM, SIG_IGN); // Ignore SIGTERM in the game process
-
-        char path[256];
-        snprintf(path, sizeof(path), "./%s", game);
-        execlp(path, game, NULL);
-        perror("Error launching game");
-        exit(EXIT_FAILURE);
-    } else if (child_pid > 0) {
-        // Parent process: wait for the game to finish
-        int status;
-        waitpid(child_pid, &status, 0);
-        child_pid = -1; // Reset child_pid after the game exits
-        printf("\nGame exited. Returning to main menu...\n");
-        sleep(2);
+// End a game for good. It gets the terminal back and SIGTERM so it can
+// restore the terminal and finish its recording, then SIGKILL if it hangs.
+void end_game(int index) {
+    RunningGame *g = &running[index];
+    siginfo_t info;
+    if (g->stopped) give_terminal(g);
+    kill(-g->pid, SIGTERM);
+    kill(-g->pid, SIGCONT);
+    struct pollfd fd = {g->pidfd, POLLIN, 0};
+    if (poll(&fd, 1, END_TIMEOUT_MS) <= 0) kill(-g->pid, SIGKILL);
+    waitid(P_PIDFD, g->pidfd, &info, WEXITED);
+    if (have_tty) {
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+        tcsetattr(STDIN_FILENO, TCSANOW, &menu_tio);
+    }
+    if (foreground == index) foreground = -1;
+    remove_game(index);
+}
+
+// Collect what happened to the games: exits through their pidfds, stops
+// through SIGCHLD. Both are waited for by pidfd, never by a bare pid.
+void reap_games() {
+    for (int i = running_count - 1; i >= 0; i--) {
+        RunningGame *g = &running[i];
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_PIDFD, g->pidfd, &info, WEXITED | WSTOPPED | WNOHANG) < 0 || info.si_pid == 0) {
+            continue;
+        }
+        if (info.si_code == CLD_STOPPED) {
+            // Ctrl+Z stops only the game's main process; SIGSTOP the whole
+            // group so nothing it started keeps running in the background
+            kill(-g->pid, SIGSTOP);
+            g->stopped = 1;
+            g->stopped_at = now_ns();
+            g->cpu_at_stop = game_cpu_ns(g->pid);
+            if (i == foreground) take_terminal(g);
+        } else {
+            if (i == foreground) take_terminal(g);
+            remove_game(i);
+        }
+    }
+}
+
+// A byte on the ready pipe is the game's first frame
+static void check_ready(RunningGame *g) {
+    char byte;
+    ssize_t n = read(g->ready_fd, &byte, 1);
+    if (n > 0 && !g->timing.first_frame_ns) g->timing.first_frame_ns = now_ns() - g->started;
+    if (n >= 0 || errno != EINTR) {
+        close(g->ready_fd); // Nothing more to learn from it
+        g->ready_fd = -1;
+    }
+}
+
+// A rebuilt plugin file waiting to be reloaded
+typedef struct {
+    int64_t mtime_ns;          // Version seen last, 0 if the file is unchanged
+    uint64_t since;            // When that version was first seen
+    int64_t failed_ns;         // Version that failed to load, not retried
+} ReloadWatch;
+
+// Swap in the plugin's new build once the file has settled. Compatible
+// state is kept and the game carries on with the new code; otherwise the
+// old build shuts its state down and the new one starts a fresh game.
+// Returns -1 if the game can't go on.
+static int reload_plugin(PluginModule *module, const char *path, void **state,
+                         ReloadWatch *watch, int rows, int cols) {
+    struct stat st;
+    if (stat(path, &st) < 0) return 0; // Being replaced, or removed while playing
+    int64_t mtime = plugin_mtime(&st);
+    if (mtime == module->mtime_ns && st.st_size == module->size) {
+        watch->mtime_ns = 0;
+        return 0;
+    }
+    if (mtime == watch->failed_ns) return 0;
+    if (mtime != watch->mtime_ns) {
+        watch->mtime_ns = mtime;
+        watch->since = now_ns();
+        return 0;
+    }
+    if (now_ns() - watch->since < RELOAD_SETTLE_NS) return 0;
+
+    PluginModule next;
+    if (plugin_open(&next, path) < 0) {
+        watch->failed_ns = mtime; // Wait for the next build
+        return 0;
+    }
+    watch->mtime_ns = 0;
+    const AtarPlugin *old = module->api, *api = next.api;
+    if (!plugin_compatible(old, api)) {
+        old->shutdown(*state);
+        free(*state);
+        *state = calloc(1, api->state_size);
+        if (!*state || !api->init(*state, rows, cols, now_ns())) {
+            plugin_close(module);
+            *module = next;
+            return -1;
+        }
+    }
+    // The old descriptor goes away with its code
+    if (api->tick_ns != old->tick_ns) {
+        loop_pause(&loop);
+        loop.tick_ns = api->tick_ns;
+    }
+    plugin_close(module);
+    *module = next;
+    last_launch.reloads++;
+    return 0;
+}
+
+// Run a plugin game inside the menu process: no process to create, and the
+// terminal, loop and renderer stay set up between games. The plugin file is
+// checked on every wake-up and reloaded when it is rebuilt. Returns 1 if a
+// termination signal asked the whole console to quit.
+int run_plugin(const CatalogEntry *game) {
+    PluginModule module;
+    ReloadWatch watch = {0};
+    struct winsize ws;
+    int rows = 24, cols = 80, quit = 0, broken = 0;
+
+    fflush(stdout);
+    memset(&last_launch, 0, sizeof(last_launch));
+    strcpy(last_launch.title, game->title);
+    last_launch.plugin = 1;
+    Telemetry telemetry;
+    RenderStats base = screen.stats; // The renderer is kept across games
+    uint64_t start = now_ns();
+    if (plugin_open(&module, game->path) < 0) {
+        fprintf(stderr, "Error loading %s: %s\n", game->path, module.error);
+        return 0;
+    }
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        rows = ws.ws_row;
+        cols = ws.ws_col;
+    }
+
+    // Keep the renderer unless the terminal was resized since the last game
+    if (screen.out && (screen.width != cols || screen.height != rows)) {
+        render_shutdown(&screen);
+    }
+    if (screen.out) {
+        render_invalidate(&screen);
+        show_cursor(0);
+    } else if (render_init(&screen, cols, rows) < 0) {
+        fprintf(stderr, "Failed to allocate the screen buffers\n");
+        plugin_close(&module);
+        return 0;
+    }
+
+    const AtarPlugin *api = module.api;
+    void *state = calloc(1, api->state_size);
+    if (!state || loop_init(&loop, api->tick_ns) < 0) {
+        free(state);
+        plugin_close(&module);
+        show_cursor(1);
+        return 0;
+    }
+    telemetry_open(&telemetry, api->name, api->tick_ns);
+    int playing = api->init(state, rows, cols, now_ns());
+    broken = !playing;
+    last_launch.spawn_ns = now_ns() - start;
+    if (playing) {
+        api->render(state, &screen);
+        render_present(&screen);
+        last_launch.first_frame_ns = now_ns() - start;
+    }
+
+    while (playing) {
+        LoopEvents events;
+        if (loop_wait(&loop, &events) < 0) break;
+        if (events.signal) {
+            // Ctrl+C leaves the game, anything else closes the console
+            quit = events.signal != SIGINT;
+            break;
+        }
+        if (events.resumed) render_invalidate(&screen);
+        for (int i = 0; i < events.keys && playing; i++) {
+            playing = api->input(state, events.key[i]);
+        }
+        for (int i = 0; i < events.ticks && playing; i++) {
+            api->tick(state);
+        }
+        if (!playing) break;
+
+        if (reload_plugin(&module, game->path, &state, &watch, rows, cols) < 0) {
+            broken = 1;
+            break;
+        }
+        api = module.api;
+
+        // Let an idle game sleep until a key arrives
+        if (api->active(state)) {
+            loop_resume(&loop);
+        } else {
+            loop_pause(&loop);
+        }
+        api->render(state, &screen);
+        render_present(&screen);
+        uint64_t frame_ns = loop_frame_done(&loop);
+        RenderStats shown = screen.stats;
+        shown.frames -= base.frames;
+        shown.bytes -= base.bytes;
+        shown.writes -= base.writes;
+        telemetry_frame(&telemetry, &loop, shown, events.keys, api->score ? api->score(state) : 0,
+                        frame_ns);
+    }
+
+    last_launch.exit_ns = now_ns();
+    if (state && !broken && module.api->score && have_scores) {
+        scores_add(&scores, module.api->name, module.api->score(state));
+    }
+    if (state && !broken) module.api->shutdown(state); // Only a game whose init succeeded
+    free(state);
+    plugin_close(&module);
+    loop_dump(&loop);
+    loop_close(&loop);
+    telemetry_close(&telemetry);
+    show_cursor(1);
+    last_launch.pending = 1;
+    return quit;
+}
+
+// Show the last launch under the menu and log it where ATAR_LAUNCH_LOG
+// points (a file, or 1 for stderr)
+void report_launch() {
+    LaunchTiming *t = &last_launch;
+    if (t->pending) {
+        t->back_ns = now_ns() - t->exit_ns;
+        t->pending = 0;
+
+        const char *target = getenv("ATAR_LAUNCH_LOG");
+        FILE *log = !target ? NULL : strcmp(target, "1") == 0 ? stderr : fopen(target, "a");
+        if (log) {
+            if (t->resumed) {
+                fprintf(log, "resume %s: %.3f s in the background, %.3f ms CPU there, back to menu %.3f ms\n",
+                        t->title, t->background_ns / 1e9, t->background_cpu_ns / 1e6, t->back_ns / 1e6);
+            } else {
+                fprintf(log, "launch %s: %s %.3f ms, first frame %.3f ms, exit to menu %.3f ms, %d reloads\n",
+                        t->title, t->plugin ? "load" : "spawn", t->spawn_ns / 1e6, t->first_frame_ns / 1e6,
+                        t->back_ns / 1e6, t->reloads);
+            }
+            if (log != stderr) fclose(log);
+        }
+    }
+    if (!t->title[0]) return;
+    if (t->resumed) {
+        printf("\nLast game: %s, resumed after %.1f s in the background using %.3f s CPU\n",
+               t->title, t->background_ns / 1e9, t->background_cpu_ns / 1e9);
+    } else if (t->first_frame_ns) {
+        printf("\nLast launch: %s%s, first frame %.1f ms, back to menu %.1f ms",
+               t->title, t->plugin ? " (in-process)" : "", t->first_frame_ns / 1e6, t->back_ns / 1e6);
+        if (t->reloads) printf(", reloaded %d times", t->reloads);
+        printf("\n");
     } else {
-        perror("Error forking process");
+        printf("\nLast launch: %s drew no frame, back to menu %.1f ms\n", t->title, t->back_ns / 1e6);
     }
 }
 
 int main() {
-    // Set up signal handlers for the parent process
-    signal(SIGINT, parent_signal_handler);
-    signal(SIGTERM, parent_signal_handler);
+    // Ctrl+C, SIGTERM and child state changes arrive through a signalfd and
+    // are handled in the main loop, not in a signal handler. SIGTTOU is only
+    // blocked, so the menu can take the terminal back from the background.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    sigdelset(&signals, SIGTTOU);
+    signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        perror("Failed to set up the signal descriptor");
+        return 1;
+    }
+    have_tty = isatty(STDIN_FILENO);
 
     set_non_canonical_mode();
 
-    char *games[MAX_GAMES] = {NULL};
-    char *formatted_names[MAX_GAMES] = {NULL};
-    int game_count = get_game_files(games, formatted_names, MAX_GAMES);
+    catalog_open(&catalog);
+    have_scores = scores_open(&scores) == 0;
     int selected = 0;
     int game_selected = 0;
     int quit_program = 0;
 
-    // Handle case when no games are found
-    if (game_count == 0) {
+    // Handle case when no games are found and none can appear
+    if (catalog.count == 0 && catalog.watch_fd < 0) {
         printf("No games found! Exiting...\n");
         restore_canonical_mode();
         return 1;
     }
 
     while (!quit_program) {
-        display_main_menu(selected, game_count, game_selected, formatted_names);
-        char input = getchar();
+        // The menu draws and reads keys only while it has the terminal
+        if (foreground < 0) {
+            display_main_menu(selected, game_selected);
+            report_launch();
+            fflush(stdout);
+        }
+
+        // Wait for a key, a signal, a game drawing, stopping or exiting, or
+        // games being installed or removed
+        struct pollfd fds[3 + 2 * MAX_RUNNING];
+        int nfds = 0;
+        fds[nfds++] = (struct pollfd){foreground < 0 ? STDIN_FILENO : -1, POLLIN, 0};
+        fds[nfds++] = (struct pollfd){catalog.watch_fd, POLLIN, 0};
+        fds[nfds++] = (struct pollfd){signal_fd, POLLIN, 0};
+        for (int i = 0; i < running_count; i++) {
+            fds[nfds++] = (struct pollfd){running[i].pidfd, POLLIN, 0};
+            fds[nfds++] = (struct pollfd){running[i].ready_fd, POLLIN, 0};
+        }
+        if (poll(fds, nfds, -1) < 0) continue;
+
+        int reap = 0;
+        if (fds[2].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                if (info.ssi_signo == SIGCHLD) {
+                    reap = 1;
+                } else {
+                    quit_program = 1;
+                }
+            }
+        }
+        for (int i = 0; i < running_count; i++) {
+            if (fds[3 + 2 * i].revents & POLLIN) reap = 1;
+            if (fds[4 + 2 * i].revents & (POLLIN | POLLHUP)) check_ready(&running[i]);
+        }
+        if (reap) reap_games();
+
+        if (fds[1].revents & POLLIN) {
+            // Stay on the same game if it is still there
+            char current[CATALOG_NAME_MAX] = "";
+            if (catalog.count) strcpy(current, catalog.entries[game_selected].path);
+            if (catalog_update(&catalog)) {
+                int index = catalog_find(&catalog, current);
+                game_selected = index >= 0 ? index : 0;
+                // A plugin that just appeared takes over its executable's place
+                while (catalog_shadowed(&catalog, game_selected)) game_selected--;
+            }
+        }
+        if (foreground >= 0 || !(fds[0].revents & POLLIN)) continue;
+
+        // read() rather than getchar(): stdio could hold back keys that
+        // poll() no longer reports, or that a plugin game should get
+        char input;
+        if (read(STDIN_FILENO, &input, 1) != 1) continue;
+        int game_count = catalog.count;
 
         if (input == 'q') {
             quit_program = 1; // Exit on 'q'
         } else if (input == 'a') {
-            selected = (selected - 1 + 3) % 3; // Navigate left
+            selected = (selected - 1 + 4) % 4; // Navigate left
         } else if (input == 'd') {
-            selected = (selected + 1) % 3; // Navigate right
-        } else if (input == 'w' && selected == 1) {
+            selected = (selected + 1) % 4; // Navigate right
+        } else if (input == 'w' && selected == 1 && game_count) {
             // Move selection up in the game list
-            game_selected = (game_selected - 1 + game_count) % game_count;
-        } else if (input == 's' && selected == 1) {
+            game_selected = catalog_step(&catalog, game_selected, -1);
+        } else if (input == 's' && selected == 1 && game_count) {
             // Move selection down in the game list
-            game_selected = (game_selected + 1) % game_count;
+            game_selected = catalog_step(&catalog, game_selected, 1);
+        } else if (input == 'x' && game_count) {
+            // End the selected game if it is paused
+            int index = find_running(catalog.entries[game_selected].path);
+            if (index >= 0) end_game(index);
         } else if (input == '\n') {
-            if (selected == 0) {
-                // Play button
-                launch_game(games[game_selected]);
+            if (selected == 0 && game_count) {
+                // Play button: pick a paused game up where it was, or start one
+                const CatalogEntry *game = &catalog.entries[game_selected];
+                int index = find_running(game->path);
+                if (index >= 0) {
+                    resume_game(index);
+                } else if (!game->plugin) {
+                    launch_game(game);
+                } else if (run_plugin(game)) {
+                    quit_program = 1;
+                }
             } else if (selected == 2) {
+                // Stats: show the counters instead of the scores, or back
+                show_stats = !show_stats;
+            } else if (selected == 3) {
                 // Exit
                 quit_program = 1;
             }
         }
     }
 
-    for (int i = 0; i < game_count; i++) {
-        if (games[i]) free(games[i]);
-        if (formatted_names[i]) free(formatted_names[i]);
+    while (running_count) {
+        end_game(running_count - 1);
     }
+    catalog_close(&catalog);
+    scores_close(&scores);
+    render_shutdown(&screen);
 
     restore_canonical_mode();
 
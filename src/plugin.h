@@ -0,0 +1,184 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "render.h"
+
+// Plugin interface for games the menu loads in-process.
+//
+// A plugin is a shared object (game_NAME.so) exporting one AtarPlugin
+// descriptor as ATAR_PLUGIN_SYMBOL. The host owns everything around the
+// game: the terminal, the fixed-timestep loop and the Renderer. The game's
+// state is a single block of state_size bytes that the host allocates and
+// hands to every call, so the plugin keeps no globals of its own.
+//
+// Because the state lives with the host, a rebuilt plugin can be swapped in
+// while the game runs: if the new build reports the same abi, state_size
+// and state_version, the host keeps the state and carries on with the new
+// code. Otherwise the old build shuts the state down and the new one starts
+// a fresh game. Bump state_version whenever the meaning of the state changes
+// without its size changing. Memory the plugin allocates from the state
+// must come from malloc(), which outlives the plugin's own code.
+//
+// Games can also offer an agent interface: a fixed-size observation of the
+// state, the score and the end of an episode. batch.h steps thousands of
+// instances of such a game in parallel for bots to play.
+//
+//   cc -O2 -shared -fPIC -DATAR_PLUGIN -o game_snake.so src/snake.c
+
+#define ATAR_PLUGIN_ABI 2 // 2: agent interface
+#define ATAR_PLUGIN_SYMBOL "atar_plugin"
+
+typedef struct {
+    uint32_t abi;                  // ATAR_PLUGIN_ABI the plugin was built with
+    uint32_t state_version;        // Layout version of the state block
+    uint64_t state_size;           // Bytes the host allocates (zeroed) for the state
+    uint64_t tick_ns;              // Simulation timestep
+    const char *name;
+
+    // Start a game on a term_rows x term_cols terminal, returns 0 on failure.
+    // A failed init cleans up after itself: the host frees the state block
+    // without calling shutdown.
+    int (*init)(void *state, int term_rows, int term_cols, uint64_t seed);
+    // Apply one key as it arrives, returns 0 to quit
+    int (*input)(void *state, char key);
+    // Advance the simulation by one timestep
+    void (*tick)(void *state);
+    // Draw the whole frame into the back buffer; the host presents it
+    void (*render)(void *state, Renderer *screen);
+    // Returns 1 while the game needs ticks, 0 lets the host stop the timer
+    int (*active)(void *state);
+    // Release whatever init allocated; the host frees the state block
+    void (*shutdown)(void *state);
+
+    // Agent interface, all NULL if the game has none
+    const char *actions;           // Keys an agent may press
+    uint32_t obs_size;             // Bytes observe() writes
+    void (*observe)(void *state, uint8_t *obs);
+    int64_t (*score)(void *state);
+    // Returns 1 once the episode is over; the runner then calls reset
+    int (*done)(void *state);
+    // Start a new episode, reusing what init allocated
+    void (*reset)(void *state);
+} AtarPlugin;
+
+// Host side: a loaded plugin and the version of the file it came from
+
+typedef struct {
+    void *handle;
+    const AtarPlugin *api;
+    int64_t mtime_ns;              // Modification time of the file when loaded
+    int64_t size;
+    char error[160];               // Why the last plugin_open() failed
+} PluginModule;
+
+static inline int64_t plugin_mtime(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+// Does the file hold a whole shared object? dlopen() maps segments past the
+// end of a half-written file and the process dies with SIGBUS touching them.
+static inline int plugin_complete(int fd, int64_t size) {
+    ElfW(Ehdr) header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_phentsize != sizeof(ElfW(Phdr)) ||
+        (int64_t)(header.e_shoff + (uint64_t)header.e_shnum * header.e_shentsize) > size) {
+        return 0;
+    }
+    for (int i = 0; i < header.e_phnum; i++) {
+        ElfW(Phdr) segment;
+        if (pread(fd, &segment, sizeof(segment), header.e_phoff + (uint64_t)i * sizeof(segment)) !=
+                sizeof(segment) ||
+            (int64_t)(segment.p_offset + segment.p_filesz) > size) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Load the plugin in path, returns -1 with m->error set on failure.
+//
+// The code is loaded from a private copy that is unlinked straight away.
+// The compiler can then rewrite the file in place while the old code keeps
+// running, and every reload gets a fresh handle instead of the cached one
+// dlopen() hands out for a path it has seen before.
+static inline int plugin_open(PluginModule *m, const char *path) {
+    char copy[] = "/tmp/atar_pluginXXXXXX";
+    char buf[65536];
+    struct stat st;
+    ssize_t n = 0;
+
+    m->handle = NULL;
+    m->api = NULL;
+    int in = open(path, O_RDONLY | O_CLOEXEC);
+    if (in < 0 || fstat(in, &st) < 0) {
+        snprintf(m->error, sizeof(m->error), "cannot open %s", path);
+        if (in >= 0) close(in);
+        return -1;
+    }
+    m->mtime_ns = plugin_mtime(&st);
+    m->size = st.st_size;
+    int out = mkstemp(copy);
+    if (out < 0) {
+        snprintf(m->error, sizeof(m->error), "cannot create a copy of %s", path);
+        close(in);
+        return -1;
+    }
+    int64_t copied = 0;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, n) != n) {
+            n = -1;
+            break;
+        }
+        copied += n;
+    }
+    // Check the copy, the original may be rewritten while we read it
+    int complete = n == 0 && plugin_complete(out, copied);
+    close(in);
+    close(out);
+    if (complete) m->handle = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+    unlink(copy);
+    if (!m->handle) {
+        const char *reason = n ? "cannot copy the plugin" : !complete ? "incomplete shared object" : dlerror();
+        snprintf(m->error, sizeof(m->error), "%s", reason ? reason : "dlopen failed");
+        return -1;
+    }
+
+    const AtarPlugin *api = dlsym(m->handle, ATAR_PLUGIN_SYMBOL);
+    if (!api || api->abi != ATAR_PLUGIN_ABI || !api->state_size || !api->tick_ns ||
+        !api->init || !api->input || !api->tick || !api->render || !api->active || !api->shutdown) {
+        snprintf(m->error, sizeof(m->error), "%s is not an ABI %d plugin", path, ATAR_PLUGIN_ABI);
+        dlclose(m->handle);
+        m->handle = NULL;
+        return -1;
+    }
+    m->api = api;
+    return 0;
+}
+
+static inline void plugin_close(PluginModule *m) {
+    if (m->handle) dlclose(m->handle);
+    m->handle = NULL;
+    m->api = NULL;
+}
+
+// Does the plugin support agents?
+static inline int plugin_has_agents(const AtarPlugin *api) {
+    return api->actions && api->obs_size && api->observe && api->score && api->done && api->reset;
+}
+
+// Can state built by one version run under the other?
+static inline int plugin_compatible(const AtarPlugin *a, const AtarPlugin *b) {
+    return a->state_size == b->state_size && a->state_version == b->state_version;
+}
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+// Double-buffered terminal renderer shared by all games.
+//
+// A game draws its whole frame into the back buffer with render_put() and
+// render_text(), then render_present() compares it against the front buffer
+// (what the terminal currently shows) and emits only the changed cells,
+// using cursor-move sequences to skip unchanged runs. The whole frame goes
+// out in a single write().
+
+// Reprinting up to this many unchanged cells is cheaper than a cursor move
+#define RENDER_MAX_SKIP 6
+// Longest cursor-move sequence plus the cell itself: "\033[9999;9999H" + 1
+#define RENDER_CELL_WORST 13
+
+typedef struct {
+    unsigned long frames;      // Frames presented
+    unsigned long bytes;       // Total bytes written to the terminal
+    unsigned long writes;      // Total write() calls
+    size_t last_bytes;         // Bytes written by the last frame
+    int last_writes;           // write() calls made by the last frame
+} RenderStats;
+
+typedef struct {
+    int width, height;
+    char *front;               // What the terminal currently shows
+    char *back;                // Frame being drawn
+    char *out;                 // Escape-sequence output buffer
+    size_t out_cap;
+    int full_redraw;           // Clear the screen on the next present
+    RenderStats stats;
+} Renderer;
+
+// Set by SIGCONT: the game was stopped in the background and the menu has
+// drawn over the screen since, so the next present repaints everything.
+// Games on the event loop get SIGCONT through loop_wait() instead.
+static volatile sig_atomic_t render_continued;
+
+static void render_on_continue(int sig) {
+    (void)sig;
+    render_continued = 1;
+}
+
+// Allocate the buffers for a width x height character frame
+static inline int render_init(Renderer *r, int width, int height) {
+    memset(r, 0, sizeof(*r));
+    r->width = width;
+    r->height = height;
+    r->front = malloc((size_t)width * height);
+    r->back = malloc((size_t)width * height);
+    r->out_cap = (size_t)width * height * RENDER_CELL_WORST + 64;
+    r->out = malloc(r->out_cap);
+    if (!r->front || !r->back || !r->out) {
+        free(r->front);
+        free(r->back);
+        free(r->out);
+        r->front = r->back = r->out = NULL;
+        return -1;
+    }
+    memset(r->back, ' ', (size_t)width * height);
+    r->full_redraw = 1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = render_on_continue;
+    sa.sa_flags = SA_RESTART; // Blocking reads just carry on
+    sigaction(SIGCONT, &sa, NULL);
+
+    // Hide the cursor while the game owns the screen
+    const char hide[] = "\033[?25l";
+    if (write(STDOUT_FILENO, hide, sizeof(hide) - 1) < 0) {
+        // Not fatal, the cursor just stays visible
+    }
+    return 0;
+}
+
+// Force the next present to repaint everything (e.g. after other output)
+static inline void render_invalidate(Renderer *r) {
+    r->full_redraw = 1;
+}
+
+// Blank the back buffer before drawing a new frame
+static inline void render_clear(Renderer *r) {
+    memset(r->back, ' ', (size_t)r->width * r->height);
+}
+
+// Set a single cell of the back buffer, clipped to the frame
+static inline void render_put(Renderer *r, int row, int col, char c) {
+    if (row < 0 || row >= r->height || col < 0 || col >= r->width) return;
+    r->back[row * r->width + col] = c;
+}
+
+// Print formatted text into the back buffer, clipped to the row
+static inline void render_text(Renderer *r, int row, int col, const char *fmt, ...) {
+    char line[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (len > (int)sizeof(line) - 1) len = sizeof(line) - 1;
+    for (int i = 0; i < len; i++) {
+        render_put(r, row, col + i, line[i]);
+    }
+}
+
+// Append a cursor-move sequence to the output buffer
+static inline size_t render_emit_move(Renderer *r, size_t len, int row, int col) {
+    return len + snprintf(r->out + len, r->out_cap - len, "\033[%d;%dH", row + 1, col + 1);
+}
+
+// Write the output buffer, retrying on short writes and a non-blocking tty
+static inline void render_flush(Renderer *r, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(STDOUT_FILENO, r->out + off, len - off);
+        r->stats.writes++;
+        r->stats.last_writes++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                struct pollfd pfd = {STDOUT_FILENO, POLLOUT, 0};
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            break;
+        }
+        off += n;
+    }
+    r->stats.bytes += off;
+    r->stats.last_bytes = off;
+}
+
+// Tell the menu that launched us (through the pipe it passes in
+// ATAR_READY_FD) that the first frame is on screen. The pipe stays open,
+// so the menu also sees the moment the game exits.
+static inline void render_signal_ready() {
+    const char *fd = getenv("ATAR_READY_FD");
+    if (fd && write(atoi(fd), "R", 1) < 0) {
+        // Not launched from the menu, or it stopped listening
+    }
+}
+
+// Diff the back buffer against the front buffer and emit the changes
+static inline size_t render_present(Renderer *r) {
+    size_t len = 0;
+    int cur_row = -1, cur_col = -1;
+
+    r->stats.frames++;
+    r->stats.last_bytes = 0;
+    r->stats.last_writes = 0;
+
+    if (render_continued) {
+        render_continued = 0;
+        r->full_redraw = 1;
+    }
+    if (r->full_redraw) {
+        // After a clear the terminal is all blanks, so only non-blank cells differ
+        len += snprintf(r->out, r->out_cap, "\033[H\033[2J");
+        memset(r->front, ' ', (size_t)r->width * r->height);
+        cur_row = 0;
+        cur_col = 0;
+        r->full_redraw = 0;
+    }
+
+    for (int y = 0; y < r->height; y++) {
+        char *front = r->front + (size_t)y * r->width;
+        const char *back = r->back + (size_t)y * r->width;
+        for (int x = 0; x < r->width; x++) {
+            if (front[x] == back[x]) continue;
+
+            if (y != cur_row || x < cur_col || x - cur_col > RENDER_MAX_SKIP) {
+                len = render_emit_move(r, len, y, x);
+            } else {
+                // Short gap: reprint the unchanged cells instead of moving
+                while (cur_col < x) {
+                    r->out[len++] = back[cur_col++];
+                }
+            }
+            r->out[len++] = back[x];
+            front[x] = back[x];
+            cur_row = y;
+            cur_col = x + 1;
+        }
+    }
+
+    if (len > 0) {
+        render_flush(r, len);
+    }
+    if (r->stats.frames == 1) {
+        render_signal_ready();
+    }
+    return len;
+}
+
+// Print the renderer counters, used to compare bytes and syscalls per frame
+static inline void render_report(const Renderer *r, FILE *f) {
+    const RenderStats *s = &r->stats;
+    if (s->frames == 0) return;
+    fprintf(f, "Render: %lu frames, %lu bytes (%.1f bytes/frame), %lu writes (%.2f writes/frame)\n",
+            s->frames, s->bytes, (double)s->bytes / s->frames,
+            s->writes, (double)s->writes / s->frames);
+}
+
+// Park the cursor below the frame, show it again and release the buffers
+static inline void render_shutdown(Renderer *r) {
+    if (!r->out) return;
+    char seq[32];
+    int len = snprintf(seq, sizeof(seq), "\033[%d;1H\033[?25h", r->height + 1);
+    if (write(STDOUT_FILENO, seq, len) < 0) {
+        // Nothing left to do if the terminal is gone
+    }
+    if (getenv("ATAR_RENDER_STATS")) {
+        render_report(r, stderr);
+    }
+    free(r->front);
+    free(r->back);
+    free(r->out);
+    r->front = r->back = r->out = NULL;
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "render.h"
+
+// Terminal output on a thread of its own, so a slow or congested terminal
+// never holds up the simulation. Build with -pthread.
+//
+// The game keeps drawing into its Renderer's back buffer as before and
+// calls render_thread_publish() instead of render_present(). Frames are
+// handed over through a triple buffer: the game draws into one buffer,
+// the render thread presents from another, and the third sits in the
+// middle holding the newest finished frame. Publishing swaps the drawn
+// frame into the middle with one atomic exchange and flags it fresh; the
+// render thread takes it with another exchange when it is ready for the
+// next frame. Neither side ever waits for the other. A frame still fresh
+// when the next one is published was never shown and is counted as
+// dropped, so a blocked write() costs frames, not ticks. An eventfd wakes
+// the render thread, which otherwise sleeps.
+//
+// While the thread runs it owns the Renderer's front and output buffers
+// and its counters; the game may only draw. render_thread_stop() hands
+// them back so render_shutdown() works as before. Meanwhile the game reads
+// the counters through render_thread_stats().
+
+#define RENDER_FRESH 4 // Set in middle while it holds an unshown frame
+
+typedef struct {
+    Renderer present;          // The render thread's view: its front buffer, output and stats
+    char *frames[3];           // The three frame buffers, as allocated
+    unsigned middle;           // Index of the middle buffer, | RENDER_FRESH when unshown
+    unsigned drawing;          // Index the game draws into, game side only
+    int wake_fd;               // eventfd, written once per published frame
+    int stop;                  // Set to end the thread
+    int invalidate;            // Repaint everything on the next frame
+    pthread_t thread;
+    int running;
+    uint64_t published;        // Frames the game handed over, game side only
+    uint64_t dropped;          // Of those, replaced before the render thread took them
+    RenderStats shown;         // present.stats as of the last frame, for the game side
+} RenderThread;
+
+static void *render_thread_main(void *arg) {
+    RenderThread *t = arg;
+    unsigned showing = 2; // Buffers start out drawing 0, middle 1, shown 2
+    while (!__atomic_load_n(&t->stop, __ATOMIC_ACQUIRE)) {
+        uint64_t count;
+        if (read(t->wake_fd, &count, sizeof(count)) < 0 && errno != EINTR) break;
+        if (!(__atomic_load_n(&t->middle, __ATOMIC_ACQUIRE) & RENDER_FRESH)) continue;
+
+        // Give back the frame last shown, take the newest one
+        showing = __atomic_exchange_n(&t->middle, showing, __ATOMIC_ACQ_REL) & 3;
+        t->present.back = t->frames[showing];
+        if (__atomic_exchange_n(&t->invalidate, 0, __ATOMIC_ACQ_REL)) {
+            render_invalidate(&t->present);
+        }
+        render_present(&t->present);
+        __atomic_store_n(&t->shown.frames, t->present.stats.frames, __ATOMIC_RELAXED);
+        __atomic_store_n(&t->shown.bytes, t->present.stats.bytes, __ATOMIC_RELAXED);
+        __atomic_store_n(&t->shown.writes, t->present.stats.writes, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// Start presenting screen's frames on a new thread, returns -1 on failure
+// and leaves screen to be presented inline
+static inline int render_thread_start(RenderThread *t, Renderer *screen) {
+    memset(t, 0, sizeof(*t));
+    size_t size = (size_t)screen->width * screen->height;
+    t->frames[0] = screen->back;
+    t->frames[1] = malloc(size);
+    t->frames[2] = malloc(size);
+    t->wake_fd = eventfd(0, EFD_CLOEXEC); // Writes never block, reads wait for one
+    if (!t->frames[1] || !t->frames[2] || t->wake_fd < 0) {
+        free(t->frames[1]);
+        free(t->frames[2]);
+        if (t->wake_fd >= 0) close(t->wake_fd);
+        return -1;
+    }
+    memset(t->frames[1], ' ', size);
+    memset(t->frames[2], ' ', size);
+    t->present = *screen;
+    t->drawing = 0;
+    t->middle = 1;
+
+    // Signals stay with the game's loop (see loop.h), never the render thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int status = pthread_create(&t->thread, NULL, render_thread_main, t);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (status != 0) {
+        free(t->frames[1]);
+        free(t->frames[2]);
+        close(t->wake_fd);
+        return -1;
+    }
+    t->running = 1;
+    return 0;
+}
+
+// Wake the render thread. Adding to the eventfd counter never blocks.
+static inline void render_thread_wake(RenderThread *t) {
+    uint64_t one = 1;
+    if (write(t->wake_fd, &one, sizeof(one)) < 0) {
+        // Cannot happen short of 2^64 unread wake-ups
+    }
+}
+
+// Hand the frame drawn in screen's back buffer to the render thread and
+// draw the next one into a free buffer. Falls back to render_present()
+// when the thread is not running.
+static inline void render_thread_publish(RenderThread *t, Renderer *screen) {
+    if (!t->running) {
+        render_present(screen);
+        return;
+    }
+    unsigned old = __atomic_exchange_n(&t->middle, t->drawing | RENDER_FRESH, __ATOMIC_ACQ_REL);
+    if (old & RENDER_FRESH) t->dropped++;
+    t->published++;
+    t->drawing = old & 3;
+    screen->back = t->frames[t->drawing];
+    render_thread_wake(t);
+}
+
+// Repaint the whole screen with the next frame (render_invalidate() for a
+// renderer whose output is on the thread)
+static inline void render_thread_invalidate(RenderThread *t, Renderer *screen) {
+    if (!t->running) {
+        render_invalidate(screen);
+        return;
+    }
+    __atomic_store_n(&t->invalidate, 1, __ATOMIC_RELEASE);
+}
+
+// Frames, bytes and write() calls presented so far, from either side
+static inline RenderStats render_thread_stats(const RenderThread *t, const Renderer *screen) {
+    if (!t->running) return screen->stats;
+    RenderStats s;
+    memset(&s, 0, sizeof(s));
+    s.frames = __atomic_load_n(&t->shown.frames, __ATOMIC_RELAXED);
+    s.bytes = __atomic_load_n(&t->shown.bytes, __ATOMIC_RELAXED);
+    s.writes = __atomic_load_n(&t->shown.writes, __ATOMIC_RELAXED);
+    return s;
+}
+
+// Print the handoff counters next to render_report()'s
+static inline void render_thread_report(const RenderThread *t, FILE *f) {
+    if (t->published == 0) return;
+    fprintf(f, "Render thread: %llu frames published, %llu dropped (%.1f%%)\n",
+            (unsigned long long)t->published, (unsigned long long)t->dropped,
+            100.0 * t->dropped / t->published);
+}
+
+// Present the last frame, end the thread and give screen its buffers back
+static inline void render_thread_stop(RenderThread *t, Renderer *screen) {
+    if (!t->running) return;
+    __atomic_store_n(&t->stop, 1, __ATOMIC_RELEASE);
+    render_thread_wake(t);
+    pthread_join(t->thread, NULL);
+    t->running = 0;
+    close(t->wake_fd);
+
+    // The newest frame may not have been shown yet
+    unsigned middle = t->middle;
+    if (middle & RENDER_FRESH) {
+        t->present.back = t->frames[middle & 3];
+        render_present(&t->present);
+    }
+    char *back = screen->back;
+    *screen = t->present;
+    screen->back = back;
+    for (int i = 0; i < 3; i++) {
+        if (t->frames[i] != back) free(t->frames[i]);
+    }
+    if (getenv("ATAR_RENDER_STATS")) {
+        render_thread_report(t, stderr);
+    }
+}
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Deterministic session recording shared by the games.
+//
+// A replay file is a header (game name, RNG seed, game parameters), then
+// one event per key press: the tick delta since the previous event as a
+// LEB128 varint followed by the key byte. A footer written on exit holds
+// the final tick and a hash of the final game state so playback can prove
+// it reproduced the session. A file without a footer (the game crashed)
+// still plays back up to its last event. Integers are in host byte order.
+
+#define REPLAY_VERSION 2 // 2: keys are applied as they arrive, several may share a tick
+#define REPLAY_PARAMS 4
+#define REPLAY_HASH_INIT 0xCBF29CE484222325ull
+
+typedef struct {
+    char magic[4];                 // "ATRP"
+    uint16_t version;
+    uint16_t reserved;
+    char game[8];                  // Game name, NUL padded
+    uint64_t seed;                 // Seed of the game's Rng
+    uint32_t params[REPLAY_PARAMS]; // Game-specific settings, e.g. board size
+} ReplayHeader;
+
+typedef struct {
+    uint64_t end_tick;             // Ticks stepped before the session ended
+    uint64_t state_hash;           // Hash of the final game state
+    char magic[4];                 // "ATRE"
+    uint32_t events;               // Number of events recorded
+} ReplayFooter;
+
+typedef struct {
+    int fd;
+    uint64_t last_tick;
+    uint32_t events;
+    size_t len;
+    unsigned char buf[4096];
+} ReplayWriter;
+
+typedef struct {
+    const unsigned char *data;     // Whole file, memory-mapped
+    size_t size;
+    size_t pos, end;               // Event cursor and end of the event stream
+    uint64_t next_tick;            // Tick of the event at pos
+    ReplayHeader header;
+    ReplayFooter footer;
+    int has_footer;
+} ReplayReader;
+
+// Fold bytes into a 64-bit FNV-1a state hash
+static inline uint64_t replay_hash(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+static inline void replay_flush(ReplayWriter *w) {
+    size_t off = 0;
+    while (off < w->len) {
+        ssize_t n = write(w->fd, w->buf + off, w->len - off);
+        if (n <= 0) break;
+        off += n;
+    }
+    w->len = 0;
+}
+
+// Start recording a session, returns -1 if the file can't be created
+static inline int replay_create(ReplayWriter *w, const char *path, const char *game,
+                                uint64_t seed, const uint32_t params[REPLAY_PARAMS]) {
+    ReplayHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "ATRP", 4);
+    header.version = REPLAY_VERSION;
+    strncpy(header.game, game, sizeof(header.game));
+    header.seed = seed;
+    memcpy(header.params, params, sizeof(header.params));
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) return -1;
+    w->last_tick = 0;
+    w->events = 0;
+    w->len = sizeof(header);
+    memcpy(w->buf, &header, sizeof(header));
+    return 0;
+}
+
+// Record a key applied at the given tick; ticks must not decrease
+static inline void replay_record(ReplayWriter *w, uint64_t tick, char key) {
+    if (w->fd < 0) return;
+    if (w->len + 11 > sizeof(w->buf)) replay_flush(w);
+    uint64_t delta = tick - w->last_tick;
+    do {
+        unsigned char byte = delta & 0x7F;
+        delta >>= 7;
+        w->buf[w->len++] = byte | (delta ? 0x80 : 0);
+    } while (delta);
+    w->buf[w->len++] = (unsigned char)key;
+    w->last_tick = tick;
+    w->events++;
+}
+
+// Write the footer and close the file; safe to call more than once
+static inline void replay_finish(ReplayWriter *w, uint64_t end_tick, uint64_t state_hash) {
+    if (w->fd < 0) return;
+    ReplayFooter footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.end_tick = end_tick;
+    footer.state_hash = state_hash;
+    memcpy(footer.magic, "ATRE", 4);
+    footer.events = w->events;
+    if (w->len + sizeof(footer) > sizeof(w->buf)) replay_flush(w);
+    memcpy(w->buf + w->len, &footer, sizeof(footer));
+    w->len += sizeof(footer);
+    replay_flush(w);
+    close(w->fd);
+    w->fd = -1;
+}
+
+// Decode the event at pos into next_tick, returns 0 at the end of the stream
+static inline int replay_decode(ReplayReader *r, uint64_t base_tick) {
+    uint64_t delta = 0;
+    int shift = 0;
+    while (r->pos < r->end) {
+        unsigned char byte = r->data[r->pos++];
+        delta |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+        if (!(byte & 0x80)) {
+            if (r->pos >= r->end) break;
+            r->next_tick = base_tick + delta;
+            return 1;
+        }
+        if (shift > 63) break;
+    }
+    r->pos = r->end;
+    return 0;
+}
+
+// Map a replay file for playback, returns -1 if it isn't a replay of game
+static inline int replay_open(ReplayReader *r, const char *path, const char *game) {
+    struct stat st;
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ReplayHeader)) {
+        close(fd);
+        return -1;
+    }
+    r->size = st.st_size;
+    r->data = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (r->data == MAP_FAILED) {
+        r->data = NULL;
+        return -1;
+    }
+    madvise((void *)r->data, r->size, MADV_SEQUENTIAL);
+
+    memcpy(&r->header, r->data, sizeof(r->header));
+    if (memcmp(r->header.magic, "ATRP", 4) != 0 || r->header.version != REPLAY_VERSION ||
+        strncmp(r->header.game, game, sizeof(r->header.game)) != 0) {
+        munmap((void *)r->data, r->size);
+        r->data = NULL;
+        return -1;
+    }
+
+    r->end = r->size;
+    if (r->size >= sizeof(ReplayHeader) + sizeof(ReplayFooter)) {
+        memcpy(&r->footer, r->data + r->size - sizeof(ReplayFooter), sizeof(ReplayFooter));
+        if (memcmp(r->footer.magic, "ATRE", 4) == 0) {
+            r->has_footer = 1;
+            r->end = r->size - sizeof(ReplayFooter);
+        }
+    }
+
+    // Without a footer the session ends at its last recorded event
+    if (!r->has_footer) {
+        r->pos = sizeof(ReplayHeader);
+        uint64_t tick = 0;
+        while (replay_decode(r, tick)) {
+            tick = r->next_tick;
+            r->footer.end_tick = tick + 1;
+            r->pos++;
+        }
+    }
+
+    r->pos = sizeof(ReplayHeader);
+    replay_decode(r, 0);
+    return 0;
+}
+
+// Key recorded for this tick, or 0; call with non-decreasing ticks
+static inline char replay_key(ReplayReader *r, uint64_t tick) {
+    if (r->pos >= r->end || r->next_tick != tick) return 0;
+    char key = (char)r->data[r->pos++];
+    replay_decode(r, tick);
+    return key;
+}
+
+// Number of ticks to step to reach the end of the session
+static inline uint64_t replay_end_tick(const ReplayReader *r) {
+    return r->footer.end_tick;
+}
+
+static inline void replay_close(ReplayReader *r) {
+    if (r->data) munmap((void *)r->data, r->size);
+    r->data = NULL;
+}
+
+#endif
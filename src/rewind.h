@@ -0,0 +1,157 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// Bounded history for stepping a game backwards, shared by snake and cross.
+//
+// The game pushes one record per tick holding what the tick changed, in a
+// form it can undo on its own (cells the snake's head and tail moved
+// through, logs spawned and gone), plus keyframes where a tick or a key
+// wipes out more than a delta can describe (a crash clearing the river).
+// Stepping back pops the newest record and undoes it, so going back one
+// tick costs the same however long the game has run.
+//
+// Records live back to back in one ring of bytes allocated up front, so
+// the memory used is fixed whatever the arena size. Each record is framed
+// by its length on both ends: the newest one is found from the end, the
+// oldest from the start. When the ring is full, or holds more than
+// max_ticks tick records, the oldest records are dropped; a single record
+// larger than the whole ring empties it, and the game cannot step back
+// past that point.
+
+#define REWIND_TICK 1      // Record undoing one tick
+#define REWIND_KEYFRAME 2  // Record restoring a state wholesale
+
+typedef struct {
+    uint8_t *buf;
+    uint64_t size;             // Bytes in buf, a power of two
+    uint64_t start, end;       // Positions of the oldest record and past the newest
+    uint64_t mark;             // Start of the record being written
+    uint64_t read;             // Payload of the record returned by rewind_last()
+    int overflow;              // The record being written did not fit
+    uint32_t ticks;            // Tick records held
+    uint32_t max_ticks;        // Tick records kept at most
+} RewindBuffer;
+
+// Allocate a ring of at least bytes bytes keeping up to max_ticks ticks,
+// returns -1 on failure
+static inline int rewind_init(RewindBuffer *r, uint64_t bytes, uint32_t max_ticks) {
+    memset(r, 0, sizeof(*r));
+    for (r->size = 64; r->size < bytes; r->size *= 2);
+    r->buf = malloc(r->size);
+    r->max_ticks = max_ticks;
+    return r->buf ? 0 : -1;
+}
+
+static inline void rewind_free(RewindBuffer *r) {
+    free(r->buf);
+    r->buf = NULL;
+}
+
+// Forget every record
+static inline void rewind_clear(RewindBuffer *r) {
+    r->start = r->end = r->mark = 0;
+    r->ticks = 0;
+}
+
+// Copy n bytes to or from ring position pos, wrapping around the end
+static inline void rewind_copy_in(RewindBuffer *r, uint64_t pos, const void *data, uint64_t n) {
+    uint64_t at = pos & (r->size - 1), first = r->size - at < n ? r->size - at : n;
+    memcpy(r->buf + at, data, first);
+    memcpy(r->buf, (const uint8_t *)data + first, n - first);
+}
+
+static inline void rewind_copy_out(const RewindBuffer *r, uint64_t pos, void *data, uint64_t n) {
+    uint64_t at = pos & (r->size - 1), first = r->size - at < n ? r->size - at : n;
+    memcpy(data, r->buf + at, first);
+    memcpy((uint8_t *)data + first, r->buf, n - first);
+}
+
+// Drop the oldest record
+static inline void rewind_drop_oldest(RewindBuffer *r) {
+    uint32_t frame[2]; // Length, type
+    rewind_copy_out(r, r->start, frame, sizeof(frame));
+    r->start += frame[0];
+    if (frame[1] == REWIND_TICK) r->ticks--;
+}
+
+// Make room for n more bytes of the record being written by dropping old
+// records, returns 0 if even an empty history would not hold it
+static inline int rewind_room(RewindBuffer *r, uint64_t n) {
+    while (!r->overflow && r->end + n - r->start > r->size) {
+        if (r->start == r->mark) {
+            r->overflow = 1;
+        } else {
+            rewind_drop_oldest(r);
+        }
+    }
+    return !r->overflow;
+}
+
+// Start a record of the given type
+static inline void rewind_begin(RewindBuffer *r, uint32_t type) {
+    uint32_t frame[2] = {0, type}; // The length is filled in by rewind_end()
+    r->mark = r->end;
+    r->overflow = 0;
+    if (!rewind_room(r, sizeof(frame))) return;
+    rewind_copy_in(r, r->end, frame, sizeof(frame));
+    r->end += sizeof(frame);
+}
+
+// Append n bytes to the record
+static inline void rewind_put(RewindBuffer *r, const void *data, uint64_t n) {
+    if (!rewind_room(r, n)) return;
+    rewind_copy_in(r, r->end, data, n);
+    r->end += n;
+}
+
+// Finish the record. One that did not fit leaves the history empty.
+static inline void rewind_end(RewindBuffer *r) {
+    uint32_t length = r->end + sizeof(length) - r->mark, type;
+    if (!rewind_room(r, sizeof(length))) {
+        rewind_clear(r);
+        return;
+    }
+    rewind_copy_in(r, r->end, &length, sizeof(length));
+    r->end += sizeof(length);
+    rewind_copy_in(r, r->mark, &length, sizeof(length));
+    rewind_copy_out(r, r->mark + sizeof(length), &type, sizeof(type));
+    if (type == REWIND_TICK) r->ticks++;
+    while (r->ticks > r->max_ticks) rewind_drop_oldest(r);
+}
+
+// Type of the newest record, 0 if there is none. Its payload can then be
+// read with rewind_read() and holds *length bytes.
+static inline uint32_t rewind_last(RewindBuffer *r, uint64_t *length) {
+    uint32_t frame[2], trailer;
+    if (r->end == r->start) return 0;
+    rewind_copy_out(r, r->end - sizeof(trailer), &trailer, sizeof(trailer));
+    rewind_copy_out(r, r->end - trailer, frame, sizeof(frame));
+    r->read = r->end - trailer + sizeof(frame);
+    if (length) *length = trailer - sizeof(frame) - sizeof(trailer);
+    return frame[1];
+}
+
+// Copy n bytes at offset from the payload of the newest record
+static inline void rewind_read(const RewindBuffer *r, uint64_t offset, void *data, uint64_t n) {
+    rewind_copy_out(r, r->read + offset, data, n);
+}
+
+// Remove the newest record once it has been undone
+static inline void rewind_pop(RewindBuffer *r) {
+    uint32_t frame[2], trailer;
+    rewind_copy_out(r, r->end - sizeof(trailer), &trailer, sizeof(trailer));
+    rewind_copy_out(r, r->end - trailer, frame, sizeof(frame));
+    r->end -= trailer;
+    if (frame[1] == REWIND_TICK) r->ticks--;
+}
+
+// Bytes the records take up
+static inline uint64_t rewind_used(const RewindBuffer *r) {
+    return r->end - r->start;
+}
+
+#endif
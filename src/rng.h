@@ -0,0 +1,31 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// Seedable per-game random number generator (splitmix64).
+//
+// The whole state is one 64-bit word, so a game's randomness is fully
+// determined by its seed and can be saved alongside the rest of its state.
+
+typedef struct {
+    uint64_t state;
+} Rng;
+
+static inline void rng_seed(Rng *rng, uint64_t seed) {
+    rng->state = seed;
+}
+
+static inline uint64_t rng_next(Rng *rng) {
+    uint64_t z = (rng->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform value in [0, bound) without a division
+static inline uint32_t rng_below(Rng *rng, uint32_t bound) {
+    return (uint32_t)(((rng_next(rng) >> 32) * bound) >> 32);
+}
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "rng.h"
+#include "scores.h"
+
+// Leaderboard tool: prints the top scores kept on the storage volume (see
+// scores.h), or with --bench records N random games in batches and times
+// the appends, loading the log and the top-10 query. Point ATAR_STORAGE
+// at a scratch directory to benchmark without touching the real scores.
+//
+//   cc -O2 -o atar_scores src/scores.c
+//   ATAR_STORAGE=/tmp/scores ./atar_scores --bench 1000000
+
+#define BENCH_BATCH 1024         // Records per append, each one msync()ed
+#define BENCH_QUERIES 1000000
+
+static const char *bench_games[] = {"snake", "cross", "xox2p"};
+
+// Print the board of one game
+void print_board(Scores *s, ScoreBoard *b) {
+    ScoreEntry top[SCORES_TOP];
+    int count = scores_top(s, b->game, top, SCORES_TOP);
+    printf("%.8s: %ld games\n", b->game, b->games);
+    for (int i = 0; i < count; i++) {
+        char when[32];
+        time_t t = top[i].time;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&t));
+        printf("  %2d. %8lld   %s\n", i + 1, (long long)top[i].score, when);
+    }
+}
+
+int run_bench(long count, uint64_t seed) {
+    Scores s;
+    Rng rng;
+    ScoreRecord *batch = calloc(BENCH_BATCH, sizeof(ScoreRecord));
+    int games = sizeof(bench_games) / sizeof(bench_games[0]);
+
+    if (!batch || scores_open(&s) < 0) {
+        fprintf(stderr, "Cannot open the scores in %s\n", storage_dir());
+        free(batch);
+        return 1;
+    }
+    rng_seed(&rng, seed);
+
+    // Append in batches, compacting every SCORES_COMPACT_AT records
+    uint64_t start = bench_now_ns();
+    for (long done = 0; done < count;) {
+        int n = count - done < BENCH_BATCH ? count - done : BENCH_BATCH;
+        for (int i = 0; i < n; i++) {
+            memset(&batch[i], 0, sizeof(ScoreRecord));
+            batch[i].type = SCORE_GAME;
+            strcpy(batch[i].game, bench_games[rng_below(&rng, games)]);
+            batch[i].score = rng_below(&rng, 1000000);
+            batch[i].time = time(NULL);
+        }
+        if (scores_append(&s, batch, n) < 0) {
+            fprintf(stderr, "Append failed after %ld records\n", done);
+            break;
+        }
+        done += n;
+    }
+    uint64_t append_ns = bench_now_ns() - start;
+    long total = 0;
+    for (int g = 0; g < s.board_count; g++) total += s.boards[g].games;
+    scores_close(&s);
+
+    // A fresh reader, as the menu is at startup
+    start = bench_now_ns();
+    scores_open(&s);
+    uint64_t open_ns = bench_now_ns() - start;
+
+    ScoreEntry top[SCORES_TOP];
+    int64_t sum = 0;
+    start = bench_now_ns();
+    for (long i = 0; i < BENCH_QUERIES; i++) {
+        int n = scores_top(&s, bench_games[i % games], top, SCORES_TOP);
+        sum += n ? top[0].score : 0;
+    }
+    uint64_t query_ns = bench_now_ns() - start;
+
+    printf("scores: %ld records appended at %.0f/s in batches of %d, %ld games recorded in all\n",
+           count, count / (append_ns / 1e9), BENCH_BATCH, total);
+    printf("scores: open %.1f us with %ld records in the log, top-%d query %.0f ns (best %lld)\n",
+           open_ns / 1e3, s.records, SCORES_TOP, (double)query_ns / BENCH_QUERIES,
+           (long long)(sum / BENCH_QUERIES));
+    scores_close(&s);
+    free(batch);
+    return 0;
+}
+
+// Print the command-line help
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [GAME]\n"
+                    "       %s --bench N [--seed N]\n"
+                    "Shows the top scores kept in %s (or $%s), or records N random\n"
+                    "games there and times it.\n",
+            program, program, STORAGE_DEFAULT, STORAGE_ENV);
+}
+
+int main(int argc, char *argv[]) {
+    const char *game = NULL;
+    long bench = 0;
+    uint64_t seed = time(NULL);
+    Scores s;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && !game) {
+            game = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (bench > 0) return run_bench(bench, seed);
+
+    if (scores_open(&s) < 0) {
+        fprintf(stderr, "No scores in %s\n", storage_dir());
+        return 1;
+    }
+    for (int i = 0; i < s.board_count; i++) {
+        if (!game || strncmp(game, s.boards[i].game, sizeof(s.boards[i].game)) == 0) {
+            print_board(&s, &s.boards[i]);
+        }
+    }
+    scores_close(&s);
+    return 0;
+}
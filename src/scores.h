@@ -0,0 +1,361 @@
+#ifndef SCORES_H
+#define SCORES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "storage.h"
+#include "replay.h"
+
+// Leaderboard kept in the storage directory (see storage.h).
+//
+// SCORES_FILE is an append-only log of fixed-size records, each with its
+// own checksum, so a record torn by a crash or a power cut is recognised
+// and simply written over by the next append. The file grows in chunks of
+// SCORES_GROW records that are allocated and synced before use, and
+// records are written through a shared mapping and synced with msync()
+// before scores_add() returns. Writers from several processes take turns
+// with a lock on SCORES_LOCK.
+//
+// Readers map the log and fold each record into a per-game min-heap of
+// the SCORES_TOP best scores, picking up appends incrementally. Once the
+// log reaches SCORES_COMPACT_AT records it is rewritten with only those
+// scores plus a tally of the games dropped, and atomically renamed into
+// place; readers notice the new file and load it again.
+
+#define SCORES_FILE "scores.log"
+#define SCORES_LOCK "scores.lock"
+#define SCORES_VERSION 1
+#define SCORES_TOP 10              // Scores kept per game
+#define SCORES_MAX_GAMES 32
+#define SCORES_GROW 4096           // Records added to the file at a time
+#define SCORES_COMPACT_AT 65536    // Records in the log before it is compacted
+
+#define SCORE_GAME  1              // A finished game and its score
+#define SCORE_TALLY 2              // Games folded away by compaction, in score
+
+typedef struct {
+    char magic[4];                 // "ATSC"
+    uint16_t version;
+    uint16_t record_size;
+    uint64_t reserved[3];
+} ScoresHeader;
+
+typedef struct {
+    uint32_t checksum;             // Of the rest of the record, 0 in unused space
+    uint16_t type;
+    uint16_t reserved;
+    char game[8];                  // Game name, NUL padded
+    int64_t score;
+    int64_t time;                  // Unix time the game ended
+} ScoreRecord;
+
+typedef struct {
+    int64_t score;
+    int64_t time;
+} ScoreEntry;
+
+typedef struct {
+    char game[8];
+    long games;                    // Games recorded, compacted ones included
+    int count;
+    ScoreEntry top[SCORES_TOP];    // Min-heap on score, top[0] is the lowest kept
+} ScoreBoard;
+
+typedef struct {
+    int fd, lock_fd;               // -1 if unavailable
+    int writable;
+    const uint8_t *map;            // The whole log
+    size_t map_size;
+    size_t end;                    // Offset past the last valid record
+    ino_t inode;                   // Compaction replaces the file
+    long records;                  // Valid records in the log
+    ScoreBoard boards[SCORES_MAX_GAMES];
+    int board_count;
+} Scores;
+
+static inline uint32_t scores_checksum(const ScoreRecord *r) {
+    uint64_t hash = replay_hash(REPLAY_HASH_INIT, (const char *)r + sizeof(r->checksum),
+                                sizeof(*r) - sizeof(r->checksum));
+    uint32_t sum = (uint32_t)(hash ^ (hash >> 32));
+    return sum ? sum : 1;
+}
+
+// Board of a game, added if create is set; NULL if not found or full
+static inline ScoreBoard *scores_board(Scores *s, const char *game, int create) {
+    for (int i = 0; i < s->board_count; i++) {
+        if (strncmp(s->boards[i].game, game, sizeof(s->boards[i].game)) == 0) return &s->boards[i];
+    }
+    if (!create || s->board_count == SCORES_MAX_GAMES) return NULL;
+    ScoreBoard *b = &s->boards[s->board_count++];
+    memset(b, 0, sizeof(*b));
+    memcpy(b->game, game, strnlen(game, sizeof(b->game)));
+    return b;
+}
+
+static inline void scores_heap_down(ScoreBoard *b, int i) {
+    for (;;) {
+        int low = i, left = 2 * i + 1, right = left + 1;
+        if (left < b->count && b->top[left].score < b->top[low].score) low = left;
+        if (right < b->count && b->top[right].score < b->top[low].score) low = right;
+        if (low == i) return;
+        ScoreEntry t = b->top[i];
+        b->top[i] = b->top[low];
+        b->top[low] = t;
+        i = low;
+    }
+}
+
+// Keep the entry if it is among the best SCORES_TOP
+static inline void scores_heap_add(ScoreBoard *b, ScoreEntry e) {
+    if (b->count < SCORES_TOP) {
+        int i = b->count++;
+        while (i > 0 && b->top[(i - 1) / 2].score > e.score) {
+            b->top[i] = b->top[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        b->top[i] = e;
+    } else if (e.score > b->top[0].score) {
+        b->top[0] = e;
+        scores_heap_down(b, 0);
+    }
+}
+
+// Fold the valid records after end into the boards
+static inline void scores_scan(Scores *s) {
+    while (s->end + sizeof(ScoreRecord) <= s->map_size) {
+        const ScoreRecord *r = (const ScoreRecord *)(s->map + s->end);
+        if (r->checksum == 0 || r->checksum != scores_checksum(r)) break;
+        ScoreBoard *b = scores_board(s, r->game, 1);
+        if (b && r->type == SCORE_GAME) {
+            b->games++;
+            scores_heap_add(b, (ScoreEntry){r->score, r->time});
+        } else if (b && r->type == SCORE_TALLY) {
+            b->games += r->score;
+        }
+        s->end += sizeof(ScoreRecord);
+        s->records++;
+    }
+}
+
+// Map the log again if its size changed, returns -1 if it isn't a log
+static inline int scores_map(Scores *s) {
+    struct stat st;
+    if (fstat(s->fd, &st) < 0) return -1;
+    if (s->map && (size_t)st.st_size == s->map_size) return 0;
+    if (s->map) munmap((void *)s->map, s->map_size);
+    s->map = NULL;
+    s->map_size = 0;
+    if ((size_t)st.st_size < sizeof(ScoresHeader)) return -1;
+    void *map = mmap(NULL, st.st_size, s->writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                     s->fd, 0);
+    if (map == MAP_FAILED) return -1;
+    const ScoresHeader *header = map;
+    if (memcmp(header->magic, "ATSC", 4) != 0 || header->version != SCORES_VERSION ||
+        header->record_size != sizeof(ScoreRecord)) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    s->map = map;
+    s->map_size = st.st_size;
+    s->inode = st.st_ino;
+    if (s->end < sizeof(ScoresHeader)) s->end = sizeof(ScoresHeader);
+    return 0;
+}
+
+// Open the log from scratch and load every record
+static inline int scores_load(Scores *s, const char *path) {
+    if (s->map) munmap((void *)s->map, s->map_size);
+    if (s->fd >= 0) close(s->fd);
+    s->map = NULL;
+    s->map_size = s->end = 0;
+    s->records = 0;
+    s->board_count = 0;
+    s->writable = 1;
+    s->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (s->fd < 0) {
+        s->writable = 0;
+        s->fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (s->fd < 0 || scores_map(s) < 0) return -1;
+    scores_scan(s);
+    return 0;
+}
+
+// Start a new log with its first chunk allocated
+static inline int scores_create(const char *path) {
+    ScoresHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "ATSC", 4);
+    header.version = SCORES_VERSION;
+    header.record_size = sizeof(ScoreRecord);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    struct stat st;
+    int ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size == 0) {
+        // An empty file lost the race to nobody or was cut short at birth
+        ok = pwrite(fd, &header, sizeof(header), 0) == sizeof(header) &&
+             posix_fallocate(fd, 0, sizeof(header) + SCORES_GROW * sizeof(ScoreRecord)) == 0 &&
+             fsync(fd) == 0;
+        storage_sync_dir();
+    }
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+// Load the leaderboard, returns -1 (and works as an empty, read-only one)
+// if there is no storage
+static inline int scores_open(Scores *s) {
+    char path[STORAGE_PATH_MAX], lock[STORAGE_PATH_MAX];
+    memset(s, 0, sizeof(*s));
+    s->fd = s->lock_fd = -1;
+    if (storage_path(path, sizeof(path), SCORES_FILE) < 0 ||
+        storage_path(lock, sizeof(lock), SCORES_LOCK) < 0) {
+        return -1;
+    }
+    s->lock_fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (access(path, F_OK) != 0 && s->lock_fd >= 0) {
+        flock(s->lock_fd, LOCK_EX);
+        scores_create(path);
+        flock(s->lock_fd, LOCK_UN);
+    }
+    return scores_load(s, path);
+}
+
+// Pick up records appended since the last look, and a compacted log
+static inline void scores_refresh(Scores *s) {
+    char path[STORAGE_PATH_MAX];
+    struct stat st;
+    if (s->fd < 0 || storage_path(path, sizeof(path), SCORES_FILE) < 0) return;
+    if (stat(path, &st) == 0 && st.st_ino != s->inode) {
+        scores_load(s, path);
+    } else if (scores_map(s) == 0) {
+        scores_scan(s);
+    }
+}
+
+// Best scores of a game, highest first; returns how many were filled in
+static inline int scores_top(Scores *s, const char *game, ScoreEntry *out, int max) {
+    ScoreBoard *b = scores_board(s, game, 0);
+    int n = 0;
+    if (!b) return 0;
+    for (int i = 0; i < b->count; i++) {
+        ScoreEntry e = b->top[i];
+        int j = n < max ? n++ : n;
+        while (j > 0 && (out[j - 1].score < e.score ||
+                         (out[j - 1].score == e.score && out[j - 1].time > e.time))) {
+            if (j < max) out[j] = out[j - 1];
+            j--;
+        }
+        if (j < max) out[j] = e;
+    }
+    return n;
+}
+
+// Rewrite the log with only what the boards hold. Called with the lock.
+static inline int scores_compact(Scores *s) {
+    char path[STORAGE_PATH_MAX];
+    ScoresHeader header;
+    ScoreRecord *records = malloc(SCORES_MAX_GAMES * (SCORES_TOP + 1) * sizeof(ScoreRecord));
+    int count = 0;
+    if (!records || storage_path(path, sizeof(path), SCORES_FILE) < 0) {
+        free(records);
+        return -1;
+    }
+    memcpy(&header, s->map, sizeof(header));
+    for (int i = 0; i < s->board_count; i++) {
+        ScoreBoard *b = &s->boards[i];
+        ScoreRecord r;
+        memset(&r, 0, sizeof(r));
+        memcpy(r.game, b->game, sizeof(r.game));
+        if (b->games > b->count) {
+            r.type = SCORE_TALLY;
+            r.score = b->games - b->count;
+            r.checksum = scores_checksum(&r);
+            records[count++] = r;
+        }
+        for (int j = 0; j < b->count; j++) {
+            r.type = SCORE_GAME;
+            r.score = b->top[j].score;
+            r.time = b->top[j].time;
+            r.checksum = scores_checksum(&r);
+            records[count++] = r;
+        }
+    }
+    struct iovec parts[2] = {{&header, sizeof(header)}, {records, count * sizeof(ScoreRecord)}};
+    int status = storage_replace(SCORES_FILE, parts, 2);
+    free(records);
+    if (status == 0) status = scores_load(s, path);
+    return status;
+}
+
+// Append finished games and make them durable, returns -1 on failure
+static inline int scores_append(Scores *s, ScoreRecord *records, int count) {
+    if (s->fd < 0 || s->lock_fd < 0 || !s->writable) return -1;
+    for (int i = 0; i < count; i++) {
+        records[i].checksum = scores_checksum(&records[i]);
+    }
+    flock(s->lock_fd, LOCK_EX);
+    scores_refresh(s); // Others may have appended or compacted meanwhile
+    int status = -1;
+    size_t bytes = count * sizeof(ScoreRecord);
+    if (s->map && s->end + bytes > s->map_size) {
+        // Allocate and sync the room first, so the size survives a crash
+        size_t chunk = SCORES_GROW * sizeof(ScoreRecord);
+        size_t size = s->map_size + (s->end + bytes - s->map_size + chunk - 1) / chunk * chunk;
+        if (posix_fallocate(s->fd, 0, size) != 0 || fsync(s->fd) != 0 || scores_map(s) < 0) {
+            s->end = s->map && s->end > s->map_size ? s->map_size : s->end;
+            flock(s->lock_fd, LOCK_UN);
+            return -1;
+        }
+    }
+    if (s->map) {
+        uint8_t *at = (uint8_t *)s->map + s->end;
+        memcpy(at, records, bytes);
+        size_t page = sysconf(_SC_PAGESIZE);
+        uint8_t *start = (uint8_t *)((uintptr_t)at & ~(uintptr_t)(page - 1));
+        status = msync(start, at + bytes - start, MS_SYNC);
+        scores_scan(s);
+        if (s->records >= SCORES_COMPACT_AT) scores_compact(s);
+    }
+    flock(s->lock_fd, LOCK_UN);
+    return status;
+}
+
+static inline int scores_add(Scores *s, const char *game, int64_t score) {
+    ScoreRecord r;
+    memset(&r, 0, sizeof(r));
+    r.type = SCORE_GAME;
+    memcpy(r.game, game, strnlen(game, sizeof(r.game)));
+    r.score = score;
+    r.time = time(NULL);
+    return scores_append(s, &r, 1);
+}
+
+static inline void scores_close(Scores *s) {
+    if (s->map) munmap((void *)s->map, s->map_size);
+    if (s->fd >= 0) close(s->fd);
+    if (s->lock_fd >= 0) close(s->lock_fd);
+    s->map = NULL;
+    s->fd = s->lock_fd = -1;
+}
+
+// Record one finished game, for games that don't keep the board open
+static inline int scores_record(const char *game, int64_t score) {
+    Scores s;
+    int status = -1;
+    if (scores_open(&s) == 0) status = scores_add(&s, game, score);
+    scores_close(&s);
+    return status;
+}
+
+#endif
@@ -1,222 +1,1538 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <termios.h>
-#include <signal.h>
 #include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "render.h"
+#include "rng.h"
+#include "replay.h"
+#include "loop.h"
+#include "plugin.h"
+#include "rewind.h"
+#ifndef ATAR_PLUGIN
+#include "battle.h"
+#include "bench.h" // Allocation counting, standalone binary only
+#include "render_thread.h"
+#include "scores.h"
+#include "snapshot.h"
+#include "telemetry.h"
+#endif
 
 // Game configuration
-#define GRID_SIZE 15
+#define DEFAULT_GRID_SIZE 15
+#define MIN_GRID_SIZE 3
+#define MAX_GRID_SIZE 16384
 #define EMPTY_CELL '.'
 #define SNAKE_HEAD 'O'
 #define SNAKE_BODY '#'
 #define BAIT 'X'
+#define TICK_NS 100000000ull // 100 ms per tick for playable snake speed
+#define TURN_QUEUE_SIZE 8     // Turns buffered for the following ticks
+#define SNAPSHOT_NAME "snake" // Save state on the storage volume, see snapshot.h
+#define SNAPSHOT_STATE 2      // Bump whenever Snake or the arena layout changes
+#define REWIND_SECONDS 30     // How far back 'r' can go
+#define REWIND_TICKS (REWIND_SECONDS * 1000000000ull / TICK_NS)
+#define REWIND_STEP (1000000000ull / TICK_NS) // Ticks undone per 'r', one second
+#define REWIND_BYTES (64 << 10) // History budget, SnakeStep records of REWIND_TICKS fit
+#define BATTLE_GRID_SIZE 256  // Arena side in battle mode without --size
+#define BATTLE_CELLS_PER_SNAKE 16 // Fewest arena cells per snake in battle mode
+#define BATTLE_HEAD_OTHER '@'
+#define BATTLE_BODY_OTHER '+'
+#define BATTLE_SCORES_NAME "battle" // Leaderboard of the longest battle snakes
+
+// Cells are numbered row * grid_cols + column
+#define CELL(x, y) ((x) * s->grid_cols + (y))
+
+// Body directions, packed two bits per segment in the body ring
+#define DIR_UP    0
+#define DIR_LEFT  1
+#define DIR_DOWN  2
+#define DIR_RIGHT 3
+
+// Complete game state. Everything the simulation needs lives here and is
+// passed explicitly, so the same code runs as the standalone binary and as
+// a plugin whose state the menu owns and keeps across hot reloads. All
+// arena-sized storage is bit-packed and allocated once in init_game():
+// 1 bit per cell of occupancy, 2 bits per cell of body ring and 32 bits per
+// 64 cells of free-cell counts. A resumed game's arena arrays are instead
+// pages of its snapshot, mapped copy-on-write (see snapshot.h).
+typedef struct {
+    int grid_rows, grid_cols;     // Arena size, chosen at startup
+    int grid_cells;
+    uint64_t *occupied;           // One bit per cell covered by the snake
+    int occupied_words;           // Number of words in occupied
+    uint8_t *body_dirs;           // Ring of 2-bit moves from each segment to the next, tail to head
+    int ring_tail, ring_head;     // Ring indices of the oldest move and the next free slot
+    int tail_cell, head_cell;     // Cells of the tail and head segments
+    int snake_length;             // Length of the snake
+    uint32_t *free_tree;          // Fenwick tree of free cells per occupancy word
+    int free_tree_step;           // Highest power of two <= occupied_words
+    int free_count;               // Number of cells not covered by the snake
+    uint8_t *snapshot;            // Mapping the arena arrays live in after a resume, or NULL
+    size_t snapshot_size;
+    int bait_x, bait_y;           // Coordinates of the bait, -1 once the board is full
+    int cleared;                  // Set when the snake covers the whole board
+    char direction;               // Direction of the coming step
+    char last_move;               // Direction of the last step, turns are checked against it
+    int turn_pending;             // A turn was already taken for the coming tick
+    char turn_queue[TURN_QUEUE_SIZE]; // Turns typed faster than the snake moves
+    int queue_start, queue_len;
+    int score;                    // Player's score
+    int paused;                   // Pause state flag
+    Rng rng;                      // Bait placement and scripted input
+    uint64_t ticks;               // Ticks stepped so far
+    RewindBuffer *history;        // Steps to undo with the rewind key, NULL when off
+    int view_rows, view_cols;     // Visible window of the arena, scrolled to follow the head
+    int view_top, view_left;
+
+    // Autopilot, see autopilot_key(). Buffers are allocated for the arena
+    // by autopilot_init() so deciding a move never touches the heap.
+    int autopilot;                // The autopilot is steering
+    int32_t *cycle_order;         // Position of each cell on the Hamiltonian cycle, -1 off it
+    int32_t *cycle_cells;         // Cell at each position of the cycle
+    int cycle_length;             // grid_cells, one less when both sides are odd
+    int hole, partner;            // Cell left off the cycle and the one it can trade places with
+    int32_t *search_queue;        // Breadth-first search frontier
+    uint32_t *search_seen;        // Search that last reached each cell
+    uint32_t search_stamp;
+    uint8_t *search_from;         // Direction each cell was reached by
+    int32_t *path;                // Cells from the head to the bait, path[path_pos] is the head
+    int path_len, path_pos, path_bait;
+} Snake;
 
-// Global game state
-char grid[GRID_SIZE][GRID_SIZE];
-int *snake_x, *snake_y;   // Dynamic arrays to track the snake's body positions
-int snake_length;         // Length of the snake
-int bait_x, bait_y;       // Coordinates of the bait
-char direction = 'd';     // Initial direction: right
-int score = 0;            // Player's score
+// History record of one step: the state the step started from. The arena
+// itself is not copied; the head and tail cells are enough to undo the
+// cells the step occupied and vacated, so a record has the same size on
+// every arena.
+typedef struct {
+    int32_t head_cell, tail_cell;
+    int32_t ring_head, ring_tail;
+    int32_t bait_x, bait_y;
+    int32_t score, snake_length;
+    uint64_t rng;                 // Before the bait was placed
+    uint8_t head_move;            // Ring entry the step's move overwrote
+    uint8_t paused, cleared, turn_pending;
+    char direction, last_move;
+    uint8_t queue_start, queue_len;
+    char turn_queue[TURN_QUEUE_SIZE];
+} SnakeStep;
+
+// Function declarations
+int parse_grid_size(const char *text, int *rows, int *cols);
+void fit_view(Snake *s, int term_rows, int term_cols);
+int init_game(Snake *s);
+void free_game(Snake *s);
+void reset_game(Snake *s);
+void build_free_tree(Snake *s);
+void spawn_bait(Snake *s);
+void follow_head(Snake *s);
+void draw_grid(Snake *s, Renderer *screen);
+int move_snake(Snake *s);
+int check_collision(Snake *s, int x, int y);
+int apply_turn(Snake *s, char input);
+void handle_key(Snake *s, char input);
+void end_turn(Snake *s);
+void step_game(Snake *s);
+int step_back(Snake *s);
+uint64_t state_hash(Snake *s);
+int autopilot_init(Snake *s);
+char autopilot_key(Snake *s);
+
+#ifndef ATAR_PLUGIN
+
+Snake game = {.grid_rows = DEFAULT_GRID_SIZE, .grid_cols = DEFAULT_GRID_SIZE};
 int running = 1;          // Game running state
-int paused = 0;           // Pause state flag
+ReplayWriter recorder = {.fd = -1}; // Session recording, open with --record
 
 // Terminal settings
 struct termios orig_termios;
+Renderer screen;          // Double-buffered output shared with the other games
+RenderThread presenter;   // Writes the frames out so a slow terminal can't stall ticks
+GameLoop loop;            // Fixed-timestep pacing and frame telemetry
+Telemetry telemetry;      // Live counters for the menu and atar_stats
+RewindBuffer history;     // Last REWIND_SECONDS of steps, for the 'r' key
+Scores scores;            // Leaderboard, loaded before the first frame so ending a game only appends
+int have_scores;
 
-// Function declarations
-void init_game();
-void spawn_bait();
-void update_snake();
-void draw_grid();
-int move_snake();
-int check_collision(int x, int y);
+void usage(const char *program);
+void apply_key(Snake *s, char input);
+void autopilot_turn(Snake *s);
+char random_key(Snake *s);
+void run_headless(Snake *s, long count, const char *keys);
+int run_replay(const char *path);
+int save_game(Snake *s, const char *name);
+int resume_game(Snake *s, const char *name);
+int valid_saved_game(const Snake *saved, const uint64_t *occupied, const uint8_t *body_dirs);
+void time_snapshot(Snake *s);
+void time_rewind(Snake *s);
+void run_battle_headless(int rows, int cols, int count, long ticks, uint64_t seed);
+int play_battle(int rows, int cols, int count, uint64_t seed);
 void reset_terminal();
-void handle_signal(int sig);
 void setup_terminal();
-int kbhit();
-char getch();
 
-int main() {
-    // Prepare the terminal for real-time input
-    setup_terminal();
-    signal(SIGINT, handle_signal);  // Ensure Ctrl+C exits gracefully
-    signal(SIGTERM, handle_signal); // Handle termination signals cleanly
+int main(int argc, char *argv[]) {
+    // Arena size comes from --size ("40" or "1000x4000") or SNAKE_GRID
+    const char *size = getenv("SNAKE_GRID");
+    long headless_ticks = 0;
+    const char *keys = NULL;
+    const char *record_path = NULL;
+    uint64_t seed = time(NULL);
+    int fresh = 0, time_snapshots = 0, time_rewinds = 0, battle = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            size = argv[++i];
+        } else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            headless_ticks = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+            keys = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--autopilot") == 0) {
+            game.autopilot = 1;
+        } else if (strcmp(argv[i], "--new") == 0) {
+            fresh = 1;
+        } else if (strcmp(argv[i], "--snapshot") == 0) {
+            time_snapshots = 1;
+        } else if (strcmp(argv[i], "--rewind") == 0) {
+            time_rewinds = 1;
+        } else if (strcmp(argv[i], "--battle") == 0 && i + 1 < argc) {
+            battle = atoi(argv[++i]);
+            if (battle < 2 || battle > BATTLE_MAX_SNAKES) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            return run_replay(argv[i + 1]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (size && !parse_grid_size(size, &game.grid_rows, &game.grid_cols)) {
+        usage(argv[0]);
+        return 1;
+    }
+    rng_seed(&game.rng, seed);
+
+    // Battle mode is a game of its own, with none of the single game's
+    // saving, recording, rewinding or autopilot
+    if (battle) {
+        if (!size) game.grid_rows = game.grid_cols = BATTLE_GRID_SIZE;
+        if (keys || record_path || game.autopilot || time_snapshots || time_rewinds ||
+            (long)battle * BATTLE_CELLS_PER_SNAKE > (long)game.grid_rows * game.grid_cols) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (headless_ticks > 0) {
+            run_battle_headless(game.grid_rows, game.grid_cols, battle, headless_ticks, seed);
+            return 0;
+        }
+        return play_battle(game.grid_rows, game.grid_cols, battle, seed);
+    }
+
+    // Pick up the game saved when it was last quit, unless starting over.
+    // A recording has to start from the seed, so it always starts over, and
+    // an arena size asked for explicitly starts over unless it matches.
+    Snake saved = {0};
+    int resumed = !fresh && !headless_ticks && !record_path && resume_game(&saved, SNAPSHOT_NAME);
+    if (resumed && size && (saved.grid_rows != game.grid_rows || saved.grid_cols != game.grid_cols)) {
+        fprintf(stderr, "Starting a new %dx%d game; quitting it replaces the saved %dx%d one\n",
+                game.grid_rows, game.grid_cols, saved.grid_rows, saved.grid_cols);
+        free_game(&saved);
+        resumed = 0;
+    }
+    if (resumed) {
+        int autopilot = game.autopilot;
+        game = saved;
+        game.autopilot |= autopilot;
+    }
 
     // Initialize game state
-    init_game();
+    if ((!resumed && !init_game(&game)) || (game.autopilot && !autopilot_init(&game))) {
+        fprintf(stderr, "Not enough memory for a %dx%d arena\n", game.grid_rows, game.grid_cols);
+        return 1;
+    }
 
-    // Main game loop
-    while (running) {
-        draw_grid(); // Display the game grid
-
-        // Check for player input to change direction
-        if (kbhit()) {
-            char input = getch();
-            if (input == 'q') {  // Exit game on 'q'
-                running = 0;
-                break;
-            }
-            // Update direction if it doesn't reverse the snake
-            if ((input == 'w' && direction != 's') ||
-                (input == 'a' && direction != 'd') ||
-                (input == 's' && direction != 'w') ||
-                (input == 'd' && direction != 'a')) {
-                direction = input;
-                paused = 0; // Resume if paused
-            }
+    // Run the simulation alone, without a terminal or any pacing
+    if (headless_ticks > 0) {
+        run_headless(&game, headless_ticks, keys);
+        if (time_snapshots) time_snapshot(&game);
+        if (time_rewinds) time_rewind(&game);
+        free_game(&game);
+        return 0;
+    }
 
-            // Clear the input buffer after processing the key
-            tcflush(STDIN_FILENO, TCIFLUSH);
+    struct winsize ws;
+    int term_rows = 24, term_cols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        term_rows = ws.ws_row;
+        term_cols = ws.ws_col;
+    }
+    fit_view(&game, term_rows, term_cols);
+
+    if (record_path) {
+        uint32_t params[REPLAY_PARAMS] = {game.grid_rows, game.grid_cols};
+        if (replay_create(&recorder, record_path, "snake", seed, params) < 0) {
+            perror("Failed to create the replay file");
+            return 1;
         }
+    }
 
-        // Only move the snake if not paused
-        if (!paused) {
-            if (!move_snake()) {
-                paused = 1; // Pause if a collision occurs
-            }
+    if (rewind_init(&history, REWIND_BYTES, REWIND_TICKS) < 0) {
+        fprintf(stderr, "Not enough memory for the rewind history\n");
+        return 1;
+    }
+    game.history = &history;
+
+    // Prepare the terminal for real-time input
+    setup_terminal();
+
+    // Frame is the viewport plus three status lines
+    int screen_width = game.view_cols * 2 > 52 ? game.view_cols * 2 : 52;
+    if (render_init(&screen, screen_width, game.view_rows + 3) < 0) {
+        reset_terminal();
+        fprintf(stderr, "Failed to allocate the screen buffers\n");
+        return 1;
+    }
+
+    // Ctrl+C and friends arrive through the loop instead of a signal handler
+    if (loop_init(&loop, TICK_NS) < 0) {
+        reset_terminal();
+        fprintf(stderr, "Failed to set up the game timer\n");
+        return 1;
+    }
+    render_thread_start(&presenter, &screen); // Presented inline if it fails
+    telemetry_open(&telemetry, "snake", TICK_NS); // Played without if it fails
+    have_scores = scores_open(&scores) == 0; // Quietly skipped without storage
+
+    // Main game loop: apply keys as they arrive, simulate every tick that
+    // is due, then hand the frame to the render thread
+    // A crash only pauses the game and a rewind takes score back, so the
+    // best score of the run goes on the leaderboard once, when it ends
+    int signaled = 0, start_score = game.score, best = game.score;
+    draw_grid(&game, &screen);
+    render_thread_publish(&presenter, &screen); // Only the changed cells reach the terminal
+    while (running) {
+        LoopEvents events;
+        if (loop_wait(&loop, &events) < 0) break;
+        if (events.signal) {
+            signaled = 1;
+            break;
+        }
+        if (events.resumed) {
+            render_thread_invalidate(&presenter, &screen); // The menu drew over us while we were stopped
+        }
+        for (int i = 0; i < events.keys && running; i++) {
+            apply_key(&game, events.key[i]);
+        }
+        for (int i = 0; i < events.ticks && running; i++) {
+            if (game.autopilot && !game.paused) autopilot_turn(&game);
+            step_game(&game);
+        }
+        if (game.score > best) best = game.score;
+        if (!running) {
+            break;
         }
 
-        usleep(100000); // Slow down the loop for playable snake speed
+        // Nothing moves while paused or after a win, so sleep until a key
+        if (game.paused || game.cleared) {
+            loop_pause(&loop);
+        } else {
+            loop_resume(&loop);
+        }
+        draw_grid(&game, &screen); // Display the game grid
+        render_thread_publish(&presenter, &screen);
+        uint64_t frame_ns = loop_frame_done(&loop);
+        telemetry_frame(&telemetry, &loop, render_thread_stats(&presenter, &screen), events.keys,
+                        game.score, frame_ns);
     }
 
     // Clean up resources and restore terminal
+    replay_finish(&recorder, game.ticks, state_hash(&game));
     reset_terminal();
-    free(snake_x);
-    free(snake_y);
+    loop_close(&loop);
+    if (have_scores && best > start_score) scores_add(&scores, "snake", best);
+    scores_close(&scores);
+
+    // A won game is over, anything else carries on next time
+    if (game.cleared) {
+        snapshot_remove(SNAPSHOT_NAME);
+    } else {
+        save_game(&game, SNAPSHOT_NAME);
+    }
+    if (signaled) {
+        printf("\nGame over! Final score: %d\n", game.score);
+    }
+    free_game(&game);
+    rewind_free(&history);
     return 0;
 }
 
-// Set up the initial game state
-void init_game() {
-    // Clear the grid
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            grid[i][j] = EMPTY_CELL;
+// Print the command-line help
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--size SIZE|ROWSxCOLS] [--seed N] [--record FILE] [--autopilot] [--new]\n"
+                    "       %s [--size SIZE|ROWSxCOLS] --headless TICKS [--keys KEYS|--autopilot] [--seed N]\n"
+                    "                 [--snapshot] [--rewind]\n"
+                    "       %s [--size SIZE|ROWSxCOLS] --battle SNAKES [--headless TICKS] [--seed N]\n"
+                    "       %s --replay FILE\n"
+                    "Arena sides must be between %d and %d. Press 'p' in the game to let the\n"
+                    "autopilot play; a direction key takes over again. 'r' steps back a second,\n"
+                    "up to %d seconds, and pauses.\n"
+                    "A game that is quit is saved in %s and resumed on the next start;\n"
+                    "--new starts over, and so does a --size other than the saved game's.\n"
+                    "--snapshot times saving and resuming the headless game, --rewind stepping\n"
+                    "it back.\n"
+                    "--battle plays against SNAKES - 1 others on one arena, %dx%d unless\n"
+                    "given, with at least %d cells per snake.\n",
+            program, program, program, program, MIN_GRID_SIZE, MAX_GRID_SIZE, REWIND_SECONDS,
+            STORAGE_DEFAULT, BATTLE_GRID_SIZE, BATTLE_GRID_SIZE, BATTLE_CELLS_PER_SNAKE);
+}
+
+#endif
+
+// Parse "N" or "ROWSxCOLS" into the arena size, returns 0 if out of range
+int parse_grid_size(const char *text, int *rows_out, int *cols_out) {
+    char *end;
+    long rows = strtol(text, &end, 10);
+    long cols = rows;
+    if (*end == 'x' || *end == 'X') {
+        cols = strtol(end + 1, &end, 10);
+    }
+    if (*end != '\0' || rows < MIN_GRID_SIZE || rows > MAX_GRID_SIZE ||
+        cols < MIN_GRID_SIZE || cols > MAX_GRID_SIZE) {
+        return 0;
+    }
+    *rows_out = rows;
+    *cols_out = cols;
+    return 1;
+}
+
+// Show as much of the arena as the terminal fits, two columns per cell
+void fit_view(Snake *s, int term_rows, int term_cols) {
+    s->view_rows = s->grid_rows < term_rows - 3 ? s->grid_rows : term_rows - 3;
+    s->view_cols = s->grid_cols < term_cols / 2 ? s->grid_cols : term_cols / 2;
+    if (s->view_rows < MIN_GRID_SIZE) s->view_rows = MIN_GRID_SIZE;
+    if (s->view_cols < MIN_GRID_SIZE) s->view_cols = MIN_GRID_SIZE;
+}
+
+// Occupancy bitmap helpers
+static inline int is_occupied(Snake *s, int cell) {
+    return (s->occupied[cell >> 6] >> (cell & 63)) & 1;
+}
+
+// Fenwick tree over per-word free counts: O(log words) update and select
+static inline void free_tree_add(Snake *s, int word, int delta) {
+    for (int i = word + 1; i <= s->occupied_words; i += i & -i) {
+        s->free_tree[i] += delta;
+    }
+}
+
+// Find the cell holding the k-th (0-based) free cell
+static inline int free_tree_select(Snake *s, int k) {
+    int word = 0;
+    for (int step = s->free_tree_step; step > 0; step >>= 1) {
+        if (word + step <= s->occupied_words && (int)s->free_tree[word + step] <= k) {
+            word += step;
+            k -= s->free_tree[word];
         }
     }
+    // Drop the k lowest free bits of the word, the next one is the answer
+    uint64_t free_bits = ~s->occupied[word];
+    while (k-- > 0) {
+        free_bits &= free_bits - 1;
+    }
+    return word * 64 + __builtin_ctzll(free_bits);
+}
 
-    // Initialize the snake in the middle of the grid
-    snake_length = 2;
-    snake_x = malloc(snake_length * sizeof(int));
-    snake_y = malloc(snake_length * sizeof(int));
-    snake_x[0] = GRID_SIZE / 2; // Head
-    snake_y[0] = GRID_SIZE / 2;
-    snake_x[1] = GRID_SIZE / 2; // Tail
-    snake_y[1] = GRID_SIZE / 2 - 1;
+// Mark a cell as covered by the snake
+static inline void occupy(Snake *s, int cell) {
+    s->occupied[cell >> 6] |= (uint64_t)1 << (cell & 63);
+    free_tree_add(s, cell >> 6, -1);
+    s->free_count--;
+}
 
-    // Place the snake on the grid
-    update_snake();
+// Mark a cell as no longer covered by the snake
+static inline void vacate(Snake *s, int cell) {
+    s->occupied[cell >> 6] &= ~((uint64_t)1 << (cell & 63));
+    free_tree_add(s, cell >> 6, 1);
+    s->free_count++;
+}
 
-    // Add the first bait
-    spawn_bait();
+// Body ring helpers, two bits per move
+static inline int ring_get(Snake *s, int index) {
+    return (s->body_dirs[index >> 2] >> ((index & 3) * 2)) & 3;
 }
 
-// Place a bait at a random empty position
-void spawn_bait() {
-    do {
-        bait_x = rand() % GRID_SIZE;
-        bait_y = rand() % GRID_SIZE;
-    } while (grid[bait_x][bait_y] != EMPTY_CELL); // Retry if spot is occupied
-    grid[bait_x][bait_y] = BAIT;
+static inline void ring_set(Snake *s, int index, int dir) {
+    int shift = (index & 3) * 2;
+    s->body_dirs[index >> 2] = (s->body_dirs[index >> 2] & ~(3 << shift)) | (dir << shift);
 }
 
-// Update the grid with the snake's current position
-void update_snake() {
-    // Reset the grid, but keep the bait
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            if (grid[i][j] != BAIT) {
-                grid[i][j] = EMPTY_CELL;
-            }
-        }
+static inline int ring_next(Snake *s, int index) {
+    return index + 1 == s->grid_cells ? 0 : index + 1;
+}
+
+// Cell reached by moving one step from cell in dir
+static inline int step_cell(Snake *s, int cell, int dir) {
+    switch (dir) {
+        case DIR_UP:   return cell - s->grid_cols;
+        case DIR_LEFT: return cell - 1;
+        case DIR_DOWN: return cell + s->grid_cols;
+        default:       return cell + 1;
     }
+}
 
-    // Add the snake to the grid
-    for (int i = 0; i < snake_length; i++) {
-        if (i == 0) {
-            grid[snake_x[i]][snake_y[i]] = SNAKE_HEAD;
-        } else {
-            grid[snake_x[i]][snake_y[i]] = SNAKE_BODY;
+// Allocate the arena and set up the initial game state, returns 0 on failure
+int init_game(Snake *s) {
+    s->grid_cells = s->grid_rows * s->grid_cols;
+    s->occupied_words = (s->grid_cells + 63) / 64;
+    s->occupied = calloc(s->occupied_words, sizeof(uint64_t));
+    s->body_dirs = calloc((s->grid_cells + 3) / 4, 1);
+    s->free_tree = calloc(s->occupied_words + 1, sizeof(uint32_t));
+    if (!s->occupied || !s->body_dirs || !s->free_tree) {
+        return 0;
+    }
+    for (s->free_tree_step = 1; s->free_tree_step * 2 <= s->occupied_words; s->free_tree_step *= 2);
+
+    reset_game(s);
+    return 1;
+}
+
+void free_game(Snake *s) {
+    if (s->snapshot) {
+        munmap(s->snapshot, s->snapshot_size);
+    } else {
+        free(s->occupied);
+        free(s->body_dirs);
+        free(s->free_tree);
+    }
+    free(s->cycle_order);
+    free(s->cycle_cells);
+    free(s->search_queue);
+    free(s->search_seen);
+    free(s->search_from);
+    free(s->path);
+    s->occupied = NULL;
+    s->body_dirs = NULL;
+    s->free_tree = NULL;
+    s->snapshot = NULL;
+    s->cycle_order = s->cycle_cells = s->search_queue = s->path = NULL;
+    s->search_seen = NULL;
+    s->search_from = NULL;
+    s->autopilot = 0;
+}
+
+// Count the free cells of the occupancy words into a zeroed Fenwick tree
+// in O(words)
+void build_free_tree(Snake *s) {
+    s->free_count = 0;
+    for (int i = 1; i <= s->occupied_words; i++) {
+        int free_cells = 64 - __builtin_popcountll(s->occupied[i - 1]);
+        s->free_tree[i] += free_cells;
+        s->free_count += free_cells;
+        int parent = i + (i & -i);
+        if (parent <= s->occupied_words) {
+            s->free_tree[parent] += s->free_tree[i];
         }
     }
 }
 
-// Render the game grid and score
-void draw_grid() {
-    printf("\033[H\033[J"); // Clear the screen
-    for (int i = 0; i < GRID_SIZE; i++) {
-        for (int j = 0; j < GRID_SIZE; j++) {
-            putchar(grid[i][j]);
-            printf(" ");
+// Put a fresh snake on an empty arena, reusing the allocated storage
+void reset_game(Snake *s) {
+    memset(s->occupied, 0, s->occupied_words * sizeof(uint64_t));
+    memset(s->free_tree, 0, (s->occupied_words + 1) * sizeof(uint32_t));
+
+    // Padding bits past the last cell count as occupied so they are never picked
+    if (s->grid_cells % 64) {
+        s->occupied[s->occupied_words - 1] = ~(uint64_t)0 << (s->grid_cells % 64);
+    }
+    build_free_tree(s);
+    s->cleared = 0;
+    s->score = 0;
+    s->direction = 'd';
+    s->last_move = 'd';
+    s->turn_pending = 0;
+    s->queue_len = 0;
+    s->path_len = 0;
+
+    // Initialize the snake in the middle of the grid, tail first
+    s->snake_length = 2;
+    s->tail_cell = CELL(s->grid_rows / 2, s->grid_cols / 2 - 1);
+    s->head_cell = CELL(s->grid_rows / 2, s->grid_cols / 2);
+    s->ring_tail = 0;
+    ring_set(s, 0, DIR_RIGHT);
+    s->ring_head = 1;
+    occupy(s, s->tail_cell);
+    occupy(s, s->head_cell);
+
+    // Add the first bait
+    spawn_bait(s);
+}
+
+// Place a bait at a random empty position, or end the game if there is none
+void spawn_bait(Snake *s) {
+    if (s->free_count == 0) {
+        s->bait_x = s->bait_y = -1;
+        s->cleared = 1;
+        return;
+    }
+    int cell = free_tree_select(s, rng_below(&s->rng, s->free_count));
+    s->bait_x = cell / s->grid_cols;
+    s->bait_y = cell % s->grid_cols;
+}
+
+// Scroll the viewport by half a screen when the head nears its edge
+void follow_head(Snake *s) {
+    int x = s->head_cell / s->grid_cols;
+    int y = s->head_cell % s->grid_cols;
+    int margin_rows = s->view_rows / 4;
+    int margin_cols = s->view_cols / 4;
+
+    if (x < s->view_top + margin_rows || x >= s->view_top + s->view_rows - margin_rows) {
+        s->view_top = x - s->view_rows / 2;
+    }
+    if (y < s->view_left + margin_cols || y >= s->view_left + s->view_cols - margin_cols) {
+        s->view_left = y - s->view_cols / 2;
+    }
+
+    // Never scroll past the walls
+    if (s->view_top > s->grid_rows - s->view_rows) s->view_top = s->grid_rows - s->view_rows;
+    if (s->view_left > s->grid_cols - s->view_cols) s->view_left = s->grid_cols - s->view_cols;
+    if (s->view_top < 0) s->view_top = 0;
+    if (s->view_left < 0) s->view_left = 0;
+}
+
+// Render the visible part of the grid and the score
+void draw_grid(Snake *s, Renderer *screen) {
+    follow_head(s);
+    render_clear(screen);
+    for (int i = 0; i < s->view_rows && s->view_top + i < s->grid_rows; i++) {
+        int x = s->view_top + i;
+        for (int j = 0; j < s->view_cols && s->view_left + j < s->grid_cols; j++) {
+            int y = s->view_left + j;
+            char c = EMPTY_CELL;
+            if (CELL(x, y) == s->head_cell) {
+                c = SNAKE_HEAD;
+            } else if (is_occupied(s, CELL(x, y))) {
+                c = SNAKE_BODY;
+            } else if (x == s->bait_x && y == s->bait_y) {
+                c = BAIT;
+            }
+            render_put(screen, i, j * 2, c);
         }
-        putchar('\n');
     }
-    printf("Score: %d\n", score);
-    printf("Use 'w', 'a', 's', 'd' to move. Press 'q' to quit.\n");
-    if (paused) {
-        printf("Game paused! Press a direction to resume.\n");
+    if (s->view_rows < s->grid_rows || s->view_cols < s->grid_cols) {
+        render_text(screen, s->view_rows, 0, "Score: %d   Head: %d,%d of %dx%d   Bait: %d,%d",
+                    s->score, s->head_cell / s->grid_cols, s->head_cell % s->grid_cols,
+                    s->grid_rows, s->grid_cols, s->bait_x, s->bait_y);
+    } else {
+        render_text(screen, s->view_rows, 0, "Score: %d", s->score);
+    }
+    if (s->autopilot) {
+        render_text(screen, s->view_rows + 1, 0, "Autopilot. 'w', 'a', 's', 'd' take over, 'q' quits.");
+    } else {
+        render_text(screen, s->view_rows + 1, 0, "Use 'w', 'a', 's', 'd' to move. Press 'q' to quit.");
+    }
+    if (s->cleared) {
+        render_text(screen, s->view_rows + 2, 0, "Board cleared! You win! Press 'q' to quit.");
+    } else if (s->paused) {
+        render_text(screen, s->view_rows + 2, 0, "Game paused! Press a direction to resume.");
     }
 }
 
-// Move the snake in the current direction
-int move_snake() {
-    int new_head_x = snake_x[0];
-    int new_head_y = snake_y[0];
+// Move the snake in the current direction, touching only the head and tail cells
+int move_snake(Snake *s) {
+    int new_head_x = s->head_cell / s->grid_cols;
+    int new_head_y = s->head_cell % s->grid_cols;
+    int dir = DIR_RIGHT;
 
     // Update the head position based on direction
-    switch (direction) {
-        case 'w': new_head_x--; break;
-        case 'a': new_head_y--; break;
-        case 's': new_head_x++; break;
-        case 'd': new_head_y++; break;
+    switch (s->direction) {
+        case 'w': new_head_x--; dir = DIR_UP; break;
+        case 'a': new_head_y--; dir = DIR_LEFT; break;
+        case 's': new_head_x++; dir = DIR_DOWN; break;
+        case 'd': new_head_y++; dir = DIR_RIGHT; break;
     }
 
     // Check for collisions
-    if (check_collision(new_head_x, new_head_y)) {
+    if (check_collision(s, new_head_x, new_head_y)) {
         return 0; // Collision means game pause
     }
 
     // Check if the snake eats the bait
-    int grow = (new_head_x == bait_x && new_head_y == bait_y);
+    int grow = (new_head_x == s->bait_x && new_head_y == s->bait_y);
 
     if (!grow) {
-        // If not growing, clear the last tail position
-        grid[snake_x[snake_length - 1]][snake_y[snake_length - 1]] = EMPTY_CELL;
+        // If not growing, vacate the tail cell and follow its recorded move
+        vacate(s, s->tail_cell);
+        s->tail_cell = step_cell(s, s->tail_cell, ring_get(s, s->ring_tail));
+        s->ring_tail = ring_next(s, s->ring_tail);
     } else {
-        // Extend the snake
-        score++;
-        snake_length++;
-        snake_x = realloc(snake_x, snake_length * sizeof(int));
-        snake_y = realloc(snake_y, snake_length * sizeof(int));
-        spawn_bait();
-    }
-
-    // Move the snake's body
-    for (int i = snake_length - 1; i > 0; i--) {
-        snake_x[i] = snake_x[i - 1];
-        snake_y[i] = snake_y[i - 1];
+        // Extend the snake: the tail simply stays where it is
+        s->score++;
+        s->snake_length++;
     }
 
-    // Update the head
-    snake_x[0] = new_head_x;
-    snake_y[0] = new_head_y;
+    // Record the move and advance the head
+    ring_set(s, s->ring_head, dir);
+    s->ring_head = ring_next(s, s->ring_head);
+    s->head_cell = CELL(new_head_x, new_head_y);
+    occupy(s, s->head_cell);
 
-    update_snake();
+    if (grow) {
+        spawn_bait(s);
+    }
     return 1;
 }
 
 // Check for collisions with the wall or the snake's body
-int check_collision(int x, int y) {
-    if (x < 0 || x >= GRID_SIZE || y < 0 || y >= GRID_SIZE) {
+int check_collision(Snake *s, int x, int y) {
+    if (x < 0 || x >= s->grid_rows || y < 0 || y >= s->grid_cols) {
         return 1; // Wall collision
     }
-    for (int i = 0; i < snake_length; i++) {
-        if (snake_x[i] == x && snake_y[i] == y) {
-            return 1; // Self-collision
+    return is_occupied(s, CELL(x, y)); // Self-collision
+}
+
+// Turn for the next step; reversing onto the body is ignored.
+// Returns 1 if the turn was taken.
+int apply_turn(Snake *s, char input) {
+    if ((input == 'w' && s->last_move != 's') ||
+        (input == 'a' && s->last_move != 'd') ||
+        (input == 's' && s->last_move != 'w') ||
+        (input == 'd' && s->last_move != 'a')) {
+        s->direction = input;
+        s->turn_pending = 1;
+        s->paused = 0; // Resume if paused
+        return 1;
+    }
+    return 0;
+}
+
+// Apply a direction key. The first turn before a step takes effect at once,
+// later ones wait in the queue for the following steps, so a quick "up,
+// left" is not lost or turned into a reversal.
+void handle_key(Snake *s, char input) {
+    if (input != 'w' && input != 'a' && input != 's' && input != 'd') {
+        return;
+    }
+    if (!s->turn_pending) {
+        apply_turn(s, input);
+    } else if (s->queue_len < TURN_QUEUE_SIZE) {
+        s->turn_queue[(s->queue_start + s->queue_len++) % TURN_QUEUE_SIZE] = input;
+    }
+}
+
+// After a step, take the next valid queued turn for the coming one
+void end_turn(Snake *s) {
+    s->turn_pending = 0;
+    while (s->queue_len > 0 && !s->turn_pending) {
+        char input = s->turn_queue[s->queue_start];
+        s->queue_start = (s->queue_start + 1) % TURN_QUEUE_SIZE;
+        s->queue_len--;
+        apply_turn(s, input);
+    }
+}
+
+// Advance the game by one tick
+void step_game(Snake *s) {
+    if (s->history) {
+        SnakeStep step = {
+            .head_cell = s->head_cell, .tail_cell = s->tail_cell,
+            .ring_head = s->ring_head, .ring_tail = s->ring_tail,
+            .bait_x = s->bait_x, .bait_y = s->bait_y,
+            .score = s->score, .snake_length = s->snake_length,
+            .rng = s->rng.state, .head_move = ring_get(s, s->ring_head),
+            .paused = s->paused, .cleared = s->cleared, .turn_pending = s->turn_pending,
+            .direction = s->direction, .last_move = s->last_move,
+            .queue_start = s->queue_start, .queue_len = s->queue_len,
+        };
+        memcpy(step.turn_queue, s->turn_queue, TURN_QUEUE_SIZE);
+        rewind_begin(s->history, REWIND_TICK);
+        rewind_put(s->history, &step, sizeof(step));
+        rewind_end(s->history);
+    }
+
+    // Only move the snake if not paused
+    if (!s->paused && !s->cleared) {
+        if (move_snake(s)) {
+            s->last_move = s->direction;
+        } else {
+            s->paused = 1; // Pause if a collision occurs
+        }
+    }
+    end_turn(s);
+    s->ticks++;
+}
+
+// Undo the last step, returns 0 once the history runs out. The head and
+// tail go back one cell each, in the reverse order they moved, so the
+// occupancy bitmap, body ring and free-cell tree end up as they were.
+// ticks keeps counting, it is the clock replays are keyed to.
+int step_back(Snake *s) {
+    SnakeStep step;
+    if (!s->history || rewind_last(s->history, NULL) != REWIND_TICK) return 0;
+    rewind_read(s->history, 0, &step, sizeof(step));
+    rewind_pop(s->history);
+
+    if (s->head_cell != step.head_cell) {
+        vacate(s, s->head_cell);
+        ring_set(s, step.ring_head, step.head_move);
+    }
+    if (s->tail_cell != step.tail_cell) {
+        occupy(s, step.tail_cell);
+    }
+    s->head_cell = step.head_cell;
+    s->tail_cell = step.tail_cell;
+    s->ring_head = step.ring_head;
+    s->ring_tail = step.ring_tail;
+    s->bait_x = step.bait_x;
+    s->bait_y = step.bait_y;
+    s->score = step.score;
+    s->snake_length = step.snake_length;
+    s->rng.state = step.rng;
+    s->paused = step.paused;
+    s->cleared = step.cleared;
+    s->turn_pending = step.turn_pending;
+    s->direction = step.direction;
+    s->last_move = step.last_move;
+    s->queue_start = step.queue_start;
+    s->queue_len = step.queue_len;
+    memcpy(s->turn_queue, step.turn_queue, TURN_QUEUE_SIZE);
+    s->path_len = 0; // The autopilot's path was planned for the future just undone
+    return 1;
+}
+
+// Hash of everything that determines how the game continues
+uint64_t state_hash(Snake *s) {
+    int scalars[] = {s->head_cell, s->tail_cell, s->ring_tail, s->ring_head, s->snake_length,
+                     s->bait_x, s->bait_y, s->direction, s->score, s->paused, s->cleared,
+                     s->last_move, s->turn_pending, s->queue_len};
+    uint64_t hash = replay_hash(REPLAY_HASH_INIT, scalars, sizeof(scalars));
+    for (int i = 0; i < s->queue_len; i++) {
+        hash = replay_hash(hash, &s->turn_queue[(s->queue_start + i) % TURN_QUEUE_SIZE], 1);
+    }
+    hash = replay_hash(hash, &s->rng.state, sizeof(s->rng.state));
+    hash = replay_hash(hash, s->occupied, s->occupied_words * sizeof(uint64_t));
+    return replay_hash(hash, s->body_dirs, (s->grid_cells + 3) / 4);
+}
+
+// Autopilot. The snake follows a Hamiltonian cycle, a closed tour through
+// every cell, and takes shortcuts to the bait that never leave it stranded.
+//
+// The body always lies along the cycle in order from tail to head, with
+// gaps where shortcuts skipped cells. A move that lands strictly between
+// the head and the tail going forward along the cycle keeps that order, so
+// the cell is free and the tail stays reachable by following the cycle.
+//
+// Gaps are the one danger: they sit behind the head, and if the free cells
+// ahead of it run out before the tail has moved past them, the head runs
+// into the tail. So a shortcut is only taken while it leaves more free
+// cells ahead than the snake is long; the tail then clears the gaps before
+// the head can catch up unless bait after bait lands right in front of the
+// head, which only happens on tiny boards (about 1 game in 3000 on 4x4,
+// none seen from 6x6 up). Once the snake is too long for shortcuts it just
+// follows the cycle, which leaves no gaps and fills the board.
+//
+// To get to the bait, a breadth-first search looks for the shortest path
+// made of such moves, each further along the cycle than the last and none
+// past the bait. The path stays safe as the snake moves (the tail only
+// moves forward and frees room), so it is kept until the bait is eaten.
+//
+// A board with both sides odd has no Hamiltonian cycle. There the cycle
+// skips one corner, the hole, and passes its diagonal neighbour, the
+// partner, between the hole's two neighbours; hole and partner trade
+// places when the bait lands in the hole. The last cell can still be out
+// of reach, so such boards are not always cleared.
+
+// Append a cell to the cycle, swapping rows and columns if transposed
+static void cycle_add(Snake *s, int x, int y, int transposed) {
+    int cell = transposed ? CELL(y, x) : CELL(x, y);
+    s->cycle_order[cell] = s->cycle_length;
+    s->cycle_cells[s->cycle_length++] = cell;
+}
+
+// Lay out the cycle: along the first row, a serpentine back through the
+// other columns and up the first column. An even number of rows makes the
+// serpentine end next to the first column; with odd rows but even columns
+// the same is done on the transposed board.
+static void build_cycle(Snake *s) {
+    int transposed = s->grid_rows % 2 != 0 && s->grid_cols % 2 == 0;
+    int rows = transposed ? s->grid_cols : s->grid_rows;
+    int cols = transposed ? s->grid_rows : s->grid_cols;
+
+    s->cycle_length = 0;
+    s->hole = s->partner = -1;
+    if (rows % 2 == 0) {
+        for (int y = 0; y < cols; y++) cycle_add(s, 0, y, transposed);
+        for (int x = 1; x < rows; x++) {
+            for (int i = 1; i < cols; i++) cycle_add(s, x, x % 2 ? cols - i : i, transposed);
         }
+        for (int x = rows - 1; x > 0; x--) cycle_add(s, x, 0, transposed);
+        return;
+    }
+
+    // Both odd: skip (0,0) and pass (1,1) between its neighbours (1,0) and
+    // (0,1), zigzag down the first three rows, then serpentine as above
+    s->cycle_order[CELL(0, 0)] = -1;
+    s->hole = CELL(0, 0);
+    s->partner = CELL(1, 1);
+    cycle_add(s, 1, 0, 0);
+    cycle_add(s, 1, 1, 0);
+    for (int y = 1; y < cols; y++) cycle_add(s, 0, y, 0);
+    for (int y = cols - 1; y >= 2; y--) {
+        int down = (cols - 1 - y) % 2 == 0;
+        cycle_add(s, down ? 1 : 2, y, 0);
+        cycle_add(s, down ? 2 : 1, y, 0);
     }
+    cycle_add(s, 2, 1, 0);
+    for (int x = 3; x < rows; x++) {
+        for (int i = 1; i < cols; i++) cycle_add(s, x, x % 2 ? i : cols - i, 0);
+    }
+    for (int x = rows - 1; x > 1; x--) cycle_add(s, x, 0, 0);
+}
+
+// Allocate the autopilot's buffers for the arena, returns 0 on failure
+int autopilot_init(Snake *s) {
+    if (s->cycle_order) return 1;
+    s->cycle_order = malloc(s->grid_cells * sizeof(int32_t));
+    s->cycle_cells = malloc(s->grid_cells * sizeof(int32_t));
+    s->search_queue = malloc(s->grid_cells * sizeof(int32_t));
+    s->search_seen = calloc(s->grid_cells, sizeof(uint32_t));
+    s->search_from = malloc(s->grid_cells);
+    s->path = malloc(s->grid_cells * sizeof(int32_t));
+    if (!s->cycle_order || !s->cycle_cells || !s->search_queue || !s->search_seen ||
+        !s->search_from || !s->path) {
+        free(s->cycle_order);
+        free(s->cycle_cells);
+        free(s->search_queue);
+        free(s->search_seen);
+        free(s->search_from);
+        free(s->path);
+        s->cycle_order = s->cycle_cells = s->search_queue = s->path = NULL;
+        s->search_seen = NULL;
+        s->search_from = NULL;
+        return 0;
+    }
+    s->search_stamp = 0;
+    s->path_len = 0;
+    build_cycle(s);
+    return 1;
+}
+
+// Distance from position a forward to position b along the cycle
+static inline int cycle_ahead(Snake *s, int a, int b) {
+    return b >= a ? b - a : b - a + s->cycle_length;
+}
+
+// Shortest path of safe moves from the head to the bait, stored in path.
+// Returns 0 if the bait isn't between the head and the tail on the cycle
+// or too close to the tail for shortcuts.
+static int find_path(Snake *s, int bait) {
+    int head = s->cycle_order[s->head_cell], tail = s->cycle_order[s->tail_cell];
+    if (head < 0 || tail < 0 || s->cycle_order[bait] < 0) return 0;
+    int limit = cycle_ahead(s, head, s->cycle_order[bait]);
+    int tail_ahead = cycle_ahead(s, head, tail);
+    if (limit >= tail_ahead) return 0;
+    if (tail_ahead - limit - 1 < s->snake_length + 1) {
+        limit = 1; // Too little room ahead once grown: only the next cell on the cycle
+    }
+
+    if (++s->search_stamp == 0) {
+        memset(s->search_seen, 0, s->grid_cells * sizeof(uint32_t));
+        s->search_stamp = 1;
+    }
+    int first = 0, last = 0, found = 0;
+    s->search_queue[last++] = s->head_cell;
+    s->search_seen[s->head_cell] = s->search_stamp;
+    while (first < last && !found) {
+        int cell = s->search_queue[first++];
+        int ahead = cycle_ahead(s, head, s->cycle_order[cell]);
+        int x = cell / s->grid_cols, y = cell % s->grid_cols;
+        for (int dir = 0; dir < 4; dir++) {
+            if ((dir == DIR_UP && x == 0) || (dir == DIR_LEFT && y == 0) ||
+                (dir == DIR_DOWN && x == s->grid_rows - 1) || (dir == DIR_RIGHT && y == s->grid_cols - 1)) {
+                continue;
+            }
+            int next = step_cell(s, cell, dir);
+            int order = s->cycle_order[next];
+            if (order < 0 || s->search_seen[next] == s->search_stamp || is_occupied(s, next)) continue;
+            int next_ahead = cycle_ahead(s, head, order);
+            if (next_ahead <= ahead || next_ahead > limit) continue;
+            s->search_seen[next] = s->search_stamp;
+            s->search_from[next] = dir;
+            s->search_queue[last++] = next;
+            if (next == bait) found = 1;
+        }
+    }
+    if (!found) return 0;
+
+    // Walk back from the bait to lay the path out head first
+    int length = 1;
+    for (int cell = bait; cell != s->head_cell; length++) {
+        cell = step_cell(s, cell, (s->search_from[cell] + 2) & 3);
+    }
+    for (int i = length - 1, cell = bait; i >= 0; i--) {
+        s->path[i] = cell;
+        if (i) cell = step_cell(s, cell, (s->search_from[cell] + 2) & 3);
+    }
+    s->path_len = length;
+    s->path_pos = 0;
+    s->path_bait = bait;
+    return 1;
+}
+
+// Key that moves the head to an adjacent cell
+static char key_toward(Snake *s, int cell) {
+    if (cell == s->head_cell - s->grid_cols) return 'w';
+    if (cell == s->head_cell + s->grid_cols) return 's';
+    return cell == s->head_cell - 1 ? 'a' : 'd';
+}
+
+static int adjacent(Snake *s, int a, int b) {
+    return (abs(a - b) == s->grid_cols) || (abs(a - b) == 1 && a / s->grid_cols == b / s->grid_cols);
+}
+
+// Decide the next move, call before every step while the autopilot plays.
+// Takes O(1) while it follows a path and one search for each new bait.
+char autopilot_key(Snake *s) {
+    int bait = s->bait_x < 0 ? -1 : CELL(s->bait_x, s->bait_y);
+
+    if (bait >= 0 && bait == s->hole) {
+        if (!is_occupied(s, s->partner)) {
+            // Both are free, so no part of the body changes order
+            int order = s->cycle_order[s->partner];
+            s->cycle_order[s->hole] = order;
+            s->cycle_cells[order] = s->hole;
+            s->cycle_order[s->partner] = -1;
+            s->hole = s->partner;
+            s->partner = bait;
+            s->path_len = 0;
+        } else if (s->free_count == 1 && adjacent(s, s->head_cell, bait)) {
+            return key_toward(s, bait); // The last cell
+        }
+    }
+
+    if (bait >= 0 && !(s->path_bait == bait && s->path_pos + 1 < s->path_len &&
+                       s->path[s->path_pos] == s->head_cell)) {
+        s->path_len = 0;
+        find_path(s, bait);
+    }
+    if (s->path_len && s->path[s->path_pos] == s->head_cell && s->path_pos + 1 < s->path_len) {
+        return key_toward(s, s->path[++s->path_pos]);
+    }
+
+    // No safe shortcut: follow the cycle, or any free cell if the snake
+    // left it while someone else was steering
+    int order = s->cycle_order[s->head_cell];
+    if (order >= 0) {
+        int next = s->cycle_cells[order + 1 == s->cycle_length ? 0 : order + 1];
+        if (!is_occupied(s, next)) return key_toward(s, next);
+    }
+    int x = s->head_cell / s->grid_cols, y = s->head_cell % s->grid_cols;
+    static const char keys[4] = {'w', 'a', 's', 'd'};
+    static const int dx[4] = {-1, 0, 1, 0};
+    static const int dy[4] = {0, -1, 0, 1};
+    for (int i = 0; i < 4; i++) {
+        if (!check_collision(s, x + dx[i], y + dy[i])) return keys[i];
+    }
+    return s->direction;
+}
+
+#ifndef ATAR_PLUGIN
+
+// Handle a key as soon as it is pressed. Keys and steps are the only inputs
+// to the game state, so recording each key against the current tick and
+// replaying through here reproduces a session exactly.
+void apply_key(Snake *s, char input) {
+    if (input == 'q') {  // Exit game on 'q'
+        running = 0;
+        return;
+    }
+    if (input == 'p') {  // Hand over to the autopilot
+        s->autopilot = autopilot_init(s);
+        return;
+    }
+    if (input == 'w' || input == 'a' || input == 's' || input == 'd') {
+        s->autopilot = 0; // The player takes over
+    }
+    replay_record(&recorder, s->ticks, input);
+    if (input == 'r') {  // Go back a second and wait for a direction
+        for (unsigned i = 0; i < REWIND_STEP && step_back(s); i++);
+        s->paused = !s->cleared;
+        s->autopilot = 0;
+        return;
+    }
+    handle_key(s, input);
+}
+
+// Let the autopilot pick the move for the coming step. Its moves are
+// recorded like keys, so replays don't need the autopilot.
+void autopilot_turn(Snake *s) {
+    char input = autopilot_key(s);
+    replay_record(&recorder, s->ticks, input);
+    handle_key(s, input);
+}
+
+// Scripted stand-in for a player: usually heads for the bait, never steps
+// into a wall or the body when a safe move exists
+char random_key(Snake *s) {
+    static const char keys[4] = {'w', 'a', 's', 'd'};
+    static const int dx[4] = {-1, 0, 1, 0};
+    static const int dy[4] = {0, -1, 0, 1};
+    int x = s->head_cell / s->grid_cols, y = s->head_cell % s->grid_cols;
+    int safe[4], safe_count = 0, toward = -1;
+
+    for (int i = 0; i < 4; i++) {
+        if (check_collision(s, x + dx[i], y + dy[i])) continue;
+        safe[safe_count++] = i;
+        int before = abs(x - s->bait_x) + abs(y - s->bait_y);
+        int after = abs(x + dx[i] - s->bait_x) + abs(y + dy[i] - s->bait_y);
+        if (after < before) toward = i;
+    }
+    if (safe_count == 0) return s->direction;
+    if (toward >= 0 && rng_below(&s->rng, 4) != 0) return keys[toward];
+    return keys[safe[rng_below(&s->rng, safe_count)]];
+}
+
+// Step the simulation for a fixed number of ticks and report its speed.
+// Keys come from the script (one per tick, '.' for none, repeated), the
+// autopilot or random_key(); a dead or finished snake starts over on the
+// same arena. With the autopilot, its decisions are timed on their own.
+void run_headless(Snake *s, long count, const char *keys) {
+    BenchRun run;
+    long games = 1, best = 0;
+    long finished = 0, cleared = 0, score_sum = 0;
+    uint64_t decide_ns = 0, slowest_ns = 0;
+    size_t key_count = keys ? strlen(keys) : 0;
+
+    if (bench_begin(&run, count) < 0) {
+        fprintf(stderr, "Not enough memory for %ld samples\n", count);
+        return;
+    }
+    for (long t = 0; t < count; t++) {
+        uint64_t start = bench_now_ns();
+        if (s->autopilot) {
+            char input = autopilot_key(s);
+            uint64_t spent = bench_now_ns() - start;
+            decide_ns += spent;
+            if (spent > slowest_ns) slowest_ns = spent;
+            handle_key(s, input);
+        } else {
+            handle_key(s, key_count ? keys[t % key_count] : random_key(s));
+        }
+        if (s->cleared || !move_snake(s)) {
+            if (s->score > best) best = s->score;
+            finished++;
+            cleared += s->cleared;
+            score_sum += s->score;
+            reset_game(s);
+            games++;
+        } else {
+            s->last_move = s->direction;
+        }
+        end_turn(s);
+        bench_sample(&run, start);
+    }
+    bench_end(&run);
+    if (s->score > best) best = s->score;
+
+    char label[64];
+    snprintf(label, sizeof(label), "snake %dx%d", s->grid_rows, s->grid_cols);
+    bench_report(&run, stdout, label);
+    printf("%-24s %ld games, best score %ld, final length %d\n", "", games, best, s->snake_length);
+    if (s->autopilot) {
+        printf("%-24s autopilot %.0f decisions/s, slowest %.1f us; %ld games over (%ld cleared), "
+               "average score %.1f\n", "", count / (decide_ns / 1e9), slowest_ns / 1e3, finished,
+               cleared, finished ? (double)score_sum / finished : 0.0);
+    }
+}
+
+// Whether a saved game is one this build could have written: every field
+// the simulation indexes with in range, and the body ring leading from the
+// tail to the head over exactly the occupied cells. A damaged or edited
+// snapshot would otherwise read and write out of bounds on the first tick.
+int valid_saved_game(const Snake *saved, const uint64_t *occupied, const uint8_t *body_dirs) {
+    Snake view = *saved, *s = &view;
+    s->occupied = (uint64_t *)occupied;
+    s->body_dirs = (uint8_t *)body_dirs;
+    if (s->snake_length < 1 || s->snake_length > s->grid_cells ||
+        s->head_cell < 0 || s->head_cell >= s->grid_cells ||
+        s->tail_cell < 0 || s->tail_cell >= s->grid_cells ||
+        s->ring_head < 0 || s->ring_head >= s->grid_cells ||
+        s->ring_tail < 0 || s->ring_tail >= s->grid_cells ||
+        s->queue_start < 0 || s->queue_start >= TURN_QUEUE_SIZE ||
+        s->queue_len < 0 || s->queue_len > TURN_QUEUE_SIZE || s->score < 0 ||
+        !s->direction || !strchr("wasd", s->direction) ||
+        !s->last_move || !strchr("wasd", s->last_move)) {
+        return 0;
+    }
+    if (s->bait_x == -1 ? s->bait_y != -1 || s->snake_length != s->grid_cells
+                        : s->bait_x < 0 || s->bait_x >= s->grid_rows || s->bait_y < 0 ||
+                          s->bait_y >= s->grid_cols || is_occupied(s, CELL(s->bait_x, s->bait_y))) {
+        return 0;
+    }
+
+    // Walk the body into a bitmap of its own, which has to come out as the
+    // occupancy, padding bits included
+    uint64_t *seen = calloc(s->occupied_words, sizeof(uint64_t));
+    if (!seen) return 0;
+    if (s->grid_cells % 64) seen[s->occupied_words - 1] = ~(uint64_t)0 << (s->grid_cells % 64);
+    int cell = s->tail_cell, index = s->ring_tail, ok = 1;
+    for (int i = 0; ok && i < s->snake_length; i++) {
+        if (i > 0) {
+            int dir = ring_get(s, index), x = cell / s->grid_cols, y = cell % s->grid_cols;
+            ok = (dir == DIR_UP && x > 0) || (dir == DIR_LEFT && y > 0) ||
+                 (dir == DIR_DOWN && x + 1 < s->grid_rows) ||
+                 (dir == DIR_RIGHT && y + 1 < s->grid_cols);
+            if (!ok) break; // Off the arena
+            cell = step_cell(s, cell, dir);
+            index = ring_next(s, index);
+        }
+        ok = !((seen[cell >> 6] >> (cell & 63)) & 1); // Crossing itself
+        seen[cell >> 6] |= (uint64_t)1 << (cell & 63);
+    }
+    ok = ok && cell == s->head_cell && index == s->ring_head &&
+         memcmp(seen, occupied, s->occupied_words * sizeof(uint64_t)) == 0;
+    free(seen);
+    return ok;
+}
+
+// Save the game as snapshot name: the Snake struct, then the occupancy
+// bitmap, body ring and free-cell tree as they are. Returns -1 on failure.
+int save_game(Snake *s, const char *name) {
+    struct iovec sections[] = {
+        {s, sizeof(*s)},
+        {s->occupied, s->occupied_words * sizeof(uint64_t)},
+        {s->body_dirs, (s->grid_cells + 3) / 4},
+        {s->free_tree, (s->occupied_words + 1) * sizeof(uint32_t)},
+    };
+    return snapshot_save(name, "snake", SNAPSHOT_STATE, sections, 4);
+}
+
+// Take over the game in snapshot name, returns 0 if there is none. The
+// arena arrays stay in the mapping, so nothing is read until it is used.
+int resume_game(Snake *s, const char *name) {
+    Snapshot snap;
+    if (snapshot_open(&snap, name, "snake", SNAPSHOT_STATE) < 0) return 0;
+
+    Snake *saved = snapshot_section(&snap, 0, sizeof(Snake));
+    int ok = saved && saved->grid_rows >= MIN_GRID_SIZE && saved->grid_rows <= MAX_GRID_SIZE &&
+             saved->grid_cols >= MIN_GRID_SIZE && saved->grid_cols <= MAX_GRID_SIZE &&
+             saved->grid_cells == saved->grid_rows * saved->grid_cols &&
+             saved->occupied_words == (saved->grid_cells + 63) / 64;
+    uint64_t *occupied = NULL;
+    uint8_t *body_dirs = NULL;
+    uint32_t *free_tree = NULL;
+    if (ok) {
+        occupied = snapshot_section(&snap, 1, saved->occupied_words * sizeof(uint64_t));
+        body_dirs = snapshot_section(&snap, 2, (saved->grid_cells + 3) / 4);
+        free_tree = snapshot_section(&snap, 3, (saved->occupied_words + 1) * sizeof(uint32_t));
+    }
+    if (!occupied || !body_dirs || !free_tree || !valid_saved_game(saved, occupied, body_dirs)) {
+        snapshot_close(&snap);
+        return 0;
+    }
+
+    // The saved pointers are stale; the autopilot rebuilds its own buffers.
+    // The free-cell tree is derived from the occupancy, so it is rebuilt
+    // rather than trusted.
+    free_game(s);
+    *s = *saved;
+    s->occupied = occupied;
+    s->body_dirs = body_dirs;
+    s->free_tree = free_tree;
+    memset(s->free_tree, 0, (s->occupied_words + 1) * sizeof(uint32_t));
+    build_free_tree(s);
+    for (s->free_tree_step = 1; s->free_tree_step * 2 <= s->occupied_words; s->free_tree_step *= 2);
+    s->snapshot = snap.map;
+    s->snapshot_size = snap.size;
+    s->history = NULL;
+    s->cycle_order = s->cycle_cells = s->search_queue = s->path = NULL;
+    s->search_seen = NULL;
+    s->search_from = NULL;
+    s->path_len = 0;
+    return 1;
+}
+
+// Save the headless game to a scratch snapshot, resume it into a second
+// game and check both play on the same
+void time_snapshot(Snake *s) {
+    Snake copy = {0};
+    const char *name = "snake-bench";
+
+    uint64_t start = bench_now_ns();
+    if (save_game(s, name) < 0) {
+        fprintf(stderr, "Cannot save a snapshot in %s\n", storage_dir());
+        return;
+    }
+    uint64_t saved = bench_now_ns();
+    int resumed = resume_game(&copy, name);
+    uint64_t done = bench_now_ns();
+    snapshot_remove(name);
+    if (!resumed) {
+        fprintf(stderr, "Cannot resume the snapshot\n");
+        return;
+    }
+    size_t bytes = copy.snapshot_size;
+    int same = state_hash(&copy) == state_hash(s);
+    for (int i = 0; i < 1000; i++) {
+        char key = "wdsa"[i / 8 % 4]; // random_key() would draw from one game's Rng only
+        handle_key(s, key);
+        handle_key(&copy, key);
+        step_game(s);
+        step_game(&copy);
+    }
+    same = same && state_hash(&copy) == state_hash(s);
+    printf("%-24s snapshot %zu bytes: save %.1f us (synced), resume %.1f us, %s\n", "", bytes,
+           (saved - start) / 1e3, (done - saved) / 1e3, same ? "plays on the same" : "DIFFERS");
+    free_game(&copy);
+}
+
+// Play REWIND_TICKS more ticks of the headless game with the history on,
+// then step all the way back, checking each step lands on the state the
+// tick started from
+void time_rewind(Snake *s) {
+    static uint64_t hashes[REWIND_TICKS];
+    RewindBuffer rewind;
+    if (rewind_init(&rewind, REWIND_BYTES, REWIND_TICKS) < 0) {
+        fprintf(stderr, "Not enough memory for the rewind history\n");
+        return;
+    }
+    s->history = &rewind;
+    for (unsigned i = 0; i < REWIND_TICKS; i++) {
+        handle_key(s, random_key(s));
+        hashes[i] = state_hash(s);
+        step_game(s);
+    }
+    uint64_t used = rewind_used(&rewind);
+
+    // Only the steps back are timed, hashing the arena to check them is not
+    int steps = 0, same = 1;
+    uint64_t elapsed = 0, start = bench_now_ns();
+    while (step_back(s)) {
+        elapsed += bench_now_ns() - start;
+        steps++;
+        same = same && state_hash(s) == hashes[REWIND_TICKS - steps];
+        start = bench_now_ns();
+    }
+    printf("%-24s rewind %d ticks, %.0f ns per step back, %llu of %d bytes of history, %s\n", "",
+           steps, steps ? (double)elapsed / steps : 0.0, (unsigned long long)used, REWIND_BYTES,
+           same && steps == REWIND_TICKS ? "lands on every tick" : "DIFFERS");
+    s->history = NULL;
+    rewind_free(&rewind);
+}
+
+// Play a recorded session back from a memory-mapped file as fast as possible
+// and check that it ends in the recorded state
+int run_replay(const char *path) {
+    ReplayReader replay;
+    BenchRun run;
+
+    if (replay_open(&replay, path, "snake") < 0) {
+        fprintf(stderr, "%s is not a snake replay\n", path);
+        return 1;
+    }
+    game.grid_rows = replay.header.params[0];
+    game.grid_cols = replay.header.params[1];
+    rng_seed(&game.rng, replay.header.seed);
+    if (game.grid_rows < MIN_GRID_SIZE || game.grid_rows > MAX_GRID_SIZE ||
+        game.grid_cols < MIN_GRID_SIZE || game.grid_cols > MAX_GRID_SIZE || !init_game(&game) ||
+        bench_begin(&run, replay_end_tick(&replay)) < 0) {
+        fprintf(stderr, "Cannot set up a %dx%d arena for %s\n", game.grid_rows, game.grid_cols, path);
+        replay_close(&replay);
+        return 1;
+    }
+    // Rewinds replay the same from the same history
+    if (rewind_init(&history, REWIND_BYTES, REWIND_TICKS) < 0) {
+        fprintf(stderr, "Not enough memory for the rewind history\n");
+        replay_close(&replay);
+        return 1;
+    }
+    game.history = &history;
+
+    // Keys pressed after the last step still count, so apply them first
+    while (1) {
+        uint64_t start = bench_now_ns();
+        char key;
+        while ((key = replay_key(&replay, game.ticks))) {
+            apply_key(&game, key);
+        }
+        if (game.ticks >= replay_end_tick(&replay)) break;
+        step_game(&game);
+        bench_sample(&run, start);
+    }
+    bench_end(&run);
+
+    char label[64];
+    snprintf(label, sizeof(label), "snake replay %dx%d", game.grid_rows, game.grid_cols);
+    bench_report(&run, stdout, label);
+    printf("Final score %d, length %d after %llu ticks\n",
+           game.score, game.snake_length, (unsigned long long)game.ticks);
+
+    int status = 0;
+    if (!replay.has_footer) {
+        printf("Replay has no footer (session did not exit cleanly), state not verified\n");
+    } else if (state_hash(&game) == replay.footer.state_hash) {
+        printf("Final state matches the recording\n");
+    } else {
+        printf("Final state DIFFERS from the recording\n");
+        status = 1;
+    }
+    replay_close(&replay);
+    free_game(&game);
+    rewind_free(&history);
+    return status;
+}
+
+// Step an all-AI battle for a fixed number of ticks and report its speed
+void run_battle_headless(int rows, int cols, int count, long ticks, uint64_t seed) {
+    Battle b;
+    BenchRun run;
+    uint64_t alive_sum = 0;
+
+    if (!battle_init(&b, rows, cols, count, seed) || bench_begin(&run, ticks) < 0) {
+        fprintf(stderr, "Not enough memory for %d snakes on a %dx%d arena\n", count, rows, cols);
+        battle_free(&b);
+        return;
+    }
+    battle_reset(&b);
+    for (long t = 0; t < ticks; t++) {
+        uint64_t start = bench_now_ns();
+        battle_step(&b);
+        bench_sample(&run, start);
+        alive_sum += b.alive_count;
+    }
+    bench_end(&run);
+
+    int longest = 0;
+    for (int i = 0; i < b.count; i++) {
+        if (b.alive[i] && b.length[i] > longest) longest = b.length[i];
+    }
+    char label[64];
+    snprintf(label, sizeof(label), "battle %dx%d %d", rows, cols, count);
+    bench_report(&run, stdout, label);
+    printf("%-24s %.1f alive on average, %llu deaths (%llu head-on), %llu food eaten, longest %d, "
+           "state %016llx\n", "", (double)alive_sum / ticks, (unsigned long long)b.deaths,
+           (unsigned long long)b.head_on, (unsigned long long)b.eaten, longest,
+           (unsigned long long)battle_hash(&b));
+    battle_free(&b);
+}
+
+// Render the part of the battle around the player's snake, which is drawn
+// like the single game's; the others have BATTLE_HEAD_OTHER heads
+void draw_battle(Battle *b, Snake *view, Renderer *screen) {
+    int me = b->player;
+    view->head_cell = b->hx[me] * b->cols + b->hy[me]; // Where it died while it is out
+    follow_head(view);
+    render_clear(screen);
+    for (int i = 0; i < view->view_rows && view->view_top + i < b->rows; i++) {
+        int x = view->view_top + i;
+        for (int j = 0; j < view->view_cols && view->view_left + j < b->cols; j++) {
+            int y = view->view_left + j;
+            uint16_t o = b->owner[x * b->cols + y];
+            char c = EMPTY_CELL;
+            if (o == BATTLE_FOOD) {
+                c = BAIT;
+            } else if (o != BATTLE_EMPTY) {
+                int head = b->hx[o - 1] == x && b->hy[o - 1] == y;
+                c = o - 1 == me ? (head ? SNAKE_HEAD : SNAKE_BODY)
+                                : (head ? BATTLE_HEAD_OTHER : BATTLE_BODY_OTHER);
+            }
+            render_put(screen, i, j * 2, c);
+        }
+    }
+
+    int rank = 1;
+    for (int i = 0; i < b->count; i++) {
+        rank += b->alive[i] && b->length[i] > b->length[me];
+    }
+    if (b->alive[me]) {
+        render_text(screen, view->view_rows, 0, "Length: %d   Kills: %d   Rank %d of %d alive",
+                    b->length[me], b->kills[me], rank, b->alive_count);
+    } else {
+        render_text(screen, view->view_rows, 0, "You died! Back in %d ticks.   Kills: %d",
+                    b->respawn[me] > 0 ? b->respawn[me] : 0, b->kills[me]);
+    }
+    render_text(screen, view->view_rows + 1, 0, "Use 'w', 'a', 's', 'd' to move. Press 'q' to quit.");
+    render_text(screen, view->view_rows + 2, 0, "%d snakes on %dx%d, %llu deaths, %llu head-on",
+                b->count, b->rows, b->cols, (unsigned long long)b->deaths,
+                (unsigned long long)b->head_on);
+}
+
+// Play battle mode as snake 0 until 'q' or a signal
+int play_battle(int rows, int cols, int count, uint64_t seed) {
+    static const char keys[4] = {'w', 'a', 's', 'd'}; // In direction order
+    Battle b;
+    struct winsize ws;
+    int term_rows = 24, term_cols = 80, best = 0;
+
+    if (!battle_init(&b, rows, cols, count, seed)) {
+        fprintf(stderr, "Not enough memory for %d snakes on a %dx%d arena\n", count, rows, cols);
+        battle_free(&b);
+        return 1;
+    }
+    b.player = 0;
+    battle_reset(&b);
+
+    // The viewport scrolls with the player as in the single game
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        term_rows = ws.ws_row;
+        term_cols = ws.ws_col;
+    }
+    fit_view(&game, term_rows, term_cols);
+
+    setup_terminal();
+    int screen_width = game.view_cols * 2 > 52 ? game.view_cols * 2 : 52;
+    if (render_init(&screen, screen_width, game.view_rows + 3) < 0 || loop_init(&loop, TICK_NS) < 0) {
+        reset_terminal();
+        fprintf(stderr, "Failed to set up the screen and timer\n");
+        battle_free(&b);
+        return 1;
+    }
+    render_thread_start(&presenter, &screen);
+    telemetry_open(&telemetry, "snake", TICK_NS);
+    have_scores = scores_open(&scores) == 0;
+
+    draw_battle(&b, &game, &screen);
+    render_thread_publish(&presenter, &screen);
+    while (running) {
+        LoopEvents events;
+        if (loop_wait(&loop, &events) < 0 || events.signal) break;
+        if (events.resumed) render_thread_invalidate(&presenter, &screen);
+        for (int i = 0; i < events.keys; i++) {
+            if (events.key[i] == 'q') running = 0;
+            for (int dir = 0; dir < 4; dir++) {
+                if (events.key[i] == keys[dir]) battle_turn(&b, dir);
+            }
+        }
+        for (int i = 0; i < events.ticks && running; i++) {
+            battle_step(&b);
+            if (b.alive[0] && b.length[0] > best) best = b.length[0];
+        }
+        if (!running) break;
+        draw_battle(&b, &game, &screen);
+        render_thread_publish(&presenter, &screen);
+        uint64_t frame_ns = loop_frame_done(&loop);
+        telemetry_frame(&telemetry, &loop, render_thread_stats(&presenter, &screen), events.keys,
+                        b.alive[0] ? b.length[0] : 0, frame_ns);
+    }
+
+    reset_terminal();
+    loop_close(&loop);
+    // Lengths get a board of their own, apart from the bait counts of the
+    // single game, and a snake that never ate has nothing to show
+    if (have_scores && best > 1 + BATTLE_SPAWN_GROWTH) scores_add(&scores, BATTLE_SCORES_NAME, best);
+    scores_close(&scores);
+    printf("\nBattle over! Longest snake: %d, kills: %d\n", best, b.kills[0]);
+    battle_free(&b);
     return 0;
 }
 
@@ -231,29 +1547,135 @@ void setup_terminal() {
 
 // Restore the original terminal settings
 void reset_terminal() {
+    render_thread_stop(&presenter, &screen);
+    render_shutdown(&screen);
     tcsetattr(STDIN_FILENO, TCSANOW, &orig_termios);
+    loop_dump(&loop);
+    telemetry_close(&telemetry);
 }
 
-// Handle signals like Ctrl+C
-void handle_signal(int sig) {
-    reset_terminal();
-    printf("\nGame over! Final score: %d\n", score);
-    exit(0);
+#else
+
+// Plugin entry points, see plugin.h. The grid size comes from SNAKE_GRID as
+// it does for the standalone binary.
+
+// Agent observation: the cells around the head (OBS_EMPTY etc.), then the
+// last move and the bait's offset from the head as signed bytes
+#define OBS_RADIUS 5
+#define OBS_SIDE (2 * OBS_RADIUS + 1)
+#define OBS_SIZE (OBS_SIDE * OBS_SIDE + 3)
+#define OBS_EMPTY 0
+#define OBS_BODY  1
+#define OBS_BAIT  2
+#define OBS_WALL  3
+
+static int plugin_init(void *state, int term_rows, int term_cols, uint64_t seed) {
+    Snake *s = state;
+    const char *size = getenv("SNAKE_GRID");
+    s->grid_rows = s->grid_cols = DEFAULT_GRID_SIZE;
+    if (size && !parse_grid_size(size, &s->grid_rows, &s->grid_cols)) {
+        s->grid_rows = s->grid_cols = DEFAULT_GRID_SIZE;
+    }
+    rng_seed(&s->rng, seed);
+    fit_view(s, term_rows, term_cols);
+    if (!init_game(s)) {
+        free_game(s);
+        return 0;
+    }
+    return 1;
+}
+
+static int plugin_input(void *state, char key) {
+    Snake *s = state;
+    if (key == 'q') return 0;
+    if (key == 'p') {
+        s->autopilot = autopilot_init(s);
+    } else if (key == 'w' || key == 'a' || key == 's' || key == 'd') {
+        s->autopilot = 0;
+    }
+    handle_key(s, key);
+    return 1;
+}
+
+static void plugin_tick(void *state) {
+    Snake *s = state;
+    if (s->autopilot && !s->paused) handle_key(s, autopilot_key(s));
+    step_game(s);
 }
 
-// Check if a key has been pressed
-int kbhit() {
-    struct timeval tv = {0, 0};
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(STDIN_FILENO, &fds);
-    return select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv);
+static void plugin_render(void *state, Renderer *screen) {
+    draw_grid(state, screen);
 }
 
-// Get a single character from input
-char getch() {
-    char buf = 0;
-    read(STDIN_FILENO, &buf, 1);
-    return buf;
+static int plugin_active(void *state) {
+    Snake *s = state;
+    return !s->paused && !s->cleared;
 }
 
+static void plugin_shutdown(void *state) {
+    free_game(state);
+}
+
+static void plugin_observe(void *state, uint8_t *obs) {
+    Snake *s = state;
+    int head_x = s->head_cell / s->grid_cols;
+    int head_y = s->head_cell % s->grid_cols;
+    for (int i = 0; i < OBS_SIDE; i++) {
+        int x = head_x + i - OBS_RADIUS;
+        for (int j = 0; j < OBS_SIDE; j++) {
+            int y = head_y + j - OBS_RADIUS;
+            uint8_t cell = OBS_EMPTY;
+            if (x < 0 || x >= s->grid_rows || y < 0 || y >= s->grid_cols) {
+                cell = OBS_WALL;
+            } else if (is_occupied(s, CELL(x, y))) {
+                cell = OBS_BODY;
+            } else if (x == s->bait_x && y == s->bait_y) {
+                cell = OBS_BAIT;
+            }
+            *obs++ = cell;
+        }
+    }
+    int dx = s->bait_x < 0 ? 0 : s->bait_x - head_x;
+    int dy = s->bait_y < 0 ? 0 : s->bait_y - head_y;
+    obs[0] = s->last_move;
+    obs[1] = (int8_t)(dx < -127 ? -127 : dx > 127 ? 127 : dx);
+    obs[2] = (int8_t)(dy < -127 ? -127 : dy > 127 ? 127 : dy);
+}
+
+static int64_t plugin_score(void *state) {
+    return ((Snake *)state)->score;
+}
+
+// A collision ends the episode rather than waiting for a key to resume
+static int plugin_done(void *state) {
+    Snake *s = state;
+    return s->paused || s->cleared;
+}
+
+static void plugin_reset(void *state) {
+    Snake *s = state;
+    reset_game(s);
+    s->paused = 0;
+}
+
+const AtarPlugin atar_plugin = {
+    .abi = ATAR_PLUGIN_ABI,
+    .state_version = 3,
+    .state_size = sizeof(Snake),
+    .tick_ns = TICK_NS,
+    .name = "snake",
+    .init = plugin_init,
+    .input = plugin_input,
+    .tick = plugin_tick,
+    .render = plugin_render,
+    .active = plugin_active,
+    .shutdown = plugin_shutdown,
+    .actions = "wasd",
+    .obs_size = OBS_SIZE,
+    .observe = plugin_observe,
+    .score = plugin_score,
+    .done = plugin_done,
+    .reset = plugin_reset,
+};
+
+#endif
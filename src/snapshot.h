@@ -0,0 +1,149 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "storage.h"
+#include "replay.h"
+
+// Save states in the storage directory (see storage.h), one NAME.snap per
+// game, so a game that is quit picks up where it left off next time.
+//
+// A snapshot is a header followed by sections, the game's raw state: its
+// state struct and the arrays it points to, exactly as they are in memory.
+// Every section starts on a page boundary, so resuming maps the file
+// privately and the game points its arrays straight into the mapping,
+// copy-on-write, with nothing to parse or copy. The header is checksummed
+// and names the game and the version of its state layout; a snapshot
+// from another build or another game is ignored. Saving writes the whole
+// file anew and renames it over the old one, so a crash leaves either the
+// old snapshot or the new one. Pages of zeros, most of a big arena with a
+// short snake, are left as holes in the file rather than written.
+
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MAX_SECTIONS 8
+#define SNAPSHOT_ALIGN STORAGE_PAGE
+
+typedef struct {
+    char magic[4];                 // "ATSN"
+    uint32_t version;              // SNAPSHOT_VERSION
+    char game[8];                  // Game name, NUL padded
+    uint32_t state_version;        // The game's own layout version
+    uint32_t count;                // Sections in use
+    uint64_t size;                 // Bytes in the whole file
+    uint64_t offset[SNAPSHOT_MAX_SECTIONS];
+    uint64_t length[SNAPSHOT_MAX_SECTIONS];
+    uint64_t checksum;             // Of everything above
+} SnapshotHeader;
+
+typedef struct {
+    uint8_t *map;                  // Private, writable mapping of the file
+    size_t size;
+    const SnapshotHeader *header;
+} Snapshot;
+
+static inline uint64_t snapshot_checksum(const SnapshotHeader *h) {
+    return replay_hash(REPLAY_HASH_INIT, h, offsetof(SnapshotHeader, checksum));
+}
+
+// Save sections as snapshot name of game, returns -1 and keeps the old
+// snapshot on failure
+static inline int snapshot_save(const char *name, const char *game, uint32_t state_version,
+                                const struct iovec *sections, int count) {
+    static const uint8_t padding[SNAPSHOT_ALIGN];
+    struct iovec parts[2 * SNAPSHOT_MAX_SECTIONS + 1];
+    char file[64];
+    SnapshotHeader header;
+    int n = 0;
+
+    if (count > SNAPSHOT_MAX_SECTIONS) return -1;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "ATSN", 4);
+    header.version = SNAPSHOT_VERSION;
+    memcpy(header.game, game, strnlen(game, sizeof(header.game)));
+    header.state_version = state_version;
+    header.count = count;
+    parts[n++] = (struct iovec){&header, sizeof(header)};
+    uint64_t offset = sizeof(header);
+    for (int i = 0; i < count; i++) {
+        uint64_t aligned = (offset + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+        if (aligned > offset) parts[n++] = (struct iovec){(void *)padding, aligned - offset};
+        parts[n++] = sections[i];
+        header.offset[i] = aligned;
+        header.length[i] = sections[i].iov_len;
+        offset = aligned + sections[i].iov_len;
+    }
+    header.size = offset;
+    header.checksum = snapshot_checksum(&header);
+    snprintf(file, sizeof(file), "%s.snap", name);
+    return storage_replace_with(file, parts, n, 1);
+}
+
+// Map snapshot name of game, returns -1 if there is none or it is from a
+// different layout
+static inline int snapshot_open(Snapshot *snap, const char *name, const char *game,
+                                uint32_t state_version) {
+    char file[64], path[STORAGE_PATH_MAX];
+    struct stat st;
+
+    memset(snap, 0, sizeof(*snap));
+    snprintf(file, sizeof(file), "%s.snap", name);
+    if (storage_path(path, sizeof(path), file) < 0) return -1;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const SnapshotHeader *h = map;
+    int ok = memcmp(h->magic, "ATSN", 4) == 0 && h->version == SNAPSHOT_VERSION &&
+             h->checksum == snapshot_checksum(h) && h->size == (uint64_t)st.st_size &&
+             strncmp(h->game, game, sizeof(h->game)) == 0 && h->state_version == state_version &&
+             h->count <= SNAPSHOT_MAX_SECTIONS;
+    for (uint32_t i = 0; ok && i < h->count; i++) {
+        ok = h->offset[i] % SNAPSHOT_ALIGN == 0 && h->offset[i] + h->length[i] <= h->size;
+    }
+    if (!ok) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    snap->map = map;
+    snap->size = st.st_size;
+    snap->header = h;
+    return 0;
+}
+
+// Section i if it holds exactly length bytes, NULL otherwise
+static inline void *snapshot_section(const Snapshot *snap, uint32_t i, uint64_t length) {
+    if (i >= snap->header->count || snap->header->length[i] != length) return NULL;
+    return snap->map + snap->header->offset[i];
+}
+
+// Unmap a snapshot whose sections are no longer in use
+static inline void snapshot_close(Snapshot *snap) {
+    if (snap->map) munmap(snap->map, snap->size);
+    memset(snap, 0, sizeof(*snap));
+}
+
+// Forget the saved game, after it has ended
+static inline void snapshot_remove(const char *name) {
+    char file[64], path[STORAGE_PATH_MAX];
+    snprintf(file, sizeof(file), "%s.snap", name);
+    if (storage_path(path, sizeof(path), file) == 0 && unlink(path) == 0) {
+        storage_sync_dir();
+    }
+}
+
+#endif
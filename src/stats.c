@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "bench.h"
+#include "telemetry.h"
+
+// Telemetry dumper: prints the live counters the games publish in shared
+// memory (see telemetry.h), for every game that has run since boot or the
+// ones named. --metrics prints them one per line in the Prometheus text
+// format for scraping instead. --bench N times N frame updates alone and
+// with a reader copying the counters the whole time, and checks that no
+// copy taken as whole ever mixes two frames.
+//
+//   cc -O2 -pthread -o atar_stats src/stats.c
+//   ./atar_stats --metrics snake
+
+#define SHM_DIR "/dev/shm"         // Where Linux keeps the shm_open() names
+#define BENCH_GAME "stats-bench"
+
+// Print one game's counters as metrics, labelled with its name
+void print_metrics(const TelemetrySegment *s) {
+    const TelemetryCounters *c = &s->counters;
+    const struct {
+        const char *name;
+        uint64_t value;
+    } metrics[] = {
+        {"running", (uint64_t)telemetry_alive(s)},
+        {"uptime_ns", (telemetry_alive(s) ? loop_now_ns() : c->updated_ns) - c->started_ns},
+        {"ticks", c->ticks},
+        {"dropped_ticks", c->dropped_ticks},
+        {"frames", c->frames},
+        {"render_frames", c->render_frames},
+        {"render_bytes", c->render_bytes},
+        {"render_writes", c->render_writes},
+        {"loop_syscalls", c->loop_syscalls},
+        {"keys", c->keys},
+        {"input_depth", c->input_depth},
+        {"input_depth_max", c->input_depth_max},
+        {"frame_max_ns", c->frame_max_ns},
+    };
+    for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); i++) {
+        printf("atar_%s{game=\"%s\"} %llu\n", metrics[i].name, s->game,
+               (unsigned long long)metrics[i].value);
+    }
+    printf("atar_score{game=\"%s\"} %lld\n", s->game, (long long)c->score);
+
+    // Cumulative buckets, upper bounds in seconds as Prometheus wants them
+    uint64_t total = 0;
+    for (int i = 0; i < LOOP_BUCKETS; i++) {
+        total += c->frame_us[i];
+        if (i + 1 < LOOP_BUCKETS) {
+            printf("atar_frame_seconds_bucket{game=\"%s\",le=\"%g\"} %llu\n", s->game,
+                   (1ull << i) / 1e6, (unsigned long long)total);
+        }
+    }
+    printf("atar_frame_seconds_bucket{game=\"%s\",le=\"+Inf\"} %llu\n", s->game,
+           (unsigned long long)total);
+    printf("atar_frame_seconds_count{game=\"%s\"} %llu\n", s->game, (unsigned long long)total);
+}
+
+// Print one game's counters, returns -1 if it has none
+int dump(const char *game, int metrics) {
+    TelemetrySegment s;
+    if (telemetry_read(game, &s) < 0) return -1;
+    if (metrics) {
+        print_metrics(&s);
+    } else {
+        telemetry_print(&s, stdout);
+    }
+    return 0;
+}
+
+// Every game with a segment
+int dump_all(int metrics) {
+    const char *prefix = TELEMETRY_PREFIX + 1; // Names in SHM_DIR lose the slash
+    DIR *dir = opendir(SHM_DIR);
+    struct dirent *entry;
+    int found = 0;
+
+    if (!dir) return 0;
+    while ((entry = readdir(dir))) {
+        if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0) continue;
+        const char *game = entry->d_name + strlen(prefix);
+        if (strcmp(game, BENCH_GAME) == 0) continue;
+        if (found && !metrics) printf("\n");
+        if (dump(game, metrics) == 0) found++;
+    }
+    closedir(dir);
+    return found;
+}
+
+typedef struct {
+    const TelemetrySegment *segment;
+    int stop;
+    uint64_t copies;
+    uint64_t torn;             // Copies whose counters came from different frames
+    uint64_t settled;          // Copies telemetry_copy() reported as torn itself
+} BenchReader;
+
+// Copy the counters as fast as possible. The bench writer sets them all
+// from the same frame number, so any disagreement is a torn copy.
+void *bench_reader(void *arg) {
+    BenchReader *r = arg;
+    TelemetrySegment s;
+    while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+        int status = telemetry_copy(r->segment, &s);
+        if (status < 0) continue;
+        if (status == TELEMETRY_TORN) {
+            r->settled++;
+            continue;
+        }
+        const TelemetryCounters *c = &s.counters;
+        uint64_t frame = c->frames;
+        if (c->ticks != frame || c->render_bytes != frame * 100 || c->loop_syscalls != frame * 3 ||
+            c->keys != frame || (uint64_t)c->score != frame) {
+            r->torn++;
+        }
+        r->copies++;
+    }
+    return NULL;
+}
+
+// Publish count frames, returns the nanoseconds it took
+uint64_t bench_frames(Telemetry *t, GameLoop *loop, long count) {
+    RenderStats render;
+    memset(&render, 0, sizeof(render));
+    uint64_t start = bench_now_ns();
+    for (long i = 0; i < count; i++) {
+        loop->ticks++;
+        loop->frame.samples++;
+        loop->frame.count[0]++;
+        loop->syscalls += 3;
+        render.frames++;
+        render.bytes += 100;
+        render.writes++;
+        telemetry_frame(t, loop, render, 1, loop->ticks, 0);
+    }
+    return bench_now_ns() - start;
+}
+
+int run_bench(long count) {
+    Telemetry t;
+    GameLoop loop;
+    BenchReader reader = {0};
+    pthread_t thread;
+
+    if (telemetry_open(&t, BENCH_GAME, 1) < 0) {
+        fprintf(stderr, "Cannot create the telemetry segment in %s\n", SHM_DIR);
+        return 1;
+    }
+    memset(&loop, 0, sizeof(loop));
+    uint64_t alone_ns = bench_frames(&t, &loop, count);
+
+    // Start over so the frame numbers line up with the counters again
+    telemetry_close(&t);
+    telemetry_open(&t, BENCH_GAME, 1);
+    memset(&loop, 0, sizeof(loop));
+    reader.segment = telemetry_map(BENCH_GAME);
+    if (!reader.segment || pthread_create(&thread, NULL, bench_reader, &reader) != 0) {
+        telemetry_close(&t);
+        return 1;
+    }
+    uint64_t contended_ns = bench_frames(&t, &loop, count);
+    __atomic_store_n(&reader.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+    telemetry_unmap(reader.segment);
+    telemetry_close(&t);
+
+    char path[TELEMETRY_NAME_MAX + sizeof(TELEMETRY_PREFIX)];
+    telemetry_path(path, sizeof(path), BENCH_GAME);
+    shm_unlink(path);
+
+    printf("telemetry: %ld frames published, %.1f ns/frame alone, %.1f ns/frame with a reader\n",
+           count, (double)alone_ns / count, (double)contended_ns / count);
+    printf("telemetry: reader copied the counters %llu times (%.0f ns/copy), %llu torn, "
+           "%llu gave up\n", (unsigned long long)reader.copies,
+           reader.copies ? (double)contended_ns / reader.copies : 0.0,
+           (unsigned long long)reader.torn, (unsigned long long)reader.settled);
+    return reader.torn ? 1 : 0;
+}
+
+// Print the command-line help
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--metrics] [GAME...]\n"
+                    "       %s --bench N\n"
+                    "Shows the live counters of the games, all of them or the ones named,\n"
+                    "or times N updates of a scratch segment.\n",
+            program, program);
+}
+
+int main(int argc, char *argv[]) {
+    int metrics = 0, games = 0, missing = 0;
+    long bench = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--metrics") == 0) {
+            metrics = 1;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (bench > 0) return run_bench(bench);
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') continue;
+        if (games++ && !metrics) printf("\n");
+        if (dump(argv[i], metrics) < 0) {
+            fprintf(stderr, "No counters for %s\n", argv[i]);
+            missing = 1;
+        }
+    }
+    if (games) return missing;
+    if (dump_all(metrics) == 0) {
+        fprintf(stderr, "No game has published counters yet\n");
+        return 1;
+    }
+    return 0;
+}
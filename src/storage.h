@@ -0,0 +1,102 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// Persistent storage on the volume initialize.sh creates and startup.sh
+// mounts at ./mount; ATAR_STORAGE names another directory. If the
+// directory doesn't exist nothing is saved and the games run as before.
+//
+// Files are replaced atomically: the new contents go to a temporary file
+// that is synced and renamed over the old one, then the directory is
+// synced so the rename itself survives a power cut.
+
+#define STORAGE_ENV "ATAR_STORAGE"
+#define STORAGE_DEFAULT "mount"
+#define STORAGE_PATH_MAX 256
+#define STORAGE_PAGE 4096
+
+static inline const char *storage_dir() {
+    const char *dir = getenv(STORAGE_ENV);
+    return dir && *dir ? dir : STORAGE_DEFAULT;
+}
+
+// Path of a file in the storage directory, returns -1 if there is none
+static inline int storage_path(char *path, size_t size, const char *name) {
+    struct stat st;
+    const char *dir = storage_dir();
+    if (stat(dir, &st) < 0 || !S_ISDIR(st.st_mode)) return -1;
+    int len = snprintf(path, size, "%s/%s", dir, name);
+    return len < 0 || (size_t)len >= size ? -1 : 0;
+}
+
+// Make file creations and renames in the storage directory durable
+static inline int storage_sync_dir() {
+    int fd = open(storage_dir(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    int status = fsync(fd);
+    close(fd);
+    return status;
+}
+
+// Write the buffers one after another to fd. With sparse set, whole pages
+// of zeros are skipped rather than written and read back as zeros from the
+// holes they leave, so a large, mostly empty file costs only its data.
+static inline int storage_write(int fd, const struct iovec *parts, int count, int sparse) {
+    static const char zeros[STORAGE_PAGE];
+    off_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        const char *data = parts[i].iov_base;
+        size_t left = parts[i].iov_len;
+        while (left > 0) {
+            // Up to the next page boundary, so skipped runs are whole pages
+            size_t chunk = STORAGE_PAGE - offset % STORAGE_PAGE;
+            if (chunk > left) chunk = left;
+            if (sparse && chunk == STORAGE_PAGE && memcmp(data, zeros, chunk) == 0) {
+                offset += chunk;
+                data += chunk;
+                left -= chunk;
+                continue;
+            }
+            ssize_t n = pwrite(fd, data, chunk, offset);
+            if (n <= 0) return -1;
+            offset += n;
+            data += n;
+            left -= n;
+        }
+    }
+    return sparse ? ftruncate(fd, offset) : 0; // A trailing hole still counts
+}
+
+// Replace the file with the concatenation of the buffers, all or nothing.
+// Returns -1 and leaves the old file in place on failure.
+static inline int storage_replace_with(const char *name, const struct iovec *parts, int count,
+                                       int sparse) {
+    char path[STORAGE_PATH_MAX], temp[STORAGE_PATH_MAX + 8];
+    if (storage_path(path, sizeof(path), name) < 0) return -1;
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    int ok = storage_write(fd, parts, count, sparse) == 0;
+    ok = ok && fdatasync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temp, path) < 0) {
+        unlink(temp);
+        return -1;
+    }
+    storage_sync_dir();
+    return 0;
+}
+
+static inline int storage_replace(const char *name, const struct iovec *parts, int count) {
+    return storage_replace_with(name, parts, count, 0);
+}
+
+#endif
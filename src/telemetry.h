@@ -0,0 +1,289 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "loop.h"
+#include "render.h"
+
+// Live counters of a running game in a POSIX shared-memory segment,
+// TELEMETRY_PREFIX plus the game's name ("/atar-snake", i.e.
+// /dev/shm/atar-snake), for the menu's Stats screen and the atar_stats
+// tool (src/stats.c) to read while the game plays or after it has exited.
+//
+// The game is the only writer: it holds a lock on the segment for as long
+// as it runs, and a second copy of the same game just plays without
+// telemetry. Once per frame it updates the counters in place under a
+// sequence lock: the sequence number goes odd, the counters are written
+// with relaxed stores, and it goes even again. Readers copy the counters
+// and retry if the sequence number was odd or changed meanwhile, so the
+// game never waits for them and they never see half a frame's update
+// unless they are told so.
+// Everything is a 64-bit word so each one is copied whole.
+//
+// The segment is left in place when the game exits, holding its last
+// counters, and reused by the next run of the same game.
+
+#define TELEMETRY_PREFIX "/atar-"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_NAME_MAX 16
+#define TELEMETRY_RETRIES 10000 // Copies tried before settling for a torn one
+#define TELEMETRY_TORN 1        // telemetry_copy() settled for a torn copy
+
+typedef struct {
+    uint64_t pid;
+    uint64_t tick_ns;              // Simulation timestep
+    uint64_t started_ns;           // CLOCK_MONOTONIC when the game started
+    uint64_t updated_ns;           // End of the last frame, or when the game exited
+    uint64_t running;              // Cleared when the game exits
+    uint64_t ticks;                // Simulation ticks run
+    uint64_t dropped_ticks;        // Ticks skipped because the game fell behind
+    uint64_t frames;               // Frames drawn
+    uint64_t render_frames;        // Frames that reached the terminal
+    uint64_t render_bytes;         // Bytes written to the terminal
+    uint64_t render_writes;        // write() calls doing it
+    uint64_t loop_syscalls;        // poll(), read() and timer calls of the loop
+    uint64_t keys;                 // Keys read
+    uint64_t input_depth;          // Keys waiting when the last frame started
+    uint64_t input_depth_max;
+    int64_t score;
+    uint64_t frame_max_ns;         // Longest frame
+    uint64_t frame_us[LOOP_BUCKETS]; // Update plus render time, buckets as in loop.h
+} TelemetryCounters;
+
+typedef struct {
+    char magic[4];                 // "ATTM"
+    uint32_t version;
+    char game[TELEMETRY_NAME_MAX];
+    uint32_t seq;                  // Odd while the counters are being updated
+    uint32_t reserved;
+    TelemetryCounters counters;
+} TelemetrySegment;
+
+// Writer side, owned by the game
+typedef struct {
+    TelemetrySegment *segment;     // NULL if the game runs without telemetry
+    int fd;
+    uint32_t seq;
+} Telemetry;
+
+static inline void telemetry_path(char *path, size_t size, const char *game) {
+    snprintf(path, size, "%s%s", TELEMETRY_PREFIX, game);
+}
+
+static inline void telemetry_store(uint64_t *field, uint64_t value) {
+    __atomic_store_n(field, value, __ATOMIC_RELAXED);
+}
+
+static inline void telemetry_begin(Telemetry *t) {
+    __atomic_store_n(&t->segment->seq, ++t->seq, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void telemetry_end(Telemetry *t) {
+    __atomic_store_n(&t->segment->seq, ++t->seq, __ATOMIC_RELEASE);
+}
+
+// Create or take over the game's segment and zero its counters. Returns
+// -1, leaving the game to run without telemetry, if there is no shared
+// memory or another copy of the game holds the segment.
+static inline int telemetry_open(Telemetry *t, const char *game, uint64_t tick_ns) {
+    char path[TELEMETRY_NAME_MAX + sizeof(TELEMETRY_PREFIX)];
+    memset(t, 0, sizeof(*t));
+    t->fd = -1;
+    if (strlen(game) >= TELEMETRY_NAME_MAX) return -1;
+    telemetry_path(path, sizeof(path), game);
+
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0 || ftruncate(fd, sizeof(TelemetrySegment)) < 0) {
+        close(fd);
+        return -1;
+    }
+    TelemetrySegment *s = mmap(NULL, sizeof(*s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (s == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    t->segment = s;
+    t->fd = fd;
+
+    // A game that died mid-update left the sequence odd; readers keep
+    // retrying until the first update here ends it
+    t->seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED) & ~1u;
+    telemetry_begin(t);
+    memcpy(s->magic, "ATTM", 4);
+    s->version = TELEMETRY_VERSION;
+    snprintf(s->game, sizeof(s->game), "%s", game);
+    uint64_t *words = (uint64_t *)&s->counters;
+    for (size_t i = 0; i < sizeof(s->counters) / sizeof(uint64_t); i++) {
+        telemetry_store(&words[i], 0);
+    }
+    telemetry_store(&s->counters.pid, getpid());
+    telemetry_store(&s->counters.tick_ns, tick_ns);
+    telemetry_store(&s->counters.started_ns, loop_now_ns());
+    telemetry_store(&s->counters.updated_ns, loop_now_ns());
+    telemetry_store(&s->counters.running, 1);
+    telemetry_end(t);
+    return 0;
+}
+
+// Publish a finished frame: what the loop and the renderer have counted so
+// far, the keys this frame handled, the score, and frame_ns from
+// loop_frame_done(). Only the counters that change are stored.
+static inline void telemetry_frame(Telemetry *t, const GameLoop *loop, RenderStats render,
+                                   int keys, int64_t score, uint64_t frame_ns) {
+    if (!t->segment) return;
+    TelemetryCounters *c = &t->segment->counters;
+    int bucket = loop_hist_bucket(frame_ns);
+    telemetry_begin(t);
+    telemetry_store(&c->updated_ns, loop->wake + frame_ns);
+    telemetry_store(&c->ticks, loop->ticks);
+    telemetry_store(&c->dropped_ticks, loop->dropped);
+    telemetry_store(&c->frames, loop->frame.samples);
+    telemetry_store(&c->render_frames, render.frames);
+    telemetry_store(&c->render_bytes, render.bytes);
+    telemetry_store(&c->render_writes, render.writes);
+    telemetry_store(&c->loop_syscalls, loop->syscalls);
+    telemetry_store(&c->frame_us[bucket], loop->frame.count[bucket]);
+    if (loop->frame.max_ns != c->frame_max_ns) telemetry_store(&c->frame_max_ns, loop->frame.max_ns);
+    if (keys) {
+        telemetry_store(&c->keys, c->keys + keys);
+        if ((uint64_t)keys > c->input_depth_max) telemetry_store(&c->input_depth_max, keys);
+    }
+    telemetry_store(&c->input_depth, keys);
+    telemetry_store((uint64_t *)&c->score, score);
+    telemetry_end(t);
+}
+
+// Mark the game as exited and let go of the segment, which keeps the last
+// counters for readers
+static inline void telemetry_close(Telemetry *t) {
+    if (!t->segment) return;
+    telemetry_begin(t);
+    telemetry_store(&t->segment->counters.updated_ns, loop_now_ns());
+    telemetry_store(&t->segment->counters.running, 0);
+    telemetry_end(t);
+    munmap(t->segment, sizeof(*t->segment));
+    close(t->fd);
+    t->segment = NULL;
+    t->fd = -1;
+}
+
+// Map a game's segment for reading, NULL if it has none
+static inline const TelemetrySegment *telemetry_map(const char *game) {
+    char path[TELEMETRY_NAME_MAX + sizeof(TELEMETRY_PREFIX)];
+    struct stat st;
+    if (strlen(game) >= TELEMETRY_NAME_MAX) return NULL;
+    telemetry_path(path, sizeof(path), game);
+    int fd = shm_open(path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0 || st.st_size != sizeof(TelemetrySegment)) {
+        close(fd);
+        return NULL;
+    }
+    TelemetrySegment *s = mmap(NULL, sizeof(*s), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return s == MAP_FAILED ? NULL : s;
+}
+
+static inline void telemetry_unmap(const TelemetrySegment *s) {
+    munmap((void *)s, sizeof(*s));
+}
+
+// Copy the latest counters out of a mapped segment. Returns -1 if it is
+// not one this build can read, and TELEMETRY_TORN if the copy may mix two
+// frames. That happens when the tries run out and the last one copies
+// whatever is there: the game died halfway through an update, or kept
+// updating faster than the counters could be copied.
+static inline int telemetry_copy(const TelemetrySegment *s, TelemetrySegment *out) {
+    const uint64_t *from = (const uint64_t *)&s->counters;
+    uint64_t *to = (uint64_t *)&out->counters;
+    int status = 0;
+    for (int tries = 1;; tries++) {
+        int last = tries == TELEMETRY_RETRIES;
+        uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1) && !last) {
+            sched_yield(); // Let the game finish the update if we share its core
+            continue;
+        }
+        memcpy(out, s, offsetof(TelemetrySegment, counters));
+        for (size_t i = 0; i < sizeof(s->counters) / sizeof(uint64_t); i++) {
+            to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq && !(seq & 1)) break;
+        if (last) {
+            status = TELEMETRY_TORN;
+            break;
+        }
+    }
+    out->game[TELEMETRY_NAME_MAX - 1] = '\0';
+    if (memcmp(out->magic, "ATTM", 4) != 0 || out->version != TELEMETRY_VERSION) return -1;
+    return status;
+}
+
+// Copy a game's latest counters into out. Returns -1 if the game has no
+// segment, or one this build can't read, and TELEMETRY_TORN as
+// telemetry_copy() does.
+static inline int telemetry_read(const char *game, TelemetrySegment *out) {
+    const TelemetrySegment *s = telemetry_map(game);
+    if (!s) return -1;
+    int status = telemetry_copy(s, out);
+    telemetry_unmap(s);
+    return status;
+}
+
+// Whether the game that wrote the counters is still running. A game
+// killed before it could clear running is caught by its pid.
+static inline int telemetry_alive(const TelemetrySegment *s) {
+    return s->counters.running && (kill((pid_t)s->counters.pid, 0) == 0 || errno == EPERM);
+}
+
+// Print the counters for people, as the menu's Stats screen shows them
+static inline void telemetry_print(const TelemetrySegment *s, FILE *f) {
+    const TelemetryCounters *c = &s->counters;
+    int alive = telemetry_alive(s);
+    uint64_t now = loop_now_ns(), end = alive ? now : c->updated_ns;
+    double frames = c->frames ? (double)c->frames : 1;
+
+    if (alive) {
+        fprintf(f, "%s: running as pid %llu for %.1f s\n", s->game,
+                (unsigned long long)c->pid, (end - c->started_ns) / 1e9);
+    } else {
+        fprintf(f, "%s: exited %.1f s ago after %.1f s\n", s->game,
+                (now - c->updated_ns) / 1e9, (end - c->started_ns) / 1e9);
+    }
+    fprintf(f, "  score %lld, %llu ticks at %.1f ms, %llu dropped, %llu frames\n",
+            (long long)c->score, (unsigned long long)c->ticks, c->tick_ns / 1e6,
+            (unsigned long long)c->dropped_ticks, (unsigned long long)c->frames);
+    fprintf(f, "  render %llu bytes (%.1f bytes/frame), %.2f writes/frame, %.2f syscalls/frame\n",
+            (unsigned long long)c->render_bytes, c->render_bytes / frames, c->render_writes / frames,
+            (c->loop_syscalls + c->render_writes) / frames);
+    fprintf(f, "  input %llu keys, queue depth %llu at the last frame, %llu at most\n",
+            (unsigned long long)c->keys, (unsigned long long)c->input_depth,
+            (unsigned long long)c->input_depth_max);
+
+    LoopHistogram h;
+    memset(&h, 0, sizeof(h));
+    for (int i = 0; i < LOOP_BUCKETS; i++) {
+        h.count[i] = c->frame_us[i];
+        h.samples += c->frame_us[i];
+    }
+    h.max_ns = c->frame_max_ns;
+    loop_hist_print(&h, f, "Frame time");
+}
+
+#endif
@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <termios.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "render.h"
+#include "bench.h"
+#include "rng.h"
+
+// Ultimate tic-tac-toe: a 3x3 board of 3x3 boards. A move in cell c of a
+// small board sends the opponent to small board c; if that board is
+// already won or full they may play in any open board. Winning a small
+// board claims its square on the meta-board, and three claimed squares in
+// a row win the game.
+//
+// The computer opponent is a parallel Monte Carlo tree search. Build with
+// -pthread -lm.
+
+// Screen layout: 9x9 cells three columns wide with block separators, then
+// the turn line, a message line and the search numbers
+#define CELL_ROW(r) (1 + (r) + (r) / 3)
+#define CELL_COL(c) ((c) * 3 + (c) / 3)
+#define STATUS_ROW 13
+#define SCREEN_ROWS (STATUS_ROW + 3)
+#define SCREEN_COLS 60
+
+#define FULL_BOARD 0x1FF
+#define MAX_MOVES 81
+#define DEFAULT_BUDGET_MS 1000
+#define DEFAULT_NODES (1 << 22)   // 64 MB of tree
+#define DEFAULT_BENCH_PLAYOUTS 200000
+
+// Game state as bitboards: bit c of a board mask is cell c, row-major
+typedef struct {
+    uint16_t cells[2][9];  // Stones of X and O in each small board
+    uint16_t won[2];       // Small boards won by X and by O
+    uint16_t closed;       // Small boards won or full, no longer playable
+    int8_t next;           // Small board the next move must go in, -1 for any open one
+    int8_t to_move;        // 0 for X, 1 for O
+    int8_t winner;         // 0 X, 1 O, 2 draw, -1 still playing
+} UltState;
+
+// Monte Carlo tree search, shared by all worker threads.
+//
+// Nodes live in one preallocated arena and are claimed with an atomic
+// add, children of a node contiguously, so the tree needs no locks and no
+// allocation while searching. A thread walks down by UCT, bumping each
+// node's visit count on the way in; the reward is only added after the
+// playout, so until then the visit counts as a loss (virtual loss) and
+// the other threads spread out over different lines. A leaf that has
+// been visited EXPAND_VISITS times is expanded by whichever thread wins
+// a compare-and-swap on its state; the rest just play out from it.
+
+#define EXPAND_VISITS 4
+#define UCT_C 1.0
+
+#define NODE_LEAF 0
+#define NODE_EXPANDING 1
+#define NODE_READY 2
+
+typedef struct {
+    int32_t visits;        // Playouts through this node, including running ones
+    int32_t score;         // Half-points won by the player who moved into this node
+    int32_t first_child;   // Arena index of the first child, once NODE_READY
+    uint8_t child_count;
+    uint8_t move;          // Board * 9 + cell played to reach this node
+    uint8_t state;         // NODE_LEAF, NODE_EXPANDING or NODE_READY
+    uint8_t pad;
+} Node;
+
+typedef struct {
+    Node *nodes;
+    int32_t capacity;
+    int32_t used;          // Arena slots claimed, may overshoot capacity
+    UltState root;
+    uint64_t deadline;     // Stop at this time, if no playout limit
+    long playout_limit;    // Stop after this many playouts, 0 for none
+    long playouts;         // Playouts started
+} Search;
+
+typedef struct {
+    Search *search;
+    pthread_t thread;
+    uint64_t seed;
+} Worker;
+
+typedef struct {
+    long playouts;
+    uint64_t elapsed_ns;
+    int32_t nodes;
+    double win_rate;       // Of the chosen move, for the side that played it
+} SearchReport;
+
+uint8_t has_line[512];     // Does a 9-bit mask contain three in a row
+UltState game;
+int cursor_row = 4, cursor_col = 4;
+char ai_player = 'O';      // Side the computer plays, 0 for hotseat
+long budget_ms = DEFAULT_BUDGET_MS;
+int thread_count = 1;
+uint64_t seed;
+Search search;
+char ai_line[SCREEN_COLS]; // Numbers from the last search
+struct termios oldt;
+Renderer screen;
+
+static const char *board_names[9] = {
+    "top-left", "top", "top-right", "left", "centre", "right",
+    "bottom-left", "bottom", "bottom-right",
+};
+
+// Fill the three-in-a-row table from the eight lines of a 3x3 board
+void init_lines() {
+    static const uint16_t lines[8] = {0007, 0070, 0700, 0111, 0222, 0444, 0421, 0124};
+    for (int mask = 0; mask < 512; mask++) {
+        has_line[mask] = 0;
+        for (int i = 0; i < 8; i++) {
+            if ((mask & lines[i]) == lines[i]) has_line[mask] = 1;
+        }
+    }
+}
+
+void state_init(UltState *s) {
+    memset(s, 0, sizeof(*s));
+    s->next = -1;
+    s->winner = -1;
+}
+
+// Can the side to move play cell of small board b
+static inline int is_legal(const UltState *s, int b, int cell) {
+    if (s->winner >= 0 || ((s->closed >> b) & 1)) return 0;
+    if (s->next >= 0 && s->next != b) return 0;
+    return !(((s->cells[0][b] | s->cells[1][b]) >> cell) & 1);
+}
+
+// Play move (board * 9 + cell) for the side to move; must be legal
+static inline void apply_move(UltState *s, int move) {
+    int b = move / 9, cell = move % 9, p = s->to_move;
+    s->cells[p][b] |= 1 << cell;
+    if (has_line[s->cells[p][b]]) {
+        s->won[p] |= 1 << b;
+        s->closed |= 1 << b;
+        if (has_line[s->won[p]]) s->winner = p;
+    } else if ((s->cells[0][b] | s->cells[1][b]) == FULL_BOARD) {
+        s->closed |= 1 << b;
+    }
+    if (s->winner < 0 && s->closed == FULL_BOARD) s->winner = 2;
+    s->next = ((s->closed >> cell) & 1) ? -1 : cell;
+    s->to_move ^= 1;
+}
+
+// Boards the side to move may play in
+static inline int open_boards(const UltState *s) {
+    return s->next >= 0 ? 1 << s->next : ~s->closed & FULL_BOARD;
+}
+
+static inline int empty_cells(const UltState *s, int b) {
+    return ~(s->cells[0][b] | s->cells[1][b]) & FULL_BOARD;
+}
+
+// All legal moves, returns the count
+int gen_moves(const UltState *s, uint8_t *moves) {
+    int n = 0;
+    for (int boards = open_boards(s); boards; boards &= boards - 1) {
+        int b = __builtin_ctz(boards);
+        for (int empty = empty_cells(s, b); empty; empty &= empty - 1) {
+            moves[n++] = b * 9 + __builtin_ctz(empty);
+        }
+    }
+    return n;
+}
+
+// Index of the k-th set bit of mask
+static inline int select_bit(int mask, int k) {
+    while (k--) mask &= mask - 1;
+    return __builtin_ctz(mask);
+}
+
+// Play uniformly random legal moves to the end, returns the winner
+int playout(UltState s, Rng *rng) {
+    while (s.winner < 0) {
+        int b, empty;
+        if (s.next >= 0) {
+            b = s.next;
+            empty = empty_cells(&s, b);
+        } else {
+            // Pick among all empty cells of all open boards
+            int counts[9], total = 0;
+            for (int boards = open_boards(&s); boards; boards &= boards - 1) {
+                int i = __builtin_ctz(boards);
+                total += counts[i] = __builtin_popcount(empty_cells(&s, i));
+            }
+            int k = rng_below(rng, total);
+            for (int boards = open_boards(&s); ; boards &= boards - 1) {
+                b = __builtin_ctz(boards);
+                if (k < counts[b]) break;
+                k -= counts[b];
+            }
+            empty = empty_cells(&s, b);
+            apply_move(&s, b * 9 + select_bit(empty, k));
+            continue;
+        }
+        apply_move(&s, b * 9 + select_bit(empty, rng_below(rng, __builtin_popcount(empty))));
+    }
+    return s.winner;
+}
+
+// Give a leaf one child per legal move, unless the arena is full
+void expand(Search *sr, Node *node, const UltState *s) {
+    uint8_t moves[MAX_MOVES];
+    int count = gen_moves(s, moves);
+    int32_t first = __atomic_fetch_add(&sr->used, count, __ATOMIC_RELAXED);
+    if (first + count > sr->capacity) {
+        return; // Stays NODE_EXPANDING, so nobody tries again
+    }
+    for (int i = 0; i < count; i++) {
+        Node *child = &sr->nodes[first + i];
+        memset(child, 0, sizeof(*child));
+        child->move = moves[i];
+    }
+    node->first_child = first;
+    node->child_count = count;
+    __atomic_store_n(&node->state, NODE_READY, __ATOMIC_RELEASE);
+}
+
+// Child with the best upper confidence bound; unvisited children first
+Node *select_child(Search *sr, Node *node) {
+    Node *children = &sr->nodes[node->first_child];
+    double log_parent = log((double)__atomic_load_n(&node->visits, __ATOMIC_RELAXED) + 1);
+    Node *best = children;
+    double best_value = -1;
+    for (int i = 0; i < node->child_count; i++) {
+        int32_t visits = __atomic_load_n(&children[i].visits, __ATOMIC_RELAXED);
+        if (visits == 0) return &children[i];
+        double mean = __atomic_load_n(&children[i].score, __ATOMIC_RELAXED) / (2.0 * visits);
+        double value = mean + UCT_C * sqrt(log_parent / visits);
+        if (value > best_value) {
+            best_value = value;
+            best = &children[i];
+        }
+    }
+    return best;
+}
+
+// One selection, expansion, playout and backup
+void mcts_iteration(Search *sr, Rng *rng) {
+    Node *path[MAX_MOVES + 1];
+    int depth = 0;
+    UltState s = sr->root;
+    Node *node = &sr->nodes[0];
+
+    __atomic_fetch_add(&node->visits, 1, __ATOMIC_RELAXED);
+    path[depth++] = node;
+    while (s.winner < 0) {
+        uint8_t state = __atomic_load_n(&node->state, __ATOMIC_ACQUIRE);
+        if (state == NODE_LEAF &&
+            __atomic_load_n(&node->visits, __ATOMIC_RELAXED) >= EXPAND_VISITS) {
+            uint8_t expected = NODE_LEAF;
+            if (__atomic_compare_exchange_n(&node->state, &expected, NODE_EXPANDING, 0,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                expand(sr, node, &s);
+                state = __atomic_load_n(&node->state, __ATOMIC_ACQUIRE);
+            }
+        }
+        if (state != NODE_READY) break;
+
+        node = select_child(sr, node);
+        __atomic_fetch_add(&node->visits, 1, __ATOMIC_RELAXED); // Virtual loss until backup
+        apply_move(&s, node->move);
+        path[depth++] = node;
+    }
+
+    int winner = s.winner >= 0 ? s.winner : playout(s, rng);
+
+    // path[i] was entered by a move of the side to move at path[i - 1]
+    int mover = sr->root.to_move;
+    for (int i = 1; i < depth; i++, mover ^= 1) {
+        int reward = winner == 2 ? 1 : winner == mover ? 2 : 0;
+        if (reward) __atomic_fetch_add(&path[i]->score, reward, __ATOMIC_RELAXED);
+    }
+}
+
+void *mcts_worker(void *arg) {
+    Worker *w = arg;
+    Search *sr = w->search;
+    Rng rng;
+    rng_seed(&rng, w->seed);
+    while (1) {
+        long done = __atomic_fetch_add(&sr->playouts, 1, __ATOMIC_RELAXED);
+        if (sr->playout_limit ? done >= sr->playout_limit : bench_now_ns() >= sr->deadline) break;
+        mcts_iteration(sr, &rng);
+    }
+    return NULL;
+}
+
+// Search from state with threads workers until the deadline or the playout
+// limit, returns the most visited move
+int mcts_search(Search *sr, const UltState *state, int threads, uint64_t budget_ns,
+                long playout_limit, SearchReport *report) {
+    Worker workers[threads];
+    uint64_t start = bench_now_ns();
+
+    sr->root = *state;
+    sr->used = 1;
+    sr->playouts = 0;
+    sr->deadline = start + budget_ns;
+    sr->playout_limit = playout_limit;
+    memset(&sr->nodes[0], 0, sizeof(Node));
+
+    for (int i = 0; i < threads; i++) {
+        workers[i].search = sr;
+        workers[i].seed = seed + i * 0x9E3779B97F4A7C15ull;
+        if (i > 0 && pthread_create(&workers[i].thread, NULL, mcts_worker, &workers[i]) != 0) {
+            threads = i; // Carry on with the workers we have
+            break;
+        }
+    }
+    mcts_worker(&workers[0]);
+    for (int i = 1; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    seed = rng_next(&(Rng){seed}); // Fresh playouts next time
+
+    // Every worker overshoots the playout counter once when it stops
+    report->playouts = sr->playouts - threads;
+    report->elapsed_ns = bench_now_ns() - start;
+    report->nodes = sr->used < sr->capacity ? sr->used : sr->capacity;
+    report->win_rate = 0;
+
+    Node *root = &sr->nodes[0];
+    if (root->state != NODE_READY) {
+        // Too little time to grow the tree, fall back to any legal move
+        uint8_t moves[MAX_MOVES];
+        gen_moves(state, moves);
+        return moves[0];
+    }
+    Node *best = &sr->nodes[root->first_child];
+    for (int i = 1; i < root->child_count; i++) {
+        Node *child = &sr->nodes[root->first_child + i];
+        if (child->visits > best->visits) best = child;
+    }
+    if (best->visits) report->win_rate = best->score / (2.0 * best->visits);
+    return best->move;
+}
+
+// Time a fixed number of playouts from the opening at 1..max_threads
+// threads and print the scaling
+void run_bench(long playouts, int max_threads) {
+    UltState start;
+    SearchReport report;
+    double single = 0;
+
+    state_init(&start);
+    printf("ultimate mcts: %ld playouts from the opening, %d nodes in the arena\n",
+           playouts, search.capacity);
+    for (int threads = 1; threads <= max_threads; threads++) {
+        int move = mcts_search(&search, &start, threads, 0, playouts, &report);
+        double rate = report.playouts / (report.elapsed_ns / 1e9);
+        if (threads == 1) single = rate;
+        printf("%2d threads %10.0f playouts/s  speedup %5.2f  %9d nodes  best move %s board cell %d (%.1f%%)\n",
+               threads, rate, rate / single, report.nodes, board_names[move / 9], move % 9,
+               100 * report.win_rate);
+    }
+}
+
+// Draw the 9x9 board, the turn line and the last search
+void display_board(const char *message) {
+    int open = open_boards(&game);
+    render_clear(&screen);
+    for (int r = 0; r < 9; r++) {
+        for (int c = 0; c < 9; c++) {
+            int b = (r / 3) * 3 + c / 3, cell = (r % 3) * 3 + c % 3;
+            char symbol = ' ';
+            if ((game.won[0] >> b) & 1) {
+                symbol = 'X'; // A won board shows its owner in every cell
+            } else if ((game.won[1] >> b) & 1) {
+                symbol = 'O';
+            } else if ((game.cells[0][b] >> cell) & 1) {
+                symbol = 'X';
+            } else if ((game.cells[1][b] >> cell) & 1) {
+                symbol = 'O';
+            } else if (game.winner < 0 && ((open >> b) & 1)) {
+                symbol = '.'; // Playable now
+            }
+            int row = CELL_ROW(r), col = CELL_COL(c);
+            if (r == cursor_row && c == cursor_col) {
+                render_put(&screen, row, col, '[');
+                render_put(&screen, row, col + 2, ']');
+            }
+            render_put(&screen, row, col + 1, symbol);
+        }
+    }
+    for (int r = 3; r < 9; r += 3) {
+        render_text(&screen, CELL_ROW(r) - 1, 0, "---------+---------+---------");
+    }
+    for (int r = 0; r < 9; r++) {
+        render_put(&screen, CELL_ROW(r), CELL_COL(3) - 1, '|');
+        render_put(&screen, CELL_ROW(r), CELL_COL(6) - 1, '|');
+    }
+
+    char player = game.to_move ? 'O' : 'X';
+    if (game.winner < 0 && game.next >= 0) {
+        render_text(&screen, 0, 0, "Player %c's turn, play in the %s board", player, board_names[game.next]);
+    } else if (game.winner < 0) {
+        render_text(&screen, 0, 0, "Player %c's turn, play in any open board", player);
+    }
+    if (message) render_text(&screen, STATUS_ROW, 0, "%s", message);
+    if (ai_line[0]) render_text(&screen, STATUS_ROW + 2, 0, "%s", ai_line);
+    render_present(&screen);
+}
+
+// Let the computer pick a move within the budget and play it
+void computer_move() {
+    SearchReport report;
+    display_board("Thinking...");
+    int move = mcts_search(&search, &game, thread_count, budget_ms * 1000000ull, 0, &report);
+    apply_move(&game, move);
+    cursor_row = (move / 9) / 3 * 3 + (move % 9) / 3;
+    cursor_col = (move / 9) % 3 * 3 + (move % 9) % 3;
+    snprintf(ai_line, sizeof(ai_line), "AI: %ld playouts, %.0f/s on %d threads, %.0f%% to win",
+             report.playouts, report.playouts / (report.elapsed_ns / 1e9), thread_count,
+             100 * report.win_rate);
+}
+
+// Play rounds until a player quits
+void play() {
+    while (1) {
+        state_init(&game);
+        cursor_row = cursor_col = 4;
+        ai_line[0] = '\0';
+        while (game.winner < 0) {
+            if ((game.to_move ? 'O' : 'X') == ai_player) {
+                computer_move();
+                continue;
+            }
+            display_board(NULL);
+            int input = getchar();
+            if (input == EOF) return; // Nothing more to read, same as 'q'
+            int b = (cursor_row / 3) * 3 + cursor_col / 3;
+            int cell = (cursor_row % 3) * 3 + cursor_col % 3;
+            switch (input) {
+                case 'q': return;
+                case 'w': if (cursor_row > 0) cursor_row--; break;
+                case 's': if (cursor_row < 8) cursor_row++; break;
+                case 'a': if (cursor_col > 0) cursor_col--; break;
+                case 'd': if (cursor_col < 8) cursor_col++; break;
+                case '\n':
+                    if (is_legal(&game, b, cell)) apply_move(&game, b * 9 + cell);
+                    break;
+            }
+        }
+
+        if (game.winner == 2) {
+            display_board("It's a tie! Play again? (y/n)");
+        } else {
+            char message[48];
+            snprintf(message, sizeof(message), "Player %c wins! Play again? (y/n)", game.winner ? 'O' : 'X');
+            display_board(message);
+        }
+        while (1) {
+            int choice = getchar();
+            if (choice == 'y' || choice == 'Y') break;
+            if (choice == 'n' || choice == 'N' || choice == 'q' || choice == 'Q' || choice == EOF) return;
+        }
+    }
+}
+
+void restore_mode() {
+    render_shutdown(&screen);
+    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+}
+
+void signal_handler(int signum) {
+    restore_mode();
+    exit(0);
+}
+
+// Print the command-line help
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--ai X|O|none] [--budget MS] [--threads N] [--nodes N] [--seed N]\n"
+                    "       %s --bench [--playouts N] [--threads MAX] [--nodes N] [--seed N]\n"
+                    "The computer thinks for MS ms per move (default %d) on N threads (default:\n"
+                    "all cores). --bench times playouts from the opening at 1..MAX threads.\n",
+            program, program, DEFAULT_BUDGET_MS);
+}
+
+int main(int argc, char *argv[]) {
+    int bench = 0;
+    long bench_playouts = DEFAULT_BENCH_PLAYOUTS;
+    long nodes = DEFAULT_NODES;
+
+    thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count < 1) thread_count = 1;
+    seed = time(NULL);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ai") == 0 && i + 1 < argc) {
+            i++;
+            ai_player = strcmp(argv[i], "none") == 0 ? 0 : argv[i][0];
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            budget_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc) {
+            nodes = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--playouts") == 0 && i + 1 < argc) {
+            bench_playouts = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((ai_player && ai_player != 'X' && ai_player != 'O') || budget_ms <= 0 ||
+        thread_count < 1 || thread_count > 256 || nodes < MAX_MOVES + 1 || nodes > INT32_MAX / 2 ||
+        bench_playouts <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    init_lines();
+    search.capacity = nodes;
+    search.nodes = malloc(nodes * sizeof(Node));
+    if (!search.nodes) {
+        fprintf(stderr, "Not enough memory for %ld tree nodes\n", nodes);
+        return 1;
+    }
+
+    if (bench) {
+        run_bench(bench_playouts, thread_count);
+        free(search.nodes);
+        return 0;
+    }
+
+    signal(SIGTERM, signal_handler);
+    signal(SIGINT, signal_handler);
+
+    struct termios newt;
+    tcgetattr(STDIN_FILENO, &oldt);
+    newt = oldt;
+    newt.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+    if (render_init(&screen, SCREEN_COLS, SCREEN_ROWS) < 0) {
+        restore_mode();
+        fprintf(stderr, "Failed to allocate the screen buffers\n");
+        return 1;
+    }
+
+    play();
+
+    tcflush(STDIN_FILENO, TCIFLUSH);
+    restore_mode();
+    printf("Game exited. Thanks for playing!\n");
+    free(search.nodes);
+    return 0;
+}
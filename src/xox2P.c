@@ -1,76 +1,536 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <termios.h>
 #include <unistd.h>
 #include <signal.h>
 
-#define ROWS 3
-#define COLS 3
+#include "render.h"
+#include "bench.h"
+#include "replay.h"
+#include "rng.h"
+#include "snapshot.h"
+#include "xox_table.h"
 
-char board[ROWS][COLS];
+#define DEFAULT_SIZE 3
+#define MIN_SIZE 3
+#define MAX_SIZE 19
+#define BOARD_WORDS ((MAX_SIZE * MAX_SIZE + 63) / 64)
+
+// Screen layout: turn line, board rows with separators, blank line, messages
+#define STATUS_ROW (board_rows * 2 + 1)
+#define SCREEN_ROWS (STATUS_ROW + 3)
+#define SCREEN_COLS (board_cols * 4 > 40 ? board_cols * 4 : 40)
+#define SCREEN_COLS_MAX (MAX_SIZE * 4)
+
+#define SNAPSHOT_NAME "xox2P" // Save state on the storage volume, see snapshot.h
+#define SNAPSHOT_STATE 2      // Bump whenever XoxSave changes
+
+// One bit per cell, cells numbered row * board_cols + col
+typedef struct {
+    uint64_t w[BOARD_WORDS];
+} Bitboard;
+
+// Board size and stones in a row needed to win, from --size and --win
+int board_rows = DEFAULT_SIZE, board_cols = DEFAULT_SIZE;
+int win_length = DEFAULT_SIZE;
+
+Bitboard stones[2];  // Cells taken by X and by O
+int empty_cells;     // Cells still free, kept up to date on every move
 int cursor_row = 0, cursor_col = 0;
 char current_player = 'X';
 struct termios oldt; // Store original terminal settings
+Renderer screen;     // Only redraws the cells a keypress changed
+int interactive = 1; // 0 while playing back a replay without a terminal
+int in_round = 0;    // Set while a round is being played, cleared once it is decided
+int resumed = 0;     // The first round carries on from a snapshot
+uint64_t ticks = 0;  // Keys read so far, each key is one tick
+volatile sig_atomic_t quit_signal = 0; // SIGTERM or SIGINT arrived, quit at the next key
+ReplayWriter recorder = {.fd = -1}; // Session recording, open with --record
+ReplayReader replay; // Session being played back, open with --replay
 
-// Signal handler to clean up and exit gracefully
-void signal_handler(int signum) {
-    // Restore terminal settings
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+uint64_t board_hash();
+int valid_settings();
+void save_or_forget();
+
+static inline int bb_test(const Bitboard *b, int cell) {
+    return (b->w[cell >> 6] >> (cell & 63)) & 1;
+}
+
+static inline void bb_set(Bitboard *b, int cell) {
+    b->w[cell >> 6] |= (uint64_t)1 << (cell & 63);
+}
+
+// Symbol shown for a cell
+char cell_at(int row, int col) {
+    int cell = row * board_cols + col;
+    if (bb_test(&stones[0], cell)) return 'X';
+    if (bb_test(&stones[1], cell)) return 'O';
+    return ' ';
+}
+
+// Computer opponent: negamax alpha-beta search with iterative deepening
+// under a per-move time budget.
+//
+// Every run of win_length cells (a line window) keeps a count of each
+// player's stones, updated as stones are placed and taken back. A move wins
+// exactly when it completes a window, and the static evaluation is a sum
+// over windows still open to only one player, so both cost O(windows
+// through the cell) per move instead of a board scan. Searched positions
+// are cached in a Zobrist-hashed transposition table. Moves are tried best
+// first: the table's move, then by how much they extend own lines and break
+// the opponent's. Small boards are searched full width, larger ones only
+// near existing stones and at most AI_MAX_BRANCH moves per node.
+
+#define MAX_CELLS (MAX_SIZE * MAX_SIZE)
+#define MAX_WINDOWS (4 * MAX_CELLS)
+#define AI_WIN 1000000000                  // Win on the next move
+#define AI_INF (AI_WIN + 1)
+#define AI_MATE (AI_WIN - MAX_CELLS)       // Scores past this are forced results
+#define AI_FULL_WIDTH 25                   // Boards up to this many cells try every empty cell
+#define AI_MAX_BRANCH 24                   // Moves tried per node on larger boards
+#define AI_TT_SIZE (1 << 20)               // Transposition table entries (16 MB)
+#define AI_DEFAULT_BUDGET_MS 500
+
+// Transposition table bounds
+#define TT_EXACT 1
+#define TT_LOWER 2
+#define TT_UPPER 3
+
+typedef struct {
+    uint64_t key;
+    int32_t score;
+    int16_t move;
+    int8_t depth;
+    uint8_t flag;
+} TTEntry;
+
+typedef struct {
+    uint64_t nodes;
+    uint64_t tt_probes, tt_hits;
+    uint64_t elapsed_ns;
+    int depth;                 // Deepest completed iteration
+    int score;                 // Its score for the side to move
+} SearchStats;
+
+int window_total;                          // Line windows on this board
+uint8_t window_stones[2][MAX_WINDOWS];     // Stones of X and O in each window
+uint16_t cell_windows[MAX_CELLS][4 * MAX_SIZE]; // Windows through each cell
+uint8_t cell_window_count[MAX_CELLS];
+int line_weight[MAX_SIZE + 1];             // Value of an open window with n stones
+uint8_t near_stones[MAX_CELLS];            // Stones within two cells, for move generation
+int eval_score;                            // Sum of window values, X minus O
+uint64_t zobrist[2][MAX_CELLS];
+uint64_t position_key;                     // Zobrist hash of the stones
+
+char ai_player = 0;                        // Side the computer plays, 0 for hotseat
+long ai_budget_ms = AI_DEFAULT_BUDGET_MS;
+TTEntry *tt;
+uint64_t search_deadline;
+int search_aborted;
+int root_move;
+SearchStats search_stats;                  // Last move
+SearchStats total_stats;                   // Whole session
+int ai_moves;
+char ai_keys[2 * MAX_SIZE + 1];            // Keys that walk the cursor to the chosen cell
+int ai_key_pos, ai_key_len;
+char ai_line[SCREEN_COLS_MAX];             // Search numbers shown under the board
+int show_hint = 0;                         // Mark the best move, toggled with 'h' on 3x3
+
+static inline void bb_clear(Bitboard *b, int cell) {
+    b->w[cell >> 6] &= ~((uint64_t)1 << (cell & 63));
+}
+
+// Enumerate the line windows of the board, once the size is known
+void init_lines() {
+    static const int dr[4] = {0, 1, 1, 1};
+    static const int dc[4] = {1, 0, 1, -1};
+    Rng rng;
+
+    window_total = 0;
+    memset(cell_window_count, 0, sizeof(cell_window_count));
+    for (int d = 0; d < 4; d++) {
+        for (int r = 0; r < board_rows; r++) {
+            for (int c = 0; c < board_cols; c++) {
+                int end_r = r + dr[d] * (win_length - 1), end_c = c + dc[d] * (win_length - 1);
+                if (end_r >= board_rows || end_c < 0 || end_c >= board_cols) continue;
+                for (int i = 0; i < win_length; i++) {
+                    int cell = (r + dr[d] * i) * board_cols + c + dc[d] * i;
+                    cell_windows[cell][cell_window_count[cell]++] = window_total;
+                }
+                window_total++;
+            }
+        }
+    }
+
+    // Each stone multiplies a window's value by 8, capped so the sum over
+    // all windows stays well below AI_MATE
+    for (int n = 0; n <= MAX_SIZE; n++) {
+        line_weight[n] = n == 0 ? 0 : 1 << (3 * (n - 1) < 18 ? 3 * (n - 1) : 18);
+    }
+
+    rng_seed(&rng, 0x786F78); // Fixed, so table hits are reproducible
+    for (int p = 0; p < 2; p++) {
+        for (int cell = 0; cell < MAX_CELLS; cell++) {
+            zobrist[p][cell] = rng_next(&rng);
+        }
+    }
+}
+
+// Value of a window for X (positive) or O (negative); 0 once both have stones
+static inline int window_value(int w) {
+    int x = window_stones[0][w], o = window_stones[1][w];
+    if (x && o) return 0;
+    return line_weight[x] - line_weight[o];
+}
+
+static inline void update_near(int cell, int delta) {
+    int row = cell / board_cols, col = cell % board_cols;
+    for (int r = row - 2; r <= row + 2; r++) {
+        if (r < 0 || r >= board_rows) continue;
+        for (int c = col - 2; c <= col + 2; c++) {
+            if (c >= 0 && c < board_cols) near_stones[r * board_cols + c] += delta;
+        }
+    }
+}
+
+// Put a stone of player p (0 for X) on a free cell, returns 1 if it wins
+int make_move(int cell, int p) {
+    int won = 0;
+    bb_set(&stones[p], cell);
+    empty_cells--;
+    position_key ^= zobrist[p][cell];
+    for (int i = 0; i < cell_window_count[cell]; i++) {
+        int w = cell_windows[cell][i];
+        int before = window_value(w);
+        if (++window_stones[p][w] == win_length) won = 1;
+        eval_score += window_value(w) - before;
+    }
+    update_near(cell, 1);
+    return won;
+}
+
+// Take back make_move()
+void unmake_move(int cell, int p) {
+    bb_clear(&stones[p], cell);
+    empty_cells++;
+    position_key ^= zobrist[p][cell];
+    for (int i = 0; i < cell_window_count[cell]; i++) {
+        int w = cell_windows[cell][i];
+        int before = window_value(w);
+        window_stones[p][w]--;
+        eval_score += window_value(w) - before;
+    }
+    update_near(cell, -1);
+}
+
+// Player to move, 0 for X; X always opens
+static inline int side_to_move() {
+    return (board_rows * board_cols - empty_cells) & 1;
+}
+
+// Ordering score of a move: completing a line first, then blocking one,
+// then how much it extends open lines and breaks the opponent's
+int move_order_score(int cell, int p) {
+    int score = 0, block = 0;
+    for (int i = 0; i < cell_window_count[cell]; i++) {
+        int w = cell_windows[cell][i];
+        int mine = window_stones[p][w], theirs = window_stones[!p][w];
+        if (theirs == 0) {
+            if (mine + 1 == win_length) return AI_WIN;
+            score += line_weight[mine + 1] - line_weight[mine];
+        } else if (mine == 0) {
+            if (theirs + 1 == win_length) block = 1;
+            score += line_weight[theirs];
+        }
+    }
+    return block ? AI_WIN / 2 + score / 4 : score;
+}
+
+// Candidate moves for player p in the order to try them, returns the count
+int gen_moves(int *moves, int p, int tt_move) {
+    int cells = board_rows * board_cols;
+    int full = cells <= AI_FULL_WIDTH;
+    int cap = full ? cells : AI_MAX_BRANCH;
+    int scores[MAX_CELLS];
+    int n = 0;
+
+    // Nothing is near an empty board, open in the centre
+    if (!full && empty_cells == cells) {
+        moves[0] = (board_rows / 2) * board_cols + board_cols / 2;
+        return 1;
+    }
+    for (int cell = 0; cell < cells; cell++) {
+        if (bb_test(&stones[0], cell) || bb_test(&stones[1], cell)) continue;
+        if (!full && !near_stones[cell]) continue;
+        int score = cell == tt_move ? AI_INF : move_order_score(cell, p);
+        if (n == cap && score <= scores[n - 1]) continue;
+
+        // Insert into the sorted list, dropping the worst once it is full
+        int i = n < cap ? n++ : n - 1;
+        while (i > 0 && scores[i - 1] < score) {
+            scores[i] = scores[i - 1];
+            moves[i] = moves[i - 1];
+            i--;
+        }
+        scores[i] = score;
+        moves[i] = cell;
+    }
+    return n;
+}
+
+// Forced-win scores are stored relative to the node, not the root
+static inline int score_to_tt(int score, int ply) {
+    return score > AI_MATE ? score + ply : score < -AI_MATE ? score - ply : score;
+}
+
+static inline int score_from_tt(int score, int ply) {
+    return score > AI_MATE ? score - ply : score < -AI_MATE ? score + ply : score;
+}
+
+// Negamax alpha-beta; the score is for the side to move
+int search(int depth, int alpha, int beta, int ply) {
+    if ((++search_stats.nodes & 1023) == 0 && (bench_now_ns() > search_deadline || quit_signal)) {
+        search_aborted = 1;
+    }
+    if (search_aborted || empty_cells == 0) return 0;
+    int p = side_to_move();
+    if (depth == 0) return p ? -eval_score : eval_score;
+
+    TTEntry *entry = &tt[position_key & (AI_TT_SIZE - 1)];
+    int tt_move = -1;
+    search_stats.tt_probes++;
+    if (entry->flag && entry->key == position_key) {
+        search_stats.tt_hits++;
+        tt_move = entry->move;
+        if (entry->depth >= depth && ply > 0) {
+            int score = score_from_tt(entry->score, ply);
+            if (entry->flag == TT_EXACT ||
+                (entry->flag == TT_LOWER && score >= beta) ||
+                (entry->flag == TT_UPPER && score <= alpha)) {
+                return score;
+            }
+        }
+    }
+
+    int moves[MAX_CELLS];
+    int count = gen_moves(moves, p, tt_move);
+    int best = -AI_INF, best_move = moves[0], alpha_start = alpha;
+    for (int i = 0; i < count; i++) {
+        int score = make_move(moves[i], p) ? AI_WIN - ply
+                                           : -search(depth - 1, -beta, -alpha, ply + 1);
+        unmake_move(moves[i], p);
+        if (search_aborted) return 0;
+        if (score > best) {
+            best = score;
+            best_move = moves[i];
+            if (ply == 0) root_move = best_move;
+        }
+        if (best > alpha) alpha = best;
+        if (alpha >= beta) break;
+    }
+
+    entry->key = position_key;
+    entry->score = score_to_tt(best, ply);
+    entry->move = best_move;
+    entry->depth = depth;
+    entry->flag = best <= alpha_start ? TT_UPPER : best >= beta ? TT_LOWER : TT_EXACT;
+    return best;
+}
+
+// Classic 3x3 three in a row is solved ahead of time in xox_table.h
+static inline int classic_board() {
+    return board_rows == 3 && board_cols == 3 && win_length == 3;
+}
+
+// Tablebase entry of the current classic position
+static inline uint8_t table_entry() {
+    return xox_table[xox_base3[stones[0].w[0] & 0x1FF] + 2 * xox_base3[stones[1].w[0] & 0x1FF]];
+}
+
+// Pick a move for the side to move within ai_budget_ms, returns the cell
+int ai_choose_move() {
+    uint64_t start = bench_now_ns();
+    int best_move = -1;
+
+    memset(&search_stats, 0, sizeof(search_stats));
+    if (classic_board()) {
+        // Perfect play is one lookup, no search needed
+        ai_moves++;
+        return XOX_MOVE(table_entry());
+    }
+    if (!tt) tt = calloc(AI_TT_SIZE, sizeof(TTEntry));
+    if (tt) {
+        search_deadline = start + ai_budget_ms * 1000000ull;
+        search_aborted = 0;
+
+        // Deepen until time runs out, the result is forced, or the search
+        // reaches the end of the game and is exact
+        for (int depth = 1; depth <= empty_cells; depth++) {
+            root_move = -1;
+            int score = search(depth, -AI_INF, AI_INF, 0);
+            if (search_aborted) break;
+            best_move = root_move;
+            search_stats.depth = depth;
+            search_stats.score = score;
+            if (score > AI_MATE || score < -AI_MATE) break;
+        }
+    }
+    if (best_move < 0) {
+        // Out of memory or out of time before depth 1, take the first candidate
+        int moves[MAX_CELLS];
+        gen_moves(moves, side_to_move(), -1);
+        best_move = moves[0];
+    }
+
+    search_stats.elapsed_ns = bench_now_ns() - start;
+    total_stats.nodes += search_stats.nodes;
+    total_stats.tt_probes += search_stats.tt_probes;
+    total_stats.tt_hits += search_stats.tt_hits;
+    total_stats.elapsed_ns += search_stats.elapsed_ns;
+    ai_moves++;
+    return best_move;
+}
+
+// One line of search numbers, for tuning the budget and the table
+void format_stats(char *line, size_t size, const SearchStats *s) {
+    double seconds = s->elapsed_ns / 1e9;
+    snprintf(line, size, "%llu nodes, %.0f nodes/s, TT hits %.1f%%",
+             (unsigned long long)s->nodes, seconds > 0 ? s->nodes / seconds : 0.0,
+             s->tt_probes ? 100.0 * s->tt_hits / s->tt_probes : 0.0);
+}
+
+// Let the computer move by typing the keys a player would: cursor moves
+// to the chosen cell, then Enter. The keys go through read_input(), so
+// they are recorded and a replay needs no search at all.
+void queue_ai_move() {
+    int cell = ai_choose_move();
+    int row = cell / board_cols, col = cell % board_cols;
+    char stats[64];
+
+    ai_key_pos = ai_key_len = 0;
+    for (int r = cursor_row; r != row; r += r < row ? 1 : -1) {
+        ai_keys[ai_key_len++] = r < row ? 's' : 'w';
+    }
+    for (int c = cursor_col; c != col; c += c < col ? 1 : -1) {
+        ai_keys[ai_key_len++] = c < col ? 'd' : 'a';
+    }
+    ai_keys[ai_key_len++] = '\n';
+
+    if (classic_board()) {
+        snprintf(ai_line, sizeof(ai_line), "AI: perfect play from the tablebase");
+        return;
+    }
+    format_stats(stats, sizeof(stats), &search_stats);
+    snprintf(ai_line, sizeof(ai_line), "AI depth %d: %s", search_stats.depth, stats);
+}
+
+// Session totals, printed on exit
+void report_ai(FILE *f) {
+    char stats[64];
+    if (ai_moves == 0) return;
+    format_stats(stats, sizeof(stats), &total_stats);
+    fprintf(f, "AI: %d moves, %.1f ms per move, %s\n", ai_moves,
+            total_stats.elapsed_ns / 1e6 / ai_moves, stats);
+}
 
-    exit(0);
+// Ask the game to quit. The board may hold the search's trial stones right
+// now, so saving and restoring the terminal is left to the normal exit path
+// once read_input() sees the flag.
+void signal_handler(int signum) {
+    (void)signum;
+    quit_signal = 1;
 }
 
 // Function to display the game board with the cursor position highlighted
 void display_board() {
-    system("clear");
-    printf("Player %c's turn\n", current_player);
-    for (int i = 0; i < ROWS; i++) {
-        for (int j = 0; j < COLS; j++) {
+    if (!interactive) return;
+    render_clear(&screen);
+
+    // The hint marks the best cell and says what it leads to
+    int hint_row = -1, hint_col = -1;
+    uint8_t entry = show_hint && classic_board() ? table_entry() : XOX_NO_MOVE;
+    if (XOX_MOVE(entry) != XOX_NO_MOVE) {
+        static const char *outcomes[3] = {"loses", "draws", "wins"};
+        hint_row = XOX_MOVE(entry) / 3;
+        hint_col = XOX_MOVE(entry) % 3;
+        render_text(&screen, 0, 0, "Player %c's turn, best play %s", current_player,
+                    outcomes[XOX_VALUE(entry)]);
+    } else {
+        render_text(&screen, 0, 0, "Player %c's turn (%d in a row wins)", current_player, win_length);
+    }
+    for (int i = 0; i < board_rows; i++) {
+        int row = 1 + i * 2;
+        for (int j = 0; j < board_cols; j++) {
+            int col = j * 4;
+            char symbol = i == hint_row && j == hint_col ? '*' : cell_at(i, j);
             if (i == cursor_row && j == cursor_col) {
-                printf("[");
-                if (board[i][j] == ' ') printf(" ");
-                else printf("%c", board[i][j]);
-                printf("]");
+                render_put(&screen, row, col, '[');
+                render_put(&screen, row, col + 1, symbol);
+                render_put(&screen, row, col + 2, ']');
             } else {
-                printf(" %c ", board[i][j]);
+                render_put(&screen, row, col + 1, symbol);
             }
-            if (j < COLS - 1) printf("|");
+            if (j < board_cols - 1) render_put(&screen, row, col + 3, '|');
         }
-        printf("\n");
-        if (i < ROWS - 1) {
-            for (int j = 0; j < COLS; j++) {
-                printf("---");
-                if (j < COLS - 1) printf("|");
+        if (i < board_rows - 1) {
+            for (int j = 0; j < board_cols; j++) {
+                render_text(&screen, row + 1, j * 4, "---");
+                if (j < board_cols - 1) render_put(&screen, row + 1, j * 4 + 3, '|');
             }
-            printf("\n");
         }
     }
-    printf("\n");
+    if (ai_line[0]) render_text(&screen, STATUS_ROW + 2, 0, "%s", ai_line);
+    render_present(&screen);
 }
 
-// Function to check if the game is over
-char check_winner() {
-    for (int i = 0; i < ROWS; i++) {
-        if (board[i][0] == board[i][1] && board[i][1] == board[i][2] && board[i][0] != ' ') {
-            return board[i][0];
-        }
-        if (board[0][i] == board[1][i] && board[1][i] == board[2][i] && board[0][i] != ' ') {
-            return board[0][i];
-        }
+// Show a message under the board without redrawing it
+void display_message(int line, const char *message) {
+    if (!interactive) return;
+    render_text(&screen, STATUS_ROW + line, 0, "%s", message);
+    render_present(&screen);
+}
+
+// Stones of one player in an unbroken line through (row, col) along
+// (dr, dc), counting both ways; stops once win_length is reached
+int line_length(const Bitboard *b, int row, int col, int dr, int dc) {
+    int count = 1;
+    for (int r = row + dr, c = col + dc; count < win_length &&
+         r >= 0 && r < board_rows && c >= 0 && c < board_cols &&
+         bb_test(b, r * board_cols + c); r += dr, c += dc) {
+        count++;
     }
-    if (board[0][0] == board[1][1] && board[1][1] == board[2][2] && board[0][0] != ' ') {
-        return board[0][0];
+    for (int r = row - dr, c = col - dc; count < win_length &&
+         r >= 0 && r < board_rows && c >= 0 && c < board_cols &&
+         bb_test(b, r * board_cols + c); r -= dr, c -= dc) {
+        count++;
     }
-    if (board[0][2] == board[1][1] && board[1][1] == board[2][0] && board[0][2] != ' ') {
-        return board[0][2];
+    return count;
+}
+
+// Outcome after a stone was placed at (row, col). Only the four lines
+// through that stone can have changed, so only they are checked.
+char check_winner(int row, int col) {
+    int cell = row * board_cols + col;
+    int player = bb_test(&stones[1], cell);
+    const Bitboard *b = &stones[player];
+    if (line_length(b, row, col, 0, 1) >= win_length ||
+        line_length(b, row, col, 1, 0) >= win_length ||
+        line_length(b, row, col, 1, 1) >= win_length ||
+        line_length(b, row, col, 1, -1) >= win_length) {
+        return player ? 'O' : 'X';
     }
-    int empty = 0;
-    for (int i = 0; i < ROWS; i++) {
-        for (int j = 0; j < COLS; j++) {
-            if (board[i][j] == ' ') empty++;
-        }
+    return (empty_cells == 0) ? 'T' : ' ';
+}
+
+// Put the current player's stone on a free cell, returns 0 if it is taken
+int place_stone(int row, int col) {
+    int cell = row * board_cols + col;
+    if (bb_test(&stones[0], cell) || bb_test(&stones[1], cell)) {
+        return 0;
     }
-    return (empty == 0) ? 'T' : ' ';
+    make_move(cell, current_player == 'O');
+    return 1;
 }
 
 void set_raw_mode() {
@@ -82,15 +542,17 @@ void set_raw_mode() {
 }
 
 void restore_mode() {
+    render_shutdown(&screen);
     tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
 }
 
 void init_board() {
-    for (int i = 0; i < ROWS; i++) {
-        for (int j = 0; j < COLS; j++) {
-            board[i][j] = ' ';
-        }
-    }
+    memset(stones, 0, sizeof(stones));
+    memset(window_stones, 0, sizeof(window_stones));
+    memset(near_stones, 0, sizeof(near_stones));
+    empty_cells = board_rows * board_cols;
+    eval_score = 0;
+    position_key = 0;
     cursor_row = 0;
     cursor_col = 0;
     current_player = 'X';
@@ -100,72 +562,376 @@ void clear_input_buffer() {
     tcflush(STDIN_FILENO, TCIFLUSH);
 }
 
+// Hash of the board, cursor and player to move, used to verify replays
+uint64_t board_hash() {
+    uint64_t hash = replay_hash(REPLAY_HASH_INIT, stones, sizeof(stones));
+    int scalars[] = {cursor_row, cursor_col, current_player};
+    return replay_hash(hash, scalars, sizeof(scalars));
+}
+
+// Everything a round in progress needs to carry on: the settings and the
+// stones. The search's incremental counts are recounted from the stones on
+// resume, which also checks them.
+typedef struct {
+    int board_rows, board_cols, win_length;
+    Bitboard stones[2];
+    int cursor_row, cursor_col;
+    char current_player, ai_player;
+    int show_hint;
+} XoxSave;
+
+// Save the round in progress as snapshot name, returns -1 on failure
+int save_game(const char *name) {
+    static XoxSave save;
+    save.board_rows = board_rows;
+    save.board_cols = board_cols;
+    save.win_length = win_length;
+    memcpy(save.stones, stones, sizeof(stones));
+    save.cursor_row = cursor_row;
+    save.cursor_col = cursor_col;
+    save.current_player = current_player;
+    save.ai_player = ai_player;
+    save.show_hint = show_hint;
+    struct iovec sections[] = {{&save, sizeof(save)}};
+    return snapshot_save(name, "xox2P", SNAPSHOT_STATE, sections, 1);
+}
+
+// Put the saved stones on an empty board one by one, which recounts all
+// the search keeps incrementally. Returns 0 unless they make a round this
+// build could have saved: every stone on the board and on a cell of its
+// own, X having opened and the players taking turns, player to move next,
+// and nobody won yet with cells left to play.
+int replay_stones(const Bitboard saved[2], char player) {
+    int count[2] = {0, 0};
+    init_board();
+    for (int p = 0; p < 2; p++) {
+        for (int cell = 0; cell < BOARD_WORDS * 64; cell++) {
+            if (!bb_test(&saved[p], cell)) continue;
+            if (cell >= board_rows * board_cols || bb_test(&stones[0], cell) ||
+                bb_test(&stones[1], cell) || make_move(cell, p)) {
+                return 0;
+            }
+            count[p]++;
+        }
+    }
+    return (count[0] == count[1] || count[0] == count[1] + 1) && empty_cells > 0 &&
+           player == (count[0] == count[1] ? 'X' : 'O');
+}
+
+// Take over the round in snapshot name, returns 0 if there is none or it
+// doesn't hold up. Its settings replace the ones given on the command line.
+int resume_game(const char *name) {
+    Snapshot snap;
+    int rows = board_rows, cols = board_cols, win = win_length;
+    if (snapshot_open(&snap, name, "xox2P", SNAPSHOT_STATE) < 0) return 0;
+    const XoxSave *save = snapshot_section(&snap, 0, sizeof(XoxSave));
+    int ok = save != NULL;
+    if (ok) {
+        board_rows = save->board_rows;
+        board_cols = save->board_cols;
+        win_length = save->win_length;
+        ok = valid_settings() && save->cursor_row >= 0 && save->cursor_row < board_rows &&
+             save->cursor_col >= 0 && save->cursor_col < board_cols &&
+             (save->ai_player == 0 || save->ai_player == 'X' || save->ai_player == 'O');
+    }
+    if (ok) {
+        init_lines(); // Fixed tables for the saved board size
+        ok = replay_stones(save->stones, save->current_player);
+    }
+    if (ok) {
+        cursor_row = save->cursor_row;
+        cursor_col = save->cursor_col;
+        current_player = save->current_player;
+        ai_player = save->ai_player;
+        show_hint = save->show_hint != 0;
+    } else {
+        // Back to the command line's board
+        board_rows = rows;
+        board_cols = cols;
+        win_length = win;
+        init_lines();
+    }
+    snapshot_close(&snap);
+    return ok;
+}
+
+// On exit keep an undecided round for next time and drop a finished one
+void save_or_forget() {
+    if (!interactive) return; // Replays and self-play leave the saved game alone
+    if (in_round) {
+        save_game(SNAPSHOT_NAME);
+    } else {
+        snapshot_remove(SNAPSHOT_NAME);
+    }
+}
+
+// Next key from the player or the replay; every key read is recorded.
+// A replay that runs out of keys quits, and so does a signal.
+char read_input() {
+    int input;
+    if (quit_signal) {
+        return 'q';
+    } else if (!interactive) {
+        input = ticks < replay_end_tick(&replay) ? replay_key(&replay, ticks) : 'q';
+    } else if (ai_key_pos < ai_key_len) {
+        input = ai_keys[ai_key_pos++];
+        replay_record(&recorder, ticks, input);
+    } else {
+        input = getchar(); // EOF if a signal interrupts the read
+        if (input == EOF) return 'q';
+        replay_record(&recorder, ticks, input);
+    }
+    ticks++;
+    return input;
+}
+
 int prompt_restart() {
     char choice;
-    printf("Do you want to play again? (y/n): ");
+    display_message(1, "Do you want to play again? (y/n): ");
     while (1) {
-        choice = getchar();
+        choice = read_input();
         if (choice == 'y' || choice == 'Y') {
             return 1;
         } else if (choice == 'n' || choice == 'N' || choice == 'q' || choice == 'Q') {
-            restore_mode();
-            printf("\nGame exited. Thanks for playing!\n");
             return 0;
         }
     }
 }
 
-int main() {
-    // Register signal handlers
-    signal(SIGTERM, signal_handler);
-    signal(SIGINT, signal_handler);
-
-    set_raw_mode();
-
+// Play rounds until a player quits
+void play() {
     while (1) {
-        init_board();
+        if (!resumed) init_board();
+        resumed = 0;
+        in_round = 1;
         char winner = ' ';
         while (1) {
             display_board();
-            char input = getchar();
+            if (interactive && current_player == ai_player && ai_key_pos == ai_key_len) {
+                queue_ai_move();
+            }
+            char input = read_input();
             if (input == 'q') {
-                clear_input_buffer();
-                restore_mode();
-                printf("Game exited. Thanks for playing!\n");
-                return 0;
+                return;
             }
 
             switch (input) {
                 case 'w': cursor_row = (cursor_row > 0) ? cursor_row - 1 : cursor_row; break;
-                case 's': cursor_row = (cursor_row < ROWS - 1) ? cursor_row + 1 : cursor_row; break;
+                case 's': cursor_row = (cursor_row < board_rows - 1) ? cursor_row + 1 : cursor_row; break;
                 case 'a': cursor_col = (cursor_col > 0) ? cursor_col - 1 : cursor_col; break;
-                case 'd': cursor_col = (cursor_col < COLS - 1) ? cursor_col + 1 : cursor_col; break;
-                case '\n': 
-                    if (board[cursor_row][cursor_col] == ' ') {
-                        board[cursor_row][cursor_col] = current_player;
+                case 'd': cursor_col = (cursor_col < board_cols - 1) ? cursor_col + 1 : cursor_col; break;
+                case 'h': show_hint = !show_hint; break;
+                case '\n':
+                    // Cursor moves can't end the game, only a new stone can
+                    if (place_stone(cursor_row, cursor_col)) {
+                        winner = check_winner(cursor_row, cursor_col);
                         current_player = (current_player == 'X') ? 'O' : 'X';
                     }
                     break;
             }
-            winner = check_winner();
 
             if (winner != ' ') {
+                in_round = 0;
                 display_board();
                 if (winner == 'X' || winner == 'O') {
-                    printf("Player %c wins!\n", winner);
+                    char message[32];
+                    snprintf(message, sizeof(message), "Player %c wins!", winner);
+                    display_message(0, message);
                 } else if (winner == 'T') {
-                    printf("It's a tie!\n");
+                    display_message(0, "It's a tie!");
                 }
                 break;
             }
         }
 
         if (!prompt_restart()) {
-            break;
+            return;
         }
     }
+}
+
+// Play a recorded session back from a memory-mapped file as fast as possible
+// and check that it ends in the recorded state
+int run_replay(const char *path) {
+    if (replay_open(&replay, path, "xox2P") < 0) {
+        fprintf(stderr, "%s is not a xox2P replay\n", path);
+        return 1;
+    }
+    board_rows = replay.header.params[0];
+    board_cols = replay.header.params[1];
+    win_length = replay.header.params[2];
+    if (!valid_settings()) {
+        fprintf(stderr, "%s has an unsupported board size\n", path);
+        replay_close(&replay);
+        return 1;
+    }
+    init_lines();
+    interactive = 0;
+
+    uint64_t start = bench_now_ns();
+    play();
+    uint64_t elapsed = bench_now_ns() - start;
+    printf("Replayed %llu keys in %llu ns\n", (unsigned long long)ticks, (unsigned long long)elapsed);
+
+    int status = 0;
+    if (!replay.has_footer) {
+        printf("Replay has no footer (session did not exit cleanly), state not verified\n");
+    } else if (board_hash() == replay.footer.state_hash) {
+        printf("Final state matches the recording\n");
+    } else {
+        printf("Final state DIFFERS from the recording\n");
+        status = 1;
+    }
+    replay_close(&replay);
+    return status;
+}
 
+// Let the computer play both sides without a terminal and report the
+// results and search speed
+void run_selfplay(int games) {
+    int wins[2] = {0, 0}, ties = 0;
+    interactive = 0;
+    for (int game = 1; game <= games; game++) {
+        char winner = ' ';
+        int moves = 0;
+        init_board();
+        while (winner == ' ') {
+            int cell = ai_choose_move();
+            place_stone(cell / board_cols, cell % board_cols);
+            winner = check_winner(cell / board_cols, cell % board_cols);
+            current_player = (current_player == 'X') ? 'O' : 'X';
+            moves++;
+        }
+        if (winner == 'T') {
+            ties++;
+            printf("Game %d: tie after %d moves\n", game, moves);
+        } else {
+            wins[winner == 'O']++;
+            printf("Game %d: %c wins in %d moves\n", game, winner, moves);
+        }
+    }
+    printf("%dx%d, %d in a row, %ld ms per move: X %d, O %d, ties %d\n",
+           board_rows, board_cols, win_length, ai_budget_ms, wins[0], wins[1], ties);
+    report_ai(stdout);
+}
+
+// Print the command-line help
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--size N|ROWSxCOLS] [--win K] [--ai X|O] [--budget MS] [--record FILE] [--new]\n"
+                    "       %s [--size N|ROWSxCOLS] [--win K] [--budget MS] --selfplay GAMES\n"
+                    "       %s --replay FILE\n"
+                    "Sides must be between %d and %d, K between %d and the longer side.\n"
+                    "The default is 3x3, three in a row; --size 15 --win 5 plays gomoku.\n"
+                    "--ai lets the computer play a side, thinking up to MS ms per move (default %d).\n"
+                    "On the classic 3x3 board 'h' shows the best move.\n"
+                    "A round that is quit is saved in %s and resumed, with its settings, on\n"
+                    "the next start; --new starts over.\n",
+            program, program, program, MIN_SIZE, MAX_SIZE, MIN_SIZE,
+            AI_DEFAULT_BUDGET_MS, STORAGE_DEFAULT);
+}
+
+// Check the board size and win length are playable
+int valid_settings() {
+    return board_rows >= MIN_SIZE && board_rows <= MAX_SIZE &&
+           board_cols >= MIN_SIZE && board_cols <= MAX_SIZE &&
+           win_length >= MIN_SIZE &&
+           win_length <= (board_rows > board_cols ? board_rows : board_cols);
+}
+
+// Parse "N" or "ROWSxCOLS" into the board size
+int parse_size(const char *text) {
+    char *end;
+    board_rows = board_cols = strtol(text, &end, 10);
+    if (*end == 'x' || *end == 'X') {
+        board_cols = strtol(end + 1, &end, 10);
+    }
+    return *end == '\0';
+}
+
+int main(int argc, char *argv[]) {
+    const char *record_path = NULL;
+    int win_given = 0;
+    int selfplay_games = 0;
+    int fresh = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            return run_replay(argv[i + 1]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc && parse_size(argv[i + 1])) {
+            i++;
+        } else if (strcmp(argv[i], "--win") == 0 && i + 1 < argc) {
+            win_length = atoi(argv[++i]);
+            win_given = 1;
+        } else if (strcmp(argv[i], "--ai") == 0 && i + 1 < argc &&
+                   (argv[i + 1][0] == 'X' || argv[i + 1][0] == 'O')) {
+            ai_player = argv[++i][0];
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc && atol(argv[i + 1]) > 0) {
+            ai_budget_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--selfplay") == 0 && i + 1 < argc) {
+            selfplay_games = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--new") == 0) {
+            fresh = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    // Without --win, fill the shorter side (capped at five, as in gomoku)
+    if (!win_given) {
+        win_length = board_rows < board_cols ? board_rows : board_cols;
+        if (win_length > 5) win_length = 5;
+    }
+    if (!valid_settings()) {
+        usage(argv[0]);
+        return 1;
+    }
+    init_lines();
+
+    if (selfplay_games > 0) {
+        run_selfplay(selfplay_games);
+        free(tt);
+        return 0;
+    }
+
+    // Pick up the round saved when it was last quit, unless starting over.
+    // A recording has to start from an empty board, so it always starts over.
+    resumed = !fresh && !record_path && resume_game(SNAPSHOT_NAME);
+
+    if (record_path) {
+        // The computer's moves are recorded as keys too, so nothing is
+        // random and the seed is always 0
+        uint32_t params[REPLAY_PARAMS] = {board_rows, board_cols, win_length};
+        if (replay_create(&recorder, record_path, "xox2P", 0, params) < 0) {
+            perror("Failed to create the replay file");
+            return 1;
+        }
+    }
+
+    // Register signal handlers. Without SA_RESTART a signal ends a blocked
+    // getchar(), so the game quits without waiting for another key.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    set_raw_mode();
+    if (render_init(&screen, SCREEN_COLS, SCREEN_ROWS) < 0) {
+        restore_mode();
+        fprintf(stderr, "Failed to allocate the screen buffers\n");
+        return 1;
+    }
+
+    play();
+
+    replay_finish(&recorder, ticks, board_hash());
+    save_or_forget();
+    clear_input_buffer();
     restore_mode();
+    printf("Game exited. Thanks for playing!\n");
+    report_ai(stdout);
+    free(tt);
     return 0;
 }
-
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "xox_table.h"
+
+// Generates src/xox_table.h, the solved tablebase for 3x3 tic-tac-toe
+// that xox2P uses for hints and perfect play, and checks it.
+//
+//   cc -O2 -o xox_tablegen src/xox_tablegen.c
+//   ./xox_tablegen > src/xox_table.h   # regenerate
+//   ./xox_tablegen --check             # verify the table compiled in
+//
+// A position is indexed by its cells in base 3 (empty 0, X 1, O 2, cell 0
+// lowest). Each entry holds the value for the side to move in the high
+// bits and the best move in the low four; unreachable positions are 0xFF.
+// --check re-solves every reachable position with a plain minimax that
+// shares no code with the generator and compares.
+
+#define POSITIONS 19683
+
+static const int lines[8][3] = {
+    {0, 1, 2}, {3, 4, 5}, {6, 7, 8}, {0, 3, 6},
+    {1, 4, 7}, {2, 5, 8}, {0, 4, 8}, {2, 4, 6},
+};
+
+// Generator: memoized negamax over base-3 indexes. Scores favour quick
+// wins and slow losses: a loss with e empty cells left is -(e + 1).
+
+static int8_t scores[POSITIONS];
+static uint8_t solved[POSITIONS];
+static uint8_t table[POSITIONS];
+static int pow3[9];
+
+static int cell_of(int index, int cell) {
+    return index / pow3[cell] % 3;
+}
+
+static int has_line(int index, int player) {
+    for (int i = 0; i < 8; i++) {
+        if (cell_of(index, lines[i][0]) == player && cell_of(index, lines[i][1]) == player &&
+            cell_of(index, lines[i][2]) == player) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int solve(int index) {
+    if (solved[index]) return scores[index];
+    int x = 0, o = 0;
+    for (int cell = 0; cell < 9; cell++) {
+        x += cell_of(index, cell) == 1;
+        o += cell_of(index, cell) == 2;
+    }
+    int mover = x == o ? 1 : 2, empty = 9 - x - o;
+    int score, best_move = XOX_NO_MOVE;
+
+    if (has_line(index, 3 - mover)) {
+        score = -(empty + 1);
+    } else if (empty == 0) {
+        score = 0;
+    } else {
+        score = -100;
+        for (int cell = 0; cell < 9; cell++) {
+            if (cell_of(index, cell)) continue;
+            int child = -solve(index + mover * pow3[cell]);
+            if (child > score) {
+                score = child;
+                best_move = cell;
+            }
+        }
+    }
+    int value = score > 0 ? XOX_WIN : score < 0 ? XOX_LOSS : XOX_DRAW;
+    solved[index] = 1;
+    scores[index] = score;
+    table[index] = value << 4 | best_move;
+    return score;
+}
+
+static void generate() {
+    solve(0);
+    printf("#ifndef XOX_TABLE_H\n"
+           "#define XOX_TABLE_H\n"
+           "\n"
+           "#include <stdint.h>\n"
+           "\n"
+           "// Solved 3x3 tic-tac-toe. Generated by src/xox_tablegen.c, do not edit.\n"
+           "//\n"
+           "// xox_table[xox_base3[x] + 2 * xox_base3[o]] for the 9-bit stone masks\n"
+           "// of X and O gives XOX_VALUE() for the side to move and XOX_MOVE(), the\n"
+           "// cell to play (XOX_NO_MOVE once the game is over). Positions that can't\n"
+           "// arise in play are XOX_UNREACHABLE.\n"
+           "\n"
+           "#define XOX_LOSS 0\n"
+           "#define XOX_DRAW 1\n"
+           "#define XOX_WIN 2\n"
+           "#define XOX_NO_MOVE 15\n"
+           "#define XOX_UNREACHABLE 0xFF\n"
+           "#define XOX_VALUE(entry) ((entry) >> 4)\n"
+           "#define XOX_MOVE(entry) ((entry) & 15)\n"
+           "\n"
+           "static const uint16_t xox_base3[512] = {\n");
+    for (int mask = 0; mask < 512; mask++) {
+        int index = 0;
+        for (int cell = 0; cell < 9; cell++) {
+            if ((mask >> cell) & 1) index += pow3[cell];
+        }
+        printf("%s%5d,%s", mask % 12 ? "" : "   ", index, mask % 12 == 11 || mask == 511 ? "\n" : "");
+    }
+    printf("};\n"
+           "\n"
+           "static const uint8_t xox_table[%d] = {\n", POSITIONS);
+    for (int index = 0; index < POSITIONS; index++) {
+        printf("%s0x%02X,%s", index % 16 ? " " : "   ", solved[index] ? table[index] : XOX_UNREACHABLE,
+               index % 16 == 15 || index == POSITIONS - 1 ? "\n" : "");
+    }
+    printf("};\n"
+           "\n"
+           "#endif\n");
+}
+
+// Checker: plain minimax over a char board, no memo, no base 3
+
+static char board[9];
+
+static int board_line(char player) {
+    for (int i = 0; i < 8; i++) {
+        if (board[lines[i][0]] == player && board[lines[i][1]] == player &&
+            board[lines[i][2]] == player) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Value for the side to move: 1 win, 0 draw, -1 loss
+static int minimax(char mover) {
+    char other = mover == 'X' ? 'O' : 'X';
+    if (board_line(other)) return -1;
+    int best = -2, moves = 0;
+    for (int cell = 0; cell < 9; cell++) {
+        if (board[cell] != ' ') continue;
+        moves++;
+        board[cell] = mover;
+        int value = -minimax(other);
+        board[cell] = ' ';
+        if (value > best) best = value;
+    }
+    return moves ? best : 0;
+}
+
+static int table_index() {
+    int x = 0, o = 0;
+    for (int cell = 0; cell < 9; cell++) {
+        if (board[cell] == 'X') x |= 1 << cell;
+        if (board[cell] == 'O') o |= 1 << cell;
+    }
+    return xox_base3[x] + 2 * xox_base3[o];
+}
+
+static uint8_t visited[POSITIONS];
+static long checked, errors;
+
+// Walk every position reachable in play and compare with the table
+static void check_from(char mover) {
+    int index = table_index();
+    if (visited[index]) return;
+    visited[index] = 1;
+    checked++;
+
+    uint8_t entry = xox_table[index];
+    int value = minimax(mover);
+    int over = board_line('X') || board_line('O') || !memchr(board, ' ', 9);
+    int move = XOX_MOVE(entry);
+    if (entry == XOX_UNREACHABLE || XOX_VALUE(entry) != value + 1) {
+        errors++;
+    } else if (over != (move == XOX_NO_MOVE)) {
+        errors++;
+    } else if (!over) {
+        // The stored move must keep the value
+        char other = mover == 'X' ? 'O' : 'X';
+        if (move > 8 || board[move] != ' ') {
+            errors++;
+        } else {
+            board[move] = mover;
+            if (-minimax(other) != value) errors++;
+            board[move] = ' ';
+        }
+    }
+    if (over) return;
+    for (int cell = 0; cell < 9; cell++) {
+        if (board[cell] != ' ') continue;
+        board[cell] = mover;
+        check_from(mover == 'X' ? 'O' : 'X');
+        board[cell] = ' ';
+    }
+}
+
+static int check() {
+    long unreachable_set = 0;
+    memset(board, ' ', sizeof(board));
+    check_from('X');
+    for (int index = 0; index < POSITIONS; index++) {
+        if (!visited[index] && xox_table[index] != XOX_UNREACHABLE) unreachable_set++;
+    }
+    printf("Checked %ld reachable positions: %ld wrong, %ld unreachable with entries\n",
+           checked, errors, unreachable_set);
+    printf("Opening value for X: %s\n",
+           (const char *[]){"loss", "draw", "win"}[XOX_VALUE(xox_table[0])]);
+    return errors || unreachable_set;
+}
+
+int main(int argc, char *argv[]) {
+    pow3[0] = 1;
+    for (int i = 1; i < 9; i++) pow3[i] = pow3[i - 1] * 3;
+
+    if (argc == 2 && strcmp(argv[1], "--check") == 0) {
+        return check();
+    }
+    if (argc != 1) {
+        fprintf(stderr, "Usage: %s [--check]\n", argv[0]);
+        return 1;
+    }
+    generate();
+    return 0;
+}
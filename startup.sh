@@ -43,6 +43,8 @@ echo "Mounting $DISK_IMAGE to $MOUNT_DIR..."
 sudo mount -o loop "$DISK_IMAGE" "$MOUNT_DIR"
 
 if [ $? -eq 0 ]; then
+    # The games keep their scores here, so they must be able to write
+    sudo chown "$(id -u):$(id -g)" "$MOUNT_DIR"
     echo "Disk image $DISK_IMAGE mounted successfully to $MOUNT_DIR."
 else
     echo "Error: Failed to mount $DISK_IMAGE. Exiting."